@@ -29,6 +29,7 @@
 #include "main/node.h"
 #include "utils/model_factory.h"
 #include "main/reads_aligner.h"
+#include "main/placement_server.h"
 
 #ifdef __MACH__
 #include <mach/clock.h>
@@ -111,6 +112,9 @@ int main(int argc, char *argv[])
     Log_output::write_out(ss.str(),1);
     /***********************************************************************/
 
+    if( Settings_handle::st.is("placement-server") )
+        Placement_server::check_options();
+
 
 
 
@@ -122,26 +126,37 @@ int main(int argc, char *argv[])
     Fasta_reader fr;
     vector<Fasta_entry> sequences;
     bool reference_alignment = false;
+    bool reference_snapshot = Settings_handle::st.is("ref-snapshot");
 
     Input_output_parser iop;
-    iop.parse_input_sequences(&fr,&sequences,&reference_alignment);
+    Node *root;
+    int data_type = -1;
 
+    if(reference_snapshot)
+    {
+        root = iop.read_reference_snapshot(&fr,&data_type);
+        reference_alignment = true;
+    }
+    else
+    {
+        iop.parse_input_sequences(&fr,&sequences,&reference_alignment);
 
 
-    /***********************************************************************/
-    /*  Read the guidetree file                                            */
-    /***********************************************************************/
 
-    Node *root = iop.parse_input_tree(&fr,&sequences,reference_alignment,n_threads);
+        /***********************************************************************/
+        /*  Read the guidetree file                                            */
+        /***********************************************************************/
 
+        root = iop.parse_input_tree(&fr,&sequences,reference_alignment,n_threads);
 
 
-    /***********************************************************************/
-    /*  Check that input is fine and place the sequences to nodes          */
-    /***********************************************************************/
 
-    int data_type = -1;
-    iop.match_sequences_and_tree(&fr,&sequences,root,reference_alignment,&data_type);
+        /***********************************************************************/
+        /*  Check that input is fine and place the sequences to nodes          */
+        /***********************************************************************/
+
+        iop.match_sequences_and_tree(&fr,&sequences,root,reference_alignment,&data_type);
+    }
 
 
     /***********************************************************************/
@@ -178,7 +193,14 @@ int main(int argc, char *argv[])
 
     if(reference_alignment)
     {
-        root->read_reference_alignment(&mf);
+        // a snapshot already contains the ancestral sequence graphs
+        if(!reference_snapshot)
+        {
+            root->read_reference_alignment(&mf);
+
+            if(Settings_handle::st.is("save-ref-snapshot"))
+                iop.save_reference_snapshot(&fr,root,data_type);
+        }
     }
     else
     {
@@ -199,6 +221,20 @@ int main(int argc, char *argv[])
 
 
 
+    /***********************************************************************/
+    /*  Server mode: place query batches from stdin until it is closed.    */
+    /***********************************************************************/
+
+    if( Settings_handle::st.is("placement-server") )
+    {
+        Placement_server ps(root,&mf,data_type,fr.base_frequencies(),count);
+        ps.run(cin,cout);
+
+        delete root;
+        return 0;
+    }
+
+
     /***********************************************************************/
     /*  If query sequences, add them to the alignment.                     */
     /***********************************************************************/
@@ -223,7 +259,7 @@ int main(int argc, char *argv[])
     /*  Collect the results and output them                                */
     /***********************************************************************/
 
-    iop.output_aligned_sequences(&fr,&sequences,root);
+    iop.output_aligned_sequences(&fr,&sequences,root,&mf,n_threads);
 
 
     /***********************************************************************/
@@ -33,7 +33,7 @@ Node::~Node()
     if(this->has_right_child())
         delete right_child;
 
-    if(this->node_has_sequence_object)
+    if(this->node_has_sequence_object && !this->sequence_is_shared)
         delete sequence;
 
 }
@@ -62,13 +62,19 @@ void Node::align_sequences_this_node(Model_factory *mf, bool is_reads_sequence)
         }
 //        else
 //            Log_output::append_msg(" to node '"+left_child->get_name()+"'.",0);
+        #pragma omp atomic
         alignment_number++;
     }
 
     clock_t t_start=clock();
 
     double dist = left_child->get_distance_to_parent()+right_child->get_distance_to_parent();
-    Evol_model model = mf->alignment_model(dist);
+
+    // candidate nodes of a query may be scored in parallel
+    Evol_model model(mf->get_sequence_data_type(), dist);
+
+    #pragma omp critical
+    model = mf->alignment_model(dist);
 
     stringstream ss;
     ss << "Time node::model: "<<double(clock()-t_start)/CLOCKS_PER_SEC<<"\n";
@@ -410,16 +416,27 @@ void Node::get_alignment_for_nodes(vector<Fasta_entry> *aligned_sequences,bool i
         Sequence *root = this->get_sequence();
         int root_length = root->sites_length();
 
-        for(int j=1;j<root_length-1;j++)
-        {
-            vector<string> column;
-            this->get_alignment_column_at(j,&column,include_internal_nodes);
+        // Rows are filled one at a time from the site index each node has
+        // at the root columns; the indexes are projected down the tree.
+        //
+        map<Node*,int> rows;
+        map<Node*,int> sizes;
+        int next_row = 0;
+        this->index_alignment_rows(&rows,&sizes,&next_row,include_internal_nodes);
 
-            for(unsigned int i=0;i<aligned_sequences->size();i++)
-            {
-                aligned_sequences->at(i).sequence.append(column.at(i));
-            }
-        }
+        int width = 1;
+        if(root_length>2)
+            width = root->get_site_at(1)->get_symbol().length();
+
+        for(unsigned int i=0;i<aligned_sequences->size();i++)
+            aligned_sequences->at(i).sequence.reserve(aligned_sequences->at(i).sequence.length()+width*root_length);
+
+        vector<int> index;
+        index.reserve(root_length);
+        for(int j=0;j<root_length;j++)
+            index.push_back(j);
+
+        this->get_alignment_rows(&index,sequence->get_gap_symbol(),&rows,&sizes,aligned_sequences,include_internal_nodes);
 
         if(Settings_handle::st.is("pileup-alignment") && Settings_handle::st.is("use-consensus"))
             this->add_root_consensus(aligned_sequences);
@@ -472,6 +489,170 @@ void Node::get_alignment_for_nodes(vector<Fasta_entry> *aligned_sequences,bool i
     }
 }
 
+void Node::index_alignment_rows(map<Node*,int> *rows, map<Node*,int> *sizes, int *next_row, bool include_internal_nodes)
+{
+    if(leaf)
+    {
+        rows->insert(make_pair(this,(*next_row)++));
+        sizes->insert(make_pair(this,1));
+        return;
+    }
+
+    left_child->index_alignment_rows(rows,sizes,next_row,include_internal_nodes);
+
+    if(include_internal_nodes)
+        rows->insert(make_pair(this,(*next_row)++));
+
+    right_child->index_alignment_rows(rows,sizes,next_row,include_internal_nodes);
+
+    sizes->insert(make_pair(this,sizes->find(left_child)->second+sizes->find(right_child)->second+1));
+}
+
+void Node::get_alignment_rows(vector<int> *index, const string &gap, map<Node*,int> *rows, map<Node*,int> *sizes,
+                              vector<Fasta_entry> *aligned_sequences, bool include_internal_nodes)
+{
+    int root_length = index->size();
+
+    map<Node*,int>::iterator rit = rows->find(this);
+    if(rit != rows->end())
+        this->append_alignment_row(index,gap,&aligned_sequences->at(rit->second).sequence);
+
+    if(leaf)
+        return;
+
+    // The smaller subtree gets a copy of the indexes and the larger one
+    // reuses this node's array: at most log(n) arrays are alive at once.
+    //
+    bool left_is_larger = sizes->find(left_child)->second >= sizes->find(right_child)->second;
+    Node *small = left_is_larger ? right_child : left_child;
+    Node *large = left_is_larger ? left_child : right_child;
+
+    {
+        vector<int> small_index(root_length,-1);
+        for(int j=1;j<root_length-1;j++)
+        {
+            int i = index->at(j);
+            if(i>=0)
+            {
+                Site_children *offspring = sequence->get_site_at(i)->get_children();
+                small_index.at(j) = left_is_larger ? offspring->right_index : offspring->left_index;
+            }
+        }
+        small->get_alignment_rows(&small_index,gap,rows,sizes,aligned_sequences,include_internal_nodes);
+    }
+
+    for(int j=1;j<root_length-1;j++)
+    {
+        int i = index->at(j);
+        if(i>=0)
+        {
+            Site_children *offspring = sequence->get_site_at(i)->get_children();
+            index->at(j) = left_is_larger ? offspring->left_index : offspring->right_index;
+        }
+    }
+    large->get_alignment_rows(index,gap,rows,sizes,aligned_sequences,include_internal_nodes);
+}
+
+void Node::append_alignment_row(const vector<int> *index, const string &gap, string *row)
+{
+    int root_length = index->size();
+
+    for(int j=1;j<root_length-1;j++)
+    {
+        int i = index->at(j);
+
+        if(i<0)
+            row->append(gap);
+        else if(leaf)
+            row->append(sequence->get_site_at(i)->get_symbol());
+        else
+        {
+            Site *site = sequence->get_site_at(i);
+            int pstate = site->get_path_state();
+            int ptype  = site->get_site_type();
+
+            if( pstate == Site::xskipped || pstate == Site::yskipped || ptype == Site::non_real)
+                row->append(sequence->get_gap_symbol());
+            else
+                row->append(Model_factory::get_ancestral_character_alphabet_at( site->get_state() ));
+        }
+    }
+}
+
+bool Node::can_stream_alignment_rows(bool include_internal_nodes)
+{
+    if(this->sequence_site_index_needs_correcting())
+        return false;
+
+    // The pileup consensus is an extra row that has no node
+    //
+    if(include_internal_nodes && Settings_handle::st.is("pileup-alignment") && Settings_handle::st.is("use-consensus"))
+        return false;
+
+    return true;
+}
+
+void Node::stream_alignment_rows(Alignment_row_sink *sink, bool include_internal_nodes)
+{
+    Sequence *root = this->get_sequence();
+    int root_length = root->sites_length();
+
+    int width = 1;
+    if(root_length>2)
+        width = root->get_site_at(1)->get_symbol().length();
+
+    vector<int> index;
+    index.reserve(root_length);
+    for(int j=0;j<root_length;j++)
+        index.push_back(j);
+
+    string row;
+    row.reserve(width*root_length);
+
+    this->stream_alignment_rows(&index,sequence->get_gap_symbol(),&row,sink,include_internal_nodes);
+}
+
+void Node::stream_alignment_rows(vector<int> *index, const string &gap, string *row, Alignment_row_sink *sink, bool include_internal_nodes)
+{
+    if(leaf)
+    {
+        row->clear();
+        this->append_alignment_row(index,gap,row);
+        sink->add_row(this,*row);
+        return;
+    }
+
+    // Rows are passed on in order, so the left subtree gets a copy of the
+    // indexes and the right one reuses this node's array once it is done.
+    //
+    int root_length = index->size();
+    {
+        vector<int> left_index(root_length,-1);
+        for(int j=1;j<root_length-1;j++)
+        {
+            int i = index->at(j);
+            if(i>=0)
+                left_index.at(j) = sequence->get_site_at(i)->get_children()->left_index;
+        }
+        left_child->stream_alignment_rows(&left_index,gap,row,sink,include_internal_nodes);
+    }
+
+    if(include_internal_nodes)
+    {
+        row->clear();
+        this->append_alignment_row(index,gap,row);
+        sink->add_row(this,*row);
+    }
+
+    for(int j=1;j<root_length-1;j++)
+    {
+        int i = index->at(j);
+        if(i>=0)
+            index->at(j) = sequence->get_site_at(i)->get_children()->right_index;
+    }
+    right_child->stream_alignment_rows(index,gap,row,sink,include_internal_nodes);
+}
+
 void Node::get_alignment_for_reads(vector<Fasta_entry> *aligned_sequences, bool show_ref_insertions)
 {
     vector<Node*> nodes;
@@ -625,6 +806,96 @@ void Node::add_root_consensus(vector<Fasta_entry> *aligned_sequences)
 
 
 
+Node *Node::map_alignment_columns(const string &node_name, vector<int> *column_sites)
+{
+    int length = sequence->sites_length();
+    column_sites->resize(length);
+
+    vector<bool> go_left;
+    if(!this->find_path_to_node(node_name,&go_left))
+    {
+        column_sites->assign(length,-1);
+        return 0;
+    }
+
+    for(int j=0;j<length;j++)
+        column_sites->at(j) = j;
+
+    // the directions were collected on the way back up
+    Node *current = this;
+    for(int k=go_left.size()-1;k>=0;k--)
+    {
+        Sequence *current_sequence = current->get_sequence();
+        bool left = go_left.at(k);
+
+        for(int j=0;j<length;j++)
+        {
+            int i = column_sites->at(j);
+            if(i>=0)
+            {
+                Site_children *offspring = current_sequence->get_site_at(i)->get_children();
+                column_sites->at(j) = left ? offspring->left_index : offspring->right_index;
+            }
+        }
+
+        current = left ? current->left_child : current->right_child;
+    }
+
+    return current;
+}
+
+bool Node::find_path_to_node(const string &node_name, vector<bool> *go_left)
+{
+    if(this->get_name() == node_name)
+        return true;
+
+    if(leaf)
+        return false;
+
+    if(left_child->find_path_to_node(node_name,go_left))
+    {
+        go_left->push_back(true);
+        return true;
+    }
+
+    if(right_child->find_path_to_node(node_name,go_left))
+    {
+        go_left->push_back(false);
+        return true;
+    }
+
+    return false;
+}
+
+void Node::get_other_leaf_columns(const string &node_name, boost::dynamic_bitset<> *columns)
+{
+    int length = sequence->sites_length();
+    columns->clear();
+    columns->resize(length,false);
+
+    if(leaf)
+    {
+        if(this->get_name() != node_name)
+            columns->set();
+        return;
+    }
+
+    boost::dynamic_bitset<> left_columns;
+    boost::dynamic_bitset<> right_columns;
+    left_child->get_other_leaf_columns(node_name,&left_columns);
+    right_child->get_other_leaf_columns(node_name,&right_columns);
+
+    for(int j=0;j<length;j++)
+    {
+        Site_children *offspring = sequence->get_site_at(j)->get_children();
+        int lj = offspring->left_index;
+        int rj = offspring->right_index;
+
+        if( (lj>=0 && left_columns[lj]) || (rj>=0 && right_columns[rj]) )
+            columns->set(j);
+    }
+}
+
 void Node::get_alignment_column_at(int j,vector<string> *column, bool include_internal_nodes)
 {
 
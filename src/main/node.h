@@ -41,6 +41,7 @@
 #include <boost/lambda/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/dynamic_bitset.hpp>
 
 #include <omp.h>
 
@@ -60,6 +61,17 @@ struct Insertion_at_node
 };
 
 
+class Node;
+
+// Receives alignment rows one at a time, in the order of get_alignment()
+//
+class Alignment_row_sink
+{
+public:
+    virtual ~Alignment_row_sink() {}
+    virtual void add_row(Node *node, const string &row) = 0;
+};
+
 struct Orf
 {
     string dna_sequence;
@@ -83,6 +95,7 @@ public:
     double dist_to_parent;
     string name;
     string name_comment;
+    vector< pair<string,string> > duplicate_queries;
     string name_id;
     string nhx_tid;
     string nhx_tag;
@@ -99,6 +112,7 @@ public:
 
     bool node_has_sequence_object;
     bool node_has_sequence;
+    bool sequence_is_shared;
 
     Orf orf;
     bool has_orf;
@@ -112,7 +126,7 @@ public:
     Node() : leaf(true), dist_to_parent(0), name("undefined"), nhx_tid(""),
              node_has_left_child(false), node_has_right_child(false),
              adjust_left_node_site_index(false), adjust_right_node_site_index(false),
-             node_has_sequence_object(false), node_has_sequence(false),
+             node_has_sequence_object(false), node_has_sequence(false), sequence_is_shared(false),
              has_orf(false), visited(false), use_for_exonarate(false) {}
     ~Node();
 
@@ -212,6 +226,16 @@ public:
 
     string get_nhx_tag() const { return nhx_tag; }
 
+    void get_name_ids(map<string,string> *ids) const
+    {
+        ids->insert(make_pair(this->name,this->name_id));
+        if(!leaf)
+        {
+            left_child->get_name_ids(ids);
+            right_child->get_name_ids(ids);
+        }
+    }
+
     string get_id_for_name(string query) const
     {
         if(this->name == query)
@@ -241,6 +265,10 @@ public:
 
     string get_name_comment() { return name_comment; }
 
+    // identical queries placed through this one; output as copies of its row
+    void set_duplicate_queries( const vector< pair<string,string> > &duplicates ) { duplicate_queries = duplicates; }
+    const vector< pair<string,string> > *get_duplicate_queries() { return &duplicate_queries; }
+
     bool is_leaf() { return leaf; }
     void is_leaf(bool i) { leaf = i; }
 
@@ -1150,6 +1178,13 @@ public:
     }
 
 
+    // One-pass versions of the per-column queries above: the columns of this
+    // node are mapped to the sites of the named descendant, or marked where
+    // any leaf other than the named one has a site.
+    Node *map_alignment_columns(const string &node_name, vector<int> *column_sites);
+    void get_other_leaf_columns(const string &node_name, boost::dynamic_bitset<> *columns);
+    bool find_path_to_node(const string &node_name, vector<bool> *go_left);
+
     int get_state_at_alignment_column(int j,string node_name)
     {
 
@@ -1369,6 +1404,8 @@ public:
     void get_node_sequence(Fasta_entry *seq);
     void get_alignment(vector<Fasta_entry> *aligned_sequences, bool include_internal_nodes=false);
     void get_alignment_for_nodes(vector<Fasta_entry> *aligned_sequences,bool include_internal_nodes);
+    bool can_stream_alignment_rows(bool include_internal_nodes=false);
+    void stream_alignment_rows(Alignment_row_sink *sink, bool include_internal_nodes=false);
     void add_root_consensus(vector<Fasta_entry> *aligned_sequences);
 
     void get_dna_sequences(map<string,string*> *dna_sequences)
@@ -1447,6 +1484,12 @@ public:
 
     void get_alignment_column_at(int j,vector<string> *column, bool include_internal_nodes);
 
+    void index_alignment_rows(map<Node*,int> *rows, map<Node*,int> *sizes, int *next_row, bool include_internal_nodes);
+    void get_alignment_rows(vector<int> *index, const string &gap, map<Node*,int> *rows, map<Node*,int> *sizes,
+                            vector<Fasta_entry> *aligned_sequences, bool include_internal_nodes);
+    void append_alignment_row(const vector<int> *index, const string &gap, string *row);
+    void stream_alignment_rows(vector<int> *index, const string &gap, string *row, Alignment_row_sink *sink, bool include_internal_nodes);
+
     void get_multiple_alignment_columns_before(Insertion_at_node ins,vector<string> *columns,bool include_internal_nodes);
 
     void get_multiple_alignment_columns_before(int j,vector< vector<string> > *columns, string node_name_wanted,
@@ -1590,90 +1633,58 @@ public:
 
         if (! output) { throw IOException ("Node::write_nhx_tree. Failed to open file"); }
 
-        output<<this->print_nhx_tree();
+        this->write_nhx_tree(output);
         output.close();
     }
 
-    string print_nhx_tree() const {
+    // The trees are written to the stream as the nodes are visited;
+    // the print_ functions collect the same output in a string.
+    //
+    void write_nhx_tree(ostream &output, bool int_ids=false) const {
         if(!leaf)
         {
-            string tid = this->get_nhx_tag();
-            if(this->get_nhx_tid() != "")
-                tid += ":TID="+this->get_nhx_tid();
-
-            if(tid != "")
-                tid = "["+tid+"]";
-
-            stringstream ss;
-            ss<<"("<<left_child->print_nhx_subtree()<<","<<right_child->print_nhx_subtree()<<"):"<<dist_to_parent<<tid<<";";
-            return ss.str();
-        } else {
-            return "";
+            this->write_nhx_subtree(output,int_ids);
+            output<<";";
         }
     }
 
-    string print_nhx_subtree() const {
-
-        string tid = this->get_nhx_tag();
-        if(this->get_nhx_tid() != "")
-            tid += ":TID="+this->get_nhx_tid();
-
-        if(tid != "")
-            tid = "["+tid+"]";
-
+    void write_nhx_subtree(ostream &output, bool int_ids=false) const {
         if(!leaf)
         {
-            stringstream ss;
-            ss<<"("<<left_child->print_nhx_subtree()<<","<<right_child->print_nhx_subtree()<<"):"<<dist_to_parent<<tid;
-            return ss.str();
-
-        } else {
-            stringstream ss;
-            ss<<name<<":"<<dist_to_parent<<tid;
-            return ss.str();
+            output<<"(";
+            left_child->write_nhx_subtree(output,int_ids);
+            output<<",";
+            right_child->write_nhx_subtree(output,int_ids);
+            output<<")";
+            if(int_ids)
+                output<<name;
         }
-    }
-
-    /************************************/
-
-    string print_nhx_tree_with_intIDs() const {
-        if(!leaf)
-        {
-            string tid = this->get_nhx_tag();
-            if(this->get_nhx_tid() != "")
-                tid += ":TID="+this->get_nhx_tid();
-
-            if(tid != "")
-                tid = "["+tid+"]";
+        else
+            output<<name;
 
-            stringstream ss;
-            ss<<"("<<left_child->print_nhx_subtree_with_intIDs()<<","<<right_child->print_nhx_subtree_with_intIDs()<<")"<<this->get_name()<<":"<<dist_to_parent<<tid<<";";
-            return ss.str();
-        } else {
-            return "";
-        }
+        output<<":"<<dist_to_parent;
+        this->write_nhx_tags(output);
     }
 
-    string print_nhx_subtree_with_intIDs() const {
-
+    void write_nhx_tags(ostream &output) const {
         string tid = this->get_nhx_tag();
         if(this->get_nhx_tid() != "")
             tid += ":TID="+this->get_nhx_tid();
 
         if(tid != "")
-            tid = "["+tid+"]";
+            output<<"["<<tid<<"]";
+    }
 
-        if(!leaf)
-        {
-            stringstream ss;
-            ss<<"("<<left_child->print_nhx_subtree_with_intIDs()<<","<<right_child->print_nhx_subtree_with_intIDs()<<")"<<this->get_name()<<":"<<dist_to_parent<<tid;
-            return ss.str();
+    string print_nhx_tree() const {
+        stringstream ss;
+        this->write_nhx_tree(ss);
+        return ss.str();
+    }
 
-        } else {
-            stringstream ss;
-            ss<<name<<":"<<dist_to_parent<<tid;
-            return ss.str();
-        }
+    string print_nhx_tree_with_intIDs() const {
+        stringstream ss;
+        this->write_nhx_tree(ss,true);
+        return ss.str();
     }
 
     /************************************/
@@ -1715,65 +1726,42 @@ public:
 
     /************************************/
 
-    string print_xml_tree() const {
+    void write_xml_tree(ostream &output) const {
         if(!leaf)
         {
-            stringstream ss;
-            ss<<"("<<left_child->print_xml_subtree()<<","<<right_child->print_xml_subtree()<<")"<<name<<":0";
+            output<<"(";
+            left_child->write_xml_subtree(output);
+            output<<",";
+            right_child->write_xml_subtree(output);
+            output<<")"<<name<<":0";
 
             if(Settings_handle::st.is("xml-nhx"))
-            {
-                string tid = this->get_nhx_tag();
-                if(this->get_nhx_tid() != "")
-                    tid += ":TID="+this->get_nhx_tid();
-
-                if(tid != "")
-                    tid = "["+tid+"]";
-                ss<<tid;
-            }
+                this->write_nhx_tags(output);
 
-            ss<<";";
-            return ss.str();
-        } else {
-            return "";
+            output<<";";
         }
     }
 
-    string print_xml_subtree() const {
+    void write_xml_subtree(ostream &output) const {
         if(!leaf)
         {
-            stringstream ss;
-            ss<<"("<<left_child->print_xml_subtree()<<","<<right_child->print_xml_subtree()<<")"<<name<<":"<<dist_to_parent;
-
-            if(Settings_handle::st.is("xml-nhx"))
-            {
-                string tid = this->get_nhx_tag();
-                if(this->get_nhx_tid() != "")
-                    tid += ":TID="+this->get_nhx_tid();
-
-                if(tid != "")
-                    tid = "["+tid+"]";
-                ss<<tid;
-            }
-
-            return ss.str();
-        } else {
-            stringstream ss;
-            ss<<name_id<<":"<<dist_to_parent;
-
-            if(Settings_handle::st.is("xml-nhx"))
-            {
-                string tid = this->get_nhx_tag();
-                if(this->get_nhx_tid() != "")
-                    tid += ":TID="+this->get_nhx_tid();
+            output<<"(";
+            left_child->write_xml_subtree(output);
+            output<<",";
+            right_child->write_xml_subtree(output);
+            output<<")"<<name<<":"<<dist_to_parent;
+        }
+        else
+            output<<name_id<<":"<<dist_to_parent;
 
-                if(tid != "")
-                    tid = "["+tid+"]";
-                ss<<tid;
-            }
+        if(Settings_handle::st.is("xml-nhx"))
+            this->write_nhx_tags(output);
+    }
 
-            return ss.str();
-        }
+    string print_xml_tree() const {
+        stringstream ss;
+        this->write_xml_tree(ss);
+        return ss.str();
     }
 
     /************************************/
@@ -2170,6 +2158,7 @@ public:
     void add_sequence( Fasta_entry seq_entry, int data_type, bool gapped = false, bool no_trimming = false, bool turn_revcomp = false);
 
     void add_ancestral_sequence( Sequence* s ) { sequence = s;  node_has_sequence_object = true;}
+    void add_shared_sequence( Sequence* s ) { sequence = s;  node_has_sequence_object = true; sequence_is_shared = true; }
 
     Sequence *get_sequence() { return sequence; }
 
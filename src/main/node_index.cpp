@@ -0,0 +1,82 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "main/node_index.h"
+
+using namespace std;
+using namespace ppa;
+
+void Node_index::build(Node *root)
+{
+    nodes.clear();
+    parents.clear();
+    this->add_subtree(root,0);
+}
+
+void Node_index::add_subtree(Node *node, Node *parent)
+{
+    // the first node of a name in the tree order is kept, as in get_all_nodes()
+    if(!node->is_leaf())
+        this->add_subtree(node->get_left_child(),node);
+
+    nodes.insert(make_pair(node->get_name(),node));
+    if(parent != 0)
+        parents.insert(make_pair(node->get_name(),parent));
+
+    if(!node->is_leaf())
+        this->add_subtree(node->get_right_child(),node);
+}
+
+void Node_index::insert_node(Node *node, Node *parent)
+{
+    // the children of a new node are either in the index already (the node
+    // was placed above them) or new as well
+    nodes[node->get_name()] = node;
+    if(parent != 0)
+        parents[node->get_name()] = parent;
+
+    if(node->is_leaf())
+        return;
+
+    Node *children[2] = {node->get_left_child(), node->get_right_child()};
+    for(int i=0;i<2;i++)
+    {
+        if(nodes.find(children[i]->get_name()) == nodes.end())
+            this->add_subtree(children[i],node);
+        else
+            parents[children[i]->get_name()] = node;
+    }
+}
+
+Node *Node_index::get_node(const string &name) const
+{
+    boost::unordered_map<string,Node*>::const_iterator it = nodes.find(name);
+    if(it == nodes.end())
+        return 0;
+    return it->second;
+}
+
+Node *Node_index::get_parent(const string &name) const
+{
+    boost::unordered_map<string,Node*>::const_iterator it = parents.find(name);
+    if(it == parents.end())
+        return 0;
+    return it->second;
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef NODE_INDEX_H
+#define NODE_INDEX_H
+
+/*
+ * Hash index of the nodes of a tree by name, with the parent of each
+ * node. It is built once and updated with insert_node() when a new node
+ * is placed in the tree, so that lookups do not need to walk the tree.
+ */
+
+#include <string>
+#include <boost/unordered_map.hpp>
+#include "main/node.h"
+
+using namespace std;
+
+namespace ppa
+{
+
+class Node_index
+{
+    boost::unordered_map<string,Node*> nodes;
+    boost::unordered_map<string,Node*> parents;
+
+    void add_subtree(Node *node, Node *parent);
+
+public:
+    Node_index() {}
+    Node_index(Node *root) { this->build(root); }
+
+    void build(Node *root);
+    void insert_node(Node *node, Node *parent);
+
+    Node *get_node(const string &name) const;
+    Node *get_parent(const string &name) const;
+};
+
+}
+
+#endif // NODE_INDEX_H
@@ -0,0 +1,149 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "main/placement_server.h"
+#include "main/reads_aligner.h"
+#include "utils/tree_snapshot.h"
+#include "utils/fasta_reader.h"
+#include "utils/settings_handle.h"
+#include "utils/log_output.h"
+#include <sstream>
+
+using namespace std;
+using namespace ppa;
+
+void Placement_server::check_options()
+{
+    if( Settings_handle::st.is("queryfile") ||
+        !( Settings_handle::st.is("ref-snapshot") || ( Settings_handle::st.is("ref-seqfile") && Settings_handle::st.is("ref-treefile") ) ) )
+    {
+        Log_output::write_out("Option '--placement-server' requires a reference alignment and tree ('-a' and '-r') or\n"
+                              "a reference snapshot ('--ref-snapshot'), and queries from stdin instead of '-q'.\nExiting.\n\n",0);
+        exit(1);
+    }
+
+    Reads_aligner ra;
+    string mode = ra.unbatched_mode();
+    if(mode != "")
+    {
+        Log_output::write_out("Option '--placement-server' cannot be used with "+mode+".\nExiting.\n\n",0);
+        exit(1);
+    }
+}
+
+Placement_server::Placement_server(Node *root, Model_factory *m, int data_type, const float *dna_pi, int c) : mf(m), count(c)
+{
+    Tree_snapshot ts;
+    ts.write(&reference, root, data_type, dna_pi);
+}
+
+bool Placement_server::read_batch(istream &input, string *batch)
+{
+    batch->clear();
+
+    bool has_lines = false;
+    string line;
+    while(getline(input, line))
+    {
+        has_lines = true;
+
+        if(!line.empty() && line[line.length()-1] == '\r')
+            line.erase(line.length()-1);
+
+        if(line == "//")
+            return true;
+
+        batch->append(line);
+        batch->append("\n");
+    }
+
+    return has_lines;
+}
+
+void Placement_server::run(istream &input, ostream &output)
+{
+    Log_output::write_header("Placement server: reading query batches",0);
+
+    Fasta_reader fr;
+    string batch;
+    int batch_number = 0;
+
+    while(this->read_batch(input, &batch))
+    {
+        batch_number++;
+
+        stringstream msg;
+        msg<<"Placement server: batch "<<batch_number;
+        Log_output::write_header(msg.str(),0);
+
+        // Fasta_reader exits on unknown input; the server reports it instead
+        size_t first = batch.find_first_not_of(" \t\n");
+        if(first == string::npos)
+        {
+            output<<"# batch "<<batch_number<<": no queries\n//\n"<<flush;
+            continue;
+        }
+        if(batch[first] != '>' && batch[first] != '@')
+        {
+            output<<"# batch "<<batch_number<<": error reading the queries: only FASTA and FASTQ formats supported\n//\n"<<flush;
+            continue;
+        }
+
+        vector<Fasta_entry> queries;
+        try
+        {
+            istringstream in(batch);
+            fr.read(in, queries, true, false);
+        }
+        catch (ppa::IOException& e) {
+            output<<"# batch "<<batch_number<<": error reading the queries: "<<e.what()<<"\n//\n"<<flush;
+            continue;
+        }
+
+        if(queries.empty())
+        {
+            output<<"# batch "<<batch_number<<": no queries\n//\n"<<flush;
+            continue;
+        }
+
+        int data_type;
+        float dna_pi[4];
+        Tree_snapshot ts;
+        Node *root = ts.read(reference.data(), reference.length(), &data_type, dna_pi);
+
+        Reads_aligner ra;
+        ra.place_queries(root, &queries, mf, count);
+        root = ra.get_global_root();
+
+        int placed = root->get_number_of_query_leaves();
+        output<<"# batch "<<batch_number<<": "<<queries.size()<<" queries, "<<placed<<" placements\n";
+
+        if(placed > 0)
+        {
+            vector<Fasta_entry> aligned_sequences;
+            root->get_alignment(&aligned_sequences, Settings_handle::st.is("output-ancestors"));
+            fr.write_fasta(output, aligned_sequences);
+        }
+
+        output<<"//\n"<<flush;
+
+        delete root;
+    }
+}
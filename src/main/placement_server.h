@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PLACEMENT_SERVER_H
+#define PLACEMENT_SERVER_H
+
+/*
+ * Long-running placement against a resident reference. The reference
+ * tree with its ancestral sequence graphs is built once and kept as an
+ * in-memory snapshot; every batch of queries is placed on a fresh copy
+ * decoded from it. Batches are read from the input stream as FASTA or
+ * FASTQ records terminated by a line '//'. For each batch a status line
+ * starting with '#' is written, followed by the extended alignment in
+ * FASTA and a closing '//' line. The server stops at the end of input.
+ */
+
+#include <iostream>
+#include <string>
+#include "main/node.h"
+#include "utils/model_factory.h"
+
+using namespace std;
+
+namespace ppa
+{
+
+class Placement_server
+{
+    string reference;
+    Model_factory *mf;
+    int count;
+
+    bool read_batch(istream &input, string *batch);
+
+public:
+    static void check_options();
+
+    Placement_server(Node *root, Model_factory *mf, int data_type, const float *dna_pi, int count);
+    void run(istream &input, ostream &output);
+};
+
+}
+
+#endif // PLACEMENT_SERVER_H
@@ -22,21 +22,89 @@
 #include "utils/exonerate_queries.h"
 #include "utils/text_utils.h"
 #include "utils/log_output.h"
+#include "utils/gzip_input.h"
+#include "utils/ungapped_prescore.h"
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 using namespace ppa;
 
-Reads_aligner::Reads_aligner(){}
+Reads_aligner::Reads_aligner() : global_root(0), discarded_opened(false) {}
+
+Reads_aligner::~Reads_aligner()
+{
+    this->clear_query_sequences();
+}
+
+Sequence *Reads_aligner::get_query_sequence(Fasta_entry *read, bool turn_revcomp, bool is_read)
+{
+    for(int i=0;i<(int)query_sequences.size();i++)
+    {
+        Query_sequence *q = &query_sequences.at(i);
+        if(q->turn_revcomp == turn_revcomp && q->is_read == is_read && q->entry.data_type == read->data_type &&
+                q->entry.num_duplicates == read->num_duplicates && q->entry.sequence == read->sequence &&
+                q->entry.quality == read->quality)
+            return q->sequence;
+    }
+
+    // the forward and the reverse strand of one query are kept
+    if(query_sequences.size() >= 2)
+    {
+        delete query_sequences.front().sequence;
+        query_sequences.erase(query_sequences.begin());
+    }
+
+    Query_sequence q;
+    q.entry = *read;
+    q.entry.duplicates.clear();
+    q.turn_revcomp = turn_revcomp;
+    q.is_read = is_read;
+    q.sequence = new Sequence(*read, read->data_type, false, true, turn_revcomp);
+    q.sequence->is_read_sequence(is_read);
+    query_sequences.push_back(q);
+
+    return q.sequence;
+}
+
+void Reads_aligner::clear_query_sequences()
+{
+    for(int i=0;i<(int)query_sequences.size();i++)
+        delete query_sequences.at(i).sequence;
+    query_sequences.clear();
+}
+
+bool Reads_aligner::open_placement_cache(Node *root, Model_factory *mf)
+{
+    if(!Settings_handle::st.is("placement-cache"))
+        return false;
+
+    if(!placement_cache.is_open())
+        placement_cache.open(Settings_handle::st.get("placement-cache").as<string>(), root, mf->get_sequence_data_type());
+
+    return true;
+}
+
+void Reads_aligner::save_placement_cache()
+{
+    try
+    {
+        placement_cache.save();
+    }
+    catch(IOException &e)
+    {
+        Log_output::write_warning("Failed to save the placement cache: "+string(e.what()),0);
+    }
+}
 
 void Reads_aligner::align(Node *root, Model_factory *mf, int count)
 {
 
     // Handle also the first one correctly
     //
-    if(!Settings_handle::st.is("ref-seqfile"))
+    if(!Settings_handle::st.is("ref-seqfile") && !Settings_handle::st.is("ref-snapshot"))
     {
         root->get_sequence()->is_read_sequence(true);
     }
@@ -47,6 +115,12 @@ void Reads_aligner::align(Node *root, Model_factory *mf, int count)
 
     Log_output::write_header("Aligning reads ",0);
 
+    if(this->can_stream_queries())
+    {
+        this->streamed_query_placement(root,mf,count,file);
+        return;
+    }
+
     Fasta_reader fr;
     vector<Fasta_entry> reads;
     Log_output::write_out("Reads data file: "+file+"\n",1);
@@ -61,6 +135,31 @@ void Reads_aligner::align(Node *root, Model_factory *mf, int count)
         exit(1);
     }
 
+    // Mates from a second file are appended after the first reads
+    //
+    int first_mate = -1;
+    if(Settings_handle::st.is("mate-queryfile"))
+    {
+        string matefile = Settings_handle::st.get("mate-queryfile").as<string>();
+        Log_output::write_out("Read mates data file: "+matefile+"\n",1);
+
+        vector<Fasta_entry> mates;
+        try
+        {
+            fr.read(matefile, mates, true);
+            fr.remove_gaps(&mates);
+        }
+        catch (ppa::IOException& e) {
+            Log_output::write_out("Error reading the read mates file '"+matefile+"'.\nExiting.\n\n",0);
+            exit(1);
+        }
+
+        first_mate = reads.size();
+        reads.resize(first_mate+mates.size());
+        for(int i=0;i<(int)mates.size();i++)
+            this->move_read(&reads.at(first_mate+i),&mates.at(i));
+    }
+
     int data_type = fr.check_sequence_data_type(&reads);
     bool is_dna = data_type == Model_factory::dna;
 
@@ -70,7 +169,7 @@ void Reads_aligner::align(Node *root, Model_factory *mf, int count)
 
     // Merge overlapping and trim reads if selected, otherwise jsut update the sequence comment
     //
-    this->pair_and_sort( &reads );
+    this->pair_and_sort( &reads, first_mate );
 
 
 
@@ -141,13 +240,184 @@ void Reads_aligner::align(Node *root, Model_factory *mf, int count)
 /**********************************************************************/
 
 
+bool Reads_aligner::can_stream_queries()
+{
+    if(!Settings_handle::st.is("query-batch-size"))
+        return false;
+
+    if(Settings_handle::st.get("query-batch-size").as<int>() < 1)
+        return false;
+
+    // modes that look at all queries at once keep reading the whole file
+    string reason = this->unbatched_mode();
+
+    // the preselected targets and the queries added to them would depend
+    // on the batch; the server places each batch on a fresh reference
+    if(reason == "" && Settings::placement_preselection)
+        reason = "target preselection (use '--no-preselection')";
+
+    if(reason != "")
+    {
+        Log_output::write_warning("Option '--query-batch-size' cannot be used with "+reason+"; reading all queries at once.",0);
+        return false;
+    }
+
+    return true;
+}
+
+string Reads_aligner::unbatched_mode()
+{
+    string reason = "";
+    if( Settings_handle::st.is("pileup-alignment") || Settings_handle::st.is("align-reads-at-root") )
+        reason = "pileup alignment";
+    else if( Settings_handle::st.is("ncbi-hack") )
+        reason = "ncbi placement";
+    else if( Settings_handle::st.is("find-best-orf") || Settings_handle::st.is("find-orfs") )
+        reason = "ORF search";
+    else if( Settings_handle::st.is("pair-end") )
+        reason = "read pairing";
+    else if( Settings_handle::st.is("use-duplicate-weigths") && not Settings_handle::st.is("no-read-ordering") )
+        reason = "ordering by duplicate number";
+
+    return reason;
+}
+
+int Reads_aligner::place_queries(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count)
+{
+    Fasta_reader fr;
+    fr.remove_gaps(reads);
+
+    int data_type = fr.check_sequence_data_type(reads);
+    bool is_dna = data_type == Model_factory::dna;
+
+    if(!fr.check_alphabet(reads,data_type))
+        Log_output::write_out(" Warning: Illegal characters in input reads sequences removed!\n",2);
+
+    global_root = root;
+
+    if(Settings_handle::st.is("fragments"))
+        count = this->query_placement_all(global_root,reads,mf,count,is_dna);
+    else
+        count = this->query_placement_one(global_root,reads,mf,count,is_dna);
+
+    return count;
+}
+
+void Reads_aligner::read_query_batch(istream *input, vector<Fasta_entry> *reads, int batch_size, map<string,int> *copy_num, string *messages, bool *more)
+{
+    Fasta_reader fr;
+    *more = fr.read_batch(*input, *reads, batch_size, copy_num, messages, true, false);
+    fr.remove_gaps(reads);
+
+    if( Settings_handle::st.is("collapse-duplicate-queries") )
+        this->collapse_duplicates( reads );
+}
+
+void Reads_aligner::streamed_query_placement(Node *root, Model_factory *mf, int count, string file)
+{
+    int batch_size = Settings_handle::st.get("query-batch-size").as<int>();
+
+    Log_output::write_out("Reads data file: "+file+"\n",1);
+
+    Gzip_streambuf buffer(file);
+    istream input(&buffer);
+    if(!buffer.is_open())
+    {
+        Log_output::write_out("Error reading the reads file '"+file+"'.\nExiting.\n\n",0);
+        exit(1);
+    }
+
+    Fasta_reader fr;
+    map<string,int> copy_num;
+    vector<Fasta_entry> reads;
+    vector<Fasta_entry> next_reads;
+    string messages;
+    string next_messages;
+
+    // the data type is decided on all queries, as when they are read at once
+    int data_type = -1;
+    {
+        Gzip_streambuf type_buffer(file);
+        istream type_input(&type_buffer);
+        data_type = fr.check_sequence_data_type(type_input, batch_size);
+    }
+    bool is_dna = data_type == Model_factory::dna;
+
+    bool more = false;
+    this->read_query_batch(&input, &reads, batch_size, &copy_num, &messages, &more);
+
+    global_root = root;
+    int batch = 0;
+    int placed = 0;
+
+    while(reads.size()>0)
+    {
+        // the next batch is parsed while this one is placed
+        boost::thread_group reader;
+        bool next_more = false;
+        if(more)
+            reader.create_thread(boost::bind(&Reads_aligner::read_query_batch, this,
+                                             &input, &next_reads, batch_size, &copy_num, &next_messages, &next_more));
+
+        if(messages != "")
+            Log_output::write_out(messages,2);
+
+        if(!fr.check_alphabet(&reads,data_type))
+            Log_output::write_out(" Warning: Illegal characters in input reads sequences removed!\n",2);
+
+        batch++;
+        placed += reads.size();
+        stringstream msg;
+        msg<<"Aligning reads: batch "<<batch<<" ("<<reads.size()<<" queries, "<<placed<<" in total)";
+        Log_output::write_header(msg.str(),0);
+
+        if(Settings_handle::st.is("fragments"))
+            count = this->query_placement_all(global_root,&reads,mf,count,is_dna);
+        else
+            count = this->query_placement_one(global_root,&reads,mf,count,is_dna);
+
+        reader.join_all();
+
+        reads.clear();
+        reads.swap(next_reads);
+        messages.swap(next_messages);
+        next_messages.clear();
+        more = next_more;
+    }
+}
+
+void Reads_aligner::write_discarded(Fasta_entry *read)
+{
+    string discarded_filename = "outfile";
+    if(Settings_handle::st.is("outfile"))
+        discarded_filename = Settings_handle::st.get("outfile").as<string>();
+
+    discarded_filename.append(".discarded");
+
+    // the file is truncated once per run and appended to by later batches
+    fstream discarded_fstream;
+    if(discarded_opened)
+        discarded_fstream.open(discarded_filename.c_str(), fstream::out|fstream::app);
+    else
+        discarded_fstream.open(discarded_filename.c_str(), fstream::out);
+    discarded_opened = true;
+
+    discarded_fstream << ">" << read->name << endl << read->sequence << endl;
+
+    for(int i=0;i<(int)read->duplicates.size();i++)
+        discarded_fstream << ">" << read->duplicates.at(i).first << endl << read->sequence << endl;
+}
+
+/**********************************************************************/
+
+
 void Reads_aligner::pileup_alignment(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count)
 {
     string ref_root_name = root->get_name();
     global_root = root;
 
     int start_i = 0;
-    if(Settings_handle::st.is("queryfile") && !Settings_handle::st.is("ref-seqfile"))
+    if(Settings_handle::st.is("queryfile") && !Settings_handle::st.is("ref-seqfile") && !Settings_handle::st.is("ref-snapshot"))
         start_i = 1;
 
     int max_attempts = Settings_handle::st.get("query-cluster-attempts").as<int>();
@@ -264,7 +534,7 @@ void Reads_aligner::translated_pileup_alignment(Node *root, vector<Fasta_entry>
     global_root = root;
 
     int start_i = 0;
-    if(Settings_handle::st.is("queryfile") && !Settings_handle::st.is("ref-seqfile"))
+    if(Settings_handle::st.is("queryfile") && !Settings_handle::st.is("ref-seqfile") && !Settings_handle::st.is("ref-snapshot"))
         start_i = 1;
 
     int max_attempts = Settings_handle::st.get("query-cluster-attempts").as<int>();
@@ -362,7 +632,93 @@ void Reads_aligner::translated_pileup_alignment(Node *root, vector<Fasta_entry>
     }
 }
 
-void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna)
+/*
+ * The queries of a batch are placed on the same tree and their keys are
+ * chained only to the batch before. Preselected targets are hashed into
+ * the context. Without them, preset target nodes of any query are
+ * candidates for all of them and the batch is placed in full unless all
+ * queries are found.
+ */
+void Reads_aligner::find_cached_nodes_for_queries(Node *root, vector<Fasta_entry> *reads, Model_factory *mf,
+                                                  map<string,string> *target_sequences, bool preselected_targets, bool is_dna)
+{
+    string batch_context = placement_chain;
+    bool preset_nodes = false;
+    if(preselected_targets)
+    {
+        for(map<string,string>::iterator it = target_sequences->begin(); it != target_sequences->end(); it++)
+            batch_context += "\t"+it->first+"\t"+it->second;
+    }
+    else
+    {
+        for(int i=0;i<(int)reads->size();i++)
+        {
+            if(reads->at(i).node_to_align != "")
+            {
+                batch_context += "\t"+reads->at(i).node_to_align;
+                preset_nodes = true;
+            }
+        }
+    }
+
+    batch_context = Placement_cache::hash(batch_context);
+
+    vector<string> cache_keys;
+    string chain = batch_context;
+    int num_cached = 0;
+    for(int i=0;i<(int)reads->size();i++)
+    {
+        cache_keys.push_back(placement_cache.query_key(reads->at(i), batch_context));
+        chain += cache_keys.back();
+        if(placement_cache.contains(cache_keys.back()))
+            num_cached++;
+    }
+    placement_chain = Placement_cache::hash(chain);
+
+    stringstream msg;
+    msg<<"Placement cache: "<<num_cached<<" of "<<reads->size()<<" queries found.\n";
+    Log_output::write_out(msg.str(),1);
+
+    if(preset_nodes && num_cached < (int)reads->size())
+    {
+        this->find_nodes_for_queries(root, reads, mf, is_dna);
+
+        for(int i=0;i<(int)reads->size();i++)
+            placement_cache.store(cache_keys.at(i), reads->at(i));
+    }
+    else
+    {
+        vector<Fasta_entry> uncached_reads;
+        vector<int> uncached_index;
+        for(int i=0;i<(int)reads->size();i++)
+        {
+            if(!placement_cache.find(cache_keys.at(i), &reads->at(i)))
+            {
+                uncached_reads.push_back(reads->at(i));
+                uncached_index.push_back(i);
+            }
+        }
+
+        if(uncached_reads.size()>0 && preselected_targets)
+            this->find_targets_for_queries(root, &uncached_reads, mf, target_sequences, is_dna);
+        else if(uncached_reads.size()>0)
+            this->find_nodes_for_queries(root, &uncached_reads, mf, is_dna);
+
+        for(int j=0;j<(int)uncached_index.size();j++)
+        {
+            Fasta_entry *read = &reads->at(uncached_index.at(j));
+            read->node_to_align = uncached_reads.at(j).node_to_align;
+            read->node_score = uncached_reads.at(j).node_score;
+            read->query_strand = uncached_reads.at(j).query_strand;
+
+            placement_cache.store(cache_keys.at(uncached_index.at(j)), *read);
+        }
+    }
+
+    this->save_placement_cache();
+}
+
+int Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna)
 {
     bool single_ref_sequence = false;
     if(root->get_number_of_leaves()==1)
@@ -375,7 +731,11 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
     map<string,string> target_sequences;
     this->preselect_target_sequences(root,reads,&target_sequences, is_dna);
 
-    if((int)target_sequences.size()>1)
+    bool preselected_targets = (int)target_sequences.size()>1;
+
+    if(this->open_placement_cache(root,mf))
+        this->find_cached_nodes_for_queries(root, reads, mf, &target_sequences, preselected_targets, is_dna);
+    else if(preselected_targets)
          this->find_targets_for_queries(root, reads, mf, &target_sequences, is_dna);
     else
         this->find_nodes_for_queries(root, reads, mf, is_dna);
@@ -435,8 +795,7 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
     }
     sort(unique_nodes.begin(),unique_nodes.end(),Reads_aligner::node_is_smaller);
 
-    map<string,Node*> nodes_map;
-    root->get_all_nodes(&nodes_map);
+    Node_index node_index(root);
 
     map<string,int> nodes_number;
 
@@ -463,7 +822,7 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
 
         string ref_node_name = *sit;
 
-        Node *current_root = nodes_map.find(ref_node_name)->second;
+        Node *current_root = node_index.get_node(ref_node_name);
         double orig_dist = current_root->get_distance_to_parent();
 
         bool alignment_done = false;
@@ -591,11 +950,12 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
             {
                 if(single_ref_sequence)
                 {
+                    node_index.insert_node(current_root,0);
                     global_root = current_root;
                 }
                 else
                 {
-                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &nodes_map);
+                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &node_index);
 
                     if(!parent_found)
                     {
@@ -603,7 +963,7 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
                     }
                 }
 
-                this->fix_branch_lengths(root,current_root);
+                this->fix_branch_lengths(root,current_root,&node_index);
 
                 ref_node_name = current_root->get_name();
             }
@@ -611,9 +971,11 @@ void Reads_aligner::query_placement_all(Node *root, vector<Fasta_entry> *reads,
         }
 
     }
+
+    return count;
 }
 
-void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna)
+int Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna)
 {
     bool single_ref_sequence = false;
     if(root->get_number_of_leaves()==1)
@@ -632,30 +994,51 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
     if(min_identity<0)
         min_identity = 0;
 
-    string discarded_filename = "outfile";
-    if(Settings_handle::st.is("outfile"))
-        discarded_filename = Settings_handle::st.get("outfile").as<string>();
-
-    discarded_filename.append(".discarded");
-    fstream discarded_fstream;
-
     map<string,string> target_sequences;
     this->preselect_target_sequences(root,reads,&target_sequences, is_dna);
 
     multimap<string,string> added_sequences;
 
+    // the targets preselected depend on the whole batch and those added
+    // later on the queries placed before
+    bool use_cache = this->open_placement_cache(root,mf);
+    if(use_cache && target_sequences.size()>0)
+    {
+        string targets = placement_chain;
+        for(map<string,string>::iterator it = target_sequences.begin(); it != target_sequences.end(); it++)
+            targets += "\t"+it->first+"\t"+it->second;
+        placement_chain = Placement_cache::hash(targets);
+    }
+
     Log_output::write_header("Aligning query sequences",0);
 
+    // built once; the nodes placed are added to it as they are created
+    Node_index node_index(root);
 
     for(int i=0;i<(int)reads->size();i++)
     {
 
         string org_nodes_to_align = reads->at(i).node_to_align;
 
-        if((int)target_sequences.size()>0 && Settings::placement_preselection)
-            this->find_targets_for_query(root, &reads->at(i), mf, &target_sequences, &added_sequences, is_dna, i==0);
+        string cache_key;
+        if(use_cache)
+        {
+            cache_key = placement_cache.query_key(reads->at(i), placement_chain);
+            placement_chain = cache_key;
+        }
+
+        if(use_cache && placement_cache.find(cache_key, &reads->at(i)))
+            Log_output::write_msg("cached placement for query: '"+reads->at(i).name+" "+reads->at(i).comment+"'",0);
         else
-            this->find_nodes_for_query(root, &reads->at(i), mf, is_dna, i==0);
+        {
+            if((int)target_sequences.size()>0 && Settings::placement_preselection)
+                this->find_targets_for_query(root, &reads->at(i), mf, &target_sequences, &added_sequences, is_dna, i==0);
+            else
+                this->find_nodes_for_query(root, &reads->at(i), mf, is_dna, i==0);
+
+            if(use_cache)
+                placement_cache.store(cache_key, reads->at(i));
+        }
 
         vector<string> unique_nodes;
 
@@ -676,9 +1059,7 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
 
             if(Settings_handle::st.is("output-discarded-queries"))
             {
-                if( ! discarded_fstream.is_open() )
-                    discarded_fstream.open(discarded_filename.c_str(), fstream::out);
-                discarded_fstream << ">" << reads->at(i).name << endl << reads->at(i).sequence << endl;
+                this->write_discarded(&reads->at(i));
             }
             else
             {
@@ -691,9 +1072,6 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
 
         sort(unique_nodes.begin(),unique_nodes.end(),Reads_aligner::node_is_smaller);
 
-        map<string,Node*> nodes_map;
-        root->get_all_nodes(&nodes_map);
-
         map<string,int> nodes_number;
 
         // do one tagged node at time
@@ -703,7 +1081,7 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
 
             string ref_node_name = *sit;
 
-            Node *current_root = nodes_map.find(ref_node_name)->second;
+            Node *current_root = node_index.get_node(ref_node_name);
             double orig_dist = current_root->get_distance_to_parent();
 
             bool alignment_done = false;
@@ -821,11 +1199,7 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
                 }
 
                 if(Settings_handle::st.is("output-discarded-queries"))
-                {
-                    if( ! discarded_fstream.is_open() )
-                        discarded_fstream.open(discarded_filename.c_str(), fstream::out);
-                    discarded_fstream << ">" << reads->at(i).name << endl << reads->at(i).sequence << endl;
-                }
+                    this->write_discarded(&reads->at(i));
             }
 
             current_root->set_distance_to_parent(orig_dist);
@@ -834,12 +1208,13 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
             {
                 if(single_ref_sequence)
                 {
+                    node_index.insert_node(current_root,0);
                     root = current_root;
                     single_ref_sequence = false;
                 }
                 else
                 {
-                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, 1, &nodes_map);
+                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, 1, &node_index);
 
                     if(!parent_found)
                     {
@@ -855,11 +1230,11 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
                     current_root->get_right_child()->set_nhx_tid("");
                 }
 
-                this->fix_branch_lengths(root,current_root);
+                this->fix_branch_lengths(root,current_root,&node_index);
 
-                if(root->get_parent_node(current_root->get_name()) != 0)
+                Node *subroot = node_index.get_parent(current_root->get_name());
+                if(subroot != 0)
                 {
-                    Node *subroot = root->get_parent_node(current_root->get_name());
                     if(subroot->get_left_child()->get_name() == current_root->get_name())
                         subroot->reconstruct_one_parsimony_ancestor(mf,true);
                     else if(subroot->get_right_child()->get_name() == current_root->get_name())
@@ -901,6 +1276,11 @@ void Reads_aligner::query_placement_one(Node *root, vector<Fasta_entry> *reads,
 
         }
     }
+
+    if(use_cache)
+        this->save_placement_cache();
+
+    return count;
 }
 
 void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *queries, Model_factory *mf, int count, bool is_dna)
@@ -931,6 +1311,8 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
 
     Log_output::write_header("Aligning query sequences",0);
 
+    // built once; the nodes placed are added to it as they are created
+    Node_index node_index(root);
 
     for(int i=0;i<(int)queries->size();i++)
     {
@@ -999,10 +1381,6 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
         //
         sort(targets.begin(),targets.end(),Reads_aligner::node_is_smaller_ncbi);
 
-
-        map<string,Node*> nodes_map;
-        root->get_all_nodes(&nodes_map);
-
         map<string,int> nodes_number;
 
         // do one tagged node at time
@@ -1013,7 +1391,7 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
             string ref_node_name = (*sit).tid;
             string unique_query_name = queries->at(i).name;
 
-            Node *current_root = nodes_map.find(ref_node_name)->second;
+            Node *current_root = node_index.get_node(ref_node_name);
             double orig_dist = current_root->get_distance_to_parent();
 
             bool alignment_done = false;
@@ -1090,12 +1468,13 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
             {
                 if(single_ref_sequence)
                 {
+                    node_index.insert_node(current_root,0);
                     root = current_root;
                     single_ref_sequence = false;
                 }
                 else
                 {
-                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, 1, &nodes_map);
+                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, 1, &node_index);
 
                     if(!parent_found)
                     {
@@ -1103,11 +1482,11 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
                     }
                 }
 
-                this->fix_branch_lengths(root,current_root);
+                this->fix_branch_lengths(root,current_root,&node_index);
 
-                if(root->get_parent_node(current_root->get_name()) != 0)
+                Node *subroot = node_index.get_parent(current_root->get_name());
+                if(subroot != 0)
                 {
-                    Node *subroot = root->get_parent_node(current_root->get_name());
                     if(subroot->get_left_child()->get_name() == current_root->get_name())
                         subroot->reconstruct_one_parsimony_ancestor(mf,true);
                     else if(subroot->get_right_child()->get_name() == current_root->get_name())
@@ -1147,29 +1526,18 @@ void Reads_aligner::query_placement_one_ncbi(Node *root, vector<Fasta_entry> *qu
     }
 }
 
-void Reads_aligner::fix_branch_lengths(Node *root,Node *current_root)
+void Reads_aligner::fix_branch_lengths(Node *root,Node *current_root,const Node_index *node_index)
 {
-    if(root->get_parent_node(current_root->get_name()) != 0)
-    {
-        Node *subroot = root->get_parent_node(current_root->get_name());
-
-        vector<Fasta_entry> subalignment;
-        subroot->get_alignment(&subalignment,true);
-        vector<Fasta_entry>::iterator it = subalignment.begin();
-
-        Fasta_entry lnode,rnode,pnode,tnode;
+    Node *subroot = 0;
+    if(node_index != 0)
+        subroot = node_index->get_parent(current_root->get_name());
+    else
+        subroot = root->get_parent_node(current_root->get_name());
 
-        for(;it!=subalignment.end();it++)
-        {
-            if(it->name == current_root->left_child->get_name())
-                lnode = *it;
-            if(it->name == current_root->right_child->get_name())
-                rnode = *it;
-            if(it->name == current_root->get_name())
-                tnode = *it;
-            if(it->name == subroot->get_name())
-                pnode = *it;
-        }
+    if(subroot != 0)
+    {
+        Fasta_entry lnode,rnode,pnode;
+        this->get_branch_rows(subroot,current_root,&pnode.sequence,&lnode.sequence,&rnode.sequence);
 
         int share12=0; int share13=0; int share23=0;
         int ident12=0; int ident13=0; int ident23=0;
@@ -1224,19 +1592,8 @@ void Reads_aligner::fix_branch_lengths(Node *root,Node *current_root)
     }
     else
     {
-        vector<Fasta_entry> subalignment;
-        current_root->get_alignment(&subalignment,true);
-        vector<Fasta_entry>::iterator it = subalignment.begin();
-
-        Fasta_entry lnode,rnode;
-
-        for(;it!=subalignment.end();it++)
-        {
-            if(it->name == current_root->left_child->get_name())
-                lnode = *it;
-            if(it->name == current_root->right_child->get_name())
-                rnode = *it;
-        }
+        Fasta_entry lnode,rnode,tnode;
+        this->get_branch_rows(current_root,current_root,&tnode.sequence,&lnode.sequence,&rnode.sequence);
 
         int share=0;
         int ident=0;
@@ -1259,6 +1616,64 @@ void Reads_aligner::fix_branch_lengths(Node *root,Node *current_root)
     }
 }
 
+void Reads_aligner::get_branch_rows(Node *top, Node *current_root, string *top_row, string *left_row, string *right_row)
+{
+    // The rows of 'top' and of the children of 'current_root' (the node
+    // itself or a child of 'top') are made from the site indices along the
+    // branches; only stale indices require rendering the whole subtree.
+    if(top->left_needs_correcting_sequence_site_index() || top->right_needs_correcting_sequence_site_index() ||
+            current_root->left_needs_correcting_sequence_site_index() || current_root->right_needs_correcting_sequence_site_index())
+    {
+        vector<Fasta_entry> subalignment;
+        top->get_alignment(&subalignment,true);
+        vector<Fasta_entry>::iterator it = subalignment.begin();
+
+        for(;it!=subalignment.end();it++)
+        {
+            if(it->name == current_root->left_child->get_name())
+                *left_row = it->sequence;
+            if(it->name == current_root->right_child->get_name())
+                *right_row = it->sequence;
+            if(it->name == top->get_name())
+                *top_row = it->sequence;
+        }
+        return;
+    }
+
+    Sequence *top_sequence = top->get_sequence();
+    Sequence *current_sequence = current_root->get_sequence();
+    int length = top_sequence->sites_length();
+    bool current_is_left = top->get_left_child() == current_root;
+
+    vector<int> top_index(length);
+    vector<int> left_index(length,-1);
+    vector<int> right_index(length,-1);
+
+    for(int j=0;j<length;j++)
+    {
+        top_index.at(j) = j;
+
+        int t = j;
+        if(top != current_root)
+        {
+            Site_children *offspring = top_sequence->get_site_at(j)->get_children();
+            t = current_is_left ? offspring->left_index : offspring->right_index;
+        }
+
+        if(t>=0)
+        {
+            Site_children *offspring = current_sequence->get_site_at(t)->get_children();
+            left_index.at(j) = offspring->left_index;
+            right_index.at(j) = offspring->right_index;
+        }
+    }
+
+    string gap = top_sequence->get_gap_symbol();
+    top->append_alignment_row(&top_index,gap,top_row);
+    current_root->left_child->append_alignment_row(&left_index,gap,left_row);
+    current_root->right_child->append_alignment_row(&right_index,gap,right_row);
+}
+
 void Reads_aligner::translated_query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count)
 {
     this->define_translation_tables();
@@ -1365,8 +1780,7 @@ void Reads_aligner::translated_query_placement_all(Node *root, vector<Fasta_entr
     }
     sort(unique_nodes.begin(),unique_nodes.end(),Reads_aligner::node_is_smaller);
 
-    map<string,Node*> nodes_map;
-    root->get_all_nodes(&nodes_map);
+    Node_index node_index(root);
 
     map<string,int> nodes_number;
 
@@ -1394,7 +1808,7 @@ void Reads_aligner::translated_query_placement_all(Node *root, vector<Fasta_entr
         string ref_node_name = *sit;
 //        cout<<"REF "<<ref_node_name<<endl;
 
-        Node *current_root = nodes_map.find(ref_node_name)->second;
+        Node *current_root = node_index.get_node(ref_node_name);
         double orig_dist = current_root->get_distance_to_parent();
 
         bool alignment_done = false;
@@ -1461,11 +1875,12 @@ void Reads_aligner::translated_query_placement_all(Node *root, vector<Fasta_entr
             {
                 if(single_ref_sequence)
                 {
+                    node_index.insert_node(current_root,0);
                     global_root = current_root;
                 }
                 else
                 {
-                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &nodes_map);
+                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &node_index);
 
                     if(!parent_found)
                     {
@@ -1473,7 +1888,7 @@ void Reads_aligner::translated_query_placement_all(Node *root, vector<Fasta_entr
                     }
                 }
 
-                this->fix_branch_lengths(root,current_root);
+                this->fix_branch_lengths(root,current_root,&node_index);
 
                 ref_node_name = current_root->get_name();
             }
@@ -1545,6 +1960,9 @@ void Reads_aligner::translated_query_placement_one(Node *root, vector<Fasta_entr
 
     map<string,int> nodes_number;
 
+    // built once; the nodes placed are added to it as they are created
+    Node_index node_index(root);
+
     for(int i=0;i<(int)potential_orfs.size();i++)
     {
         string org_nodes_to_align = potential_orfs.at(i).node_to_align;
@@ -1569,10 +1987,6 @@ void Reads_aligner::translated_query_placement_one(Node *root, vector<Fasta_entr
         }
 
 
-        map<string,Node*> nodes_map;
-        root->get_all_nodes(&nodes_map);
-
-
         stringstream nodestream;
         nodestream << potential_orf.node_to_align;
 
@@ -1582,7 +1996,7 @@ void Reads_aligner::translated_query_placement_one(Node *root, vector<Fasta_entr
         {
 //            cout<<"REF "<<ref_node_name<<endl;
 
-            Node *current_root = nodes_map.find(ref_node_name)->second;
+            Node *current_root = node_index.get_node(ref_node_name);
             double orig_dist = current_root->get_distance_to_parent();
 
             bool alignment_done = false;
@@ -1656,12 +2070,13 @@ void Reads_aligner::translated_query_placement_one(Node *root, vector<Fasta_entr
             {
                 if(single_ref_sequence)
                 {
+                    node_index.insert_node(current_root,0);
                     root = current_root;
                     single_ref_sequence = false;
                 }
                 else
                 {
-                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &nodes_map);
+                    bool parent_found = this->correct_sites_index(current_root, ref_node_name, alignments_done, &node_index);
 
                     if(!parent_found)
                     {
@@ -1678,12 +2093,12 @@ void Reads_aligner::translated_query_placement_one(Node *root, vector<Fasta_entr
                 }
                 /* untested here */
 
-                this->fix_branch_lengths(root,current_root);
+                this->fix_branch_lengths(root,current_root,&node_index);
 
                 /* untested here */
-                if(root->get_parent_node(current_root->get_name()) != 0)
+                Node *subroot = node_index.get_parent(current_root->get_name());
+                if(subroot != 0)
                 {
-                    Node *subroot = root->get_parent_node(current_root->get_name());
                     if(subroot->get_left_child()->get_name() == current_root->get_name())
                         subroot->reconstruct_one_parsimony_ancestor(mf,true);
                     else if(subroot->get_right_child()->get_name() == current_root->get_name())
@@ -1845,6 +2260,13 @@ void Reads_aligner::find_targets_for_query(Node *root, Fasta_entry *read, Model_
         ss<<"Read "<<read->name<<" with TID "<<tid<<" matches "<<matching_nodes<<" nodes.\n";
         Log_output::write_out(ss.str(),2);
 
+        vector<Node*> batch;
+        for(map<string,hit>::iterator bit = exonerate_hits.begin();bit != exonerate_hits.end(); bit++)
+            batch.push_back(nodes.find(bit->first)->second);
+
+        map<Node*,double> scores, scores_rc;
+        this->score_candidate_nodes(batch,read,mf,compare_reverse,false,&scores,&scores_rc);
+
         map<string,hit>::iterator it = exonerate_hits.begin();
 
         for(;it != exonerate_hits.end(); it++)
@@ -1852,7 +2274,7 @@ void Reads_aligner::find_targets_for_query(Node *root, Fasta_entry *read, Model_
             string target_node = it->first;
 
             map<string,Node*>::iterator nit = nodes.find(target_node);
-            double score = this->read_match_score( nit->second, read, mf);
+            double score = scores[nit->second];
 
             stringstream ss;
             ss<<target_node<<" with score "<<score<<"\n";
@@ -1871,10 +2293,7 @@ void Reads_aligner::find_targets_for_query(Node *root, Fasta_entry *read, Model_
 
             if(compare_reverse)
             {
-                Fasta_entry rev_seq = *read;
-                rev_seq.sequence = this->reverse_complement(rev_seq.sequence);
-
-                double score = this->read_match_score( nit->second, &rev_seq, mf);
+                double score = scores_rc[nit->second];
 
                 stringstream ss;
                 ss<<target_node<<"(rc) with score "<<score<<"\n";
@@ -2100,16 +2519,44 @@ void Reads_aligner::find_nodes_for_query(Node *root, Fasta_entry *read, Model_fa
                 ss<<"Read "<<read->name<<" with TID "<<tid<<" matches "<<matching_nodes<<" nodes.\n";
                 Log_output::write_out(ss.str(),2);
 
-                while(tit != tid_nodes.end() && matching_nodes>0)
-                {
-                    map<string,Node*>::iterator nit = nodes.find(tit->second);
-                    double score = this->read_match_score( nit->second, read, mf);
+                vector<string> candidates;
+                multimap<string,string>::iterator cit = tit;
+                for(int c=0;cit != tid_nodes.end() && c<matching_nodes;c++,cit++)
+                    candidates.push_back(cit->second);
 
-                    stringstream ss;
-                    ss<<tit->second<<" with score "<<score<<"\n";
-                    Log_output::write_out(ss.str(),2);
+                map<Node*,double> scores, scores_rc;
+                set<string> shortlist;
+                bool prescored = ( ignore_tid_tags &&
+                                   this->search_nodes_top_down(root,candidates,read,mf,compare_reverse,&shortlist,&scores,&scores_rc) )
+                                 || this->shortlist_nodes(candidates,&nodes,read,compare_reverse,&shortlist);
 
-                    if(score==best_score && !Settings_handle::st.is("one-placement-only") && !Settings_handle::st.is("exhaustive-placement"))
+                vector<Node*> batch;
+                cit = tit;
+                for(int c=0;cit != tid_nodes.end() && c<matching_nodes;c++,cit++)
+                {
+                    if(!prescored || shortlist.find(cit->second) != shortlist.end())
+                        batch.push_back(nodes.find(cit->second)->second);
+                }
+
+                this->score_candidate_nodes(batch,read,mf,compare_reverse,false,&scores,&scores_rc);
+
+                while(tit != tid_nodes.end() && matching_nodes>0)
+                {
+                    if(prescored && shortlist.find(tit->second) == shortlist.end())
+                    {
+                        tit++;
+                        matching_nodes--;
+                        continue;
+                    }
+
+                    map<string,Node*>::iterator nit = nodes.find(tit->second);
+                    double score = scores[nit->second];
+
+                    stringstream ss;
+                    ss<<tit->second<<" with score "<<score<<"\n";
+                    Log_output::write_out(ss.str(),2);
+
+                    if(score==best_score && !Settings_handle::st.is("one-placement-only") && !Settings_handle::st.is("exhaustive-placement"))
                     {
                         best_score = score;
                         best_node.append(" "+tit->second);
@@ -2124,10 +2571,7 @@ void Reads_aligner::find_nodes_for_query(Node *root, Fasta_entry *read, Model_fa
 
                     if(compare_reverse)
                     {
-                        Fasta_entry rev_seq = *read;
-                        rev_seq.sequence = this->reverse_complement(rev_seq.sequence);
-
-                        double score = this->read_match_score( nit->second, &rev_seq, mf);
+                        double score = scores_rc[nit->second];
 
                         stringstream ss;
                         ss<<tit->second<<"(rc) with score "<<score<<"\n";
@@ -2214,10 +2658,30 @@ void Reads_aligner::select_node_for_query(Node *root, vector<Ncbi_hit> *targets,
     ss<<"Read "<<query->name<<" has "<<targets->size()<<" target nodes.\n";
     Log_output::write_out(ss.str(),1); //2);
 
+    vector<string> candidates;
+    for(int i=0;i<(int)targets->size();i++)
+        candidates.push_back(targets->at(i).tid);
+
+    set<string> shortlist;
+    bool prescored = this->shortlist_nodes(candidates,&nodes,query,false,&shortlist);
+
+    vector<Node*> batch;
+    for(int i=0;i<(int)targets->size();i++)
+    {
+        if(!prescored || shortlist.find(targets->at(i).tid) != shortlist.end())
+            batch.push_back(nodes.find(targets->at(i).tid)->second);
+    }
+
+    map<Node*,double> scores, scores_rc;
+    this->score_candidate_nodes(batch,query,mf,false,true,&scores,&scores_rc);
+
     for(int i=0;i<(int)targets->size();i++)
     {
+        if(prescored && shortlist.find(targets->at(i).tid) == shortlist.end())
+            continue;
+
         map<string,Node*>::iterator nit = nodes.find(targets->at(i).tid);
-        double score = this->query_match_score(nit->second, query, mf);
+        double score = scores[nit->second];
 
         stringstream ss;
         ss<<"matches "<<nit->first<<" with score "<<score<<"\n";
@@ -2262,21 +2726,25 @@ void Reads_aligner::select_node_for_query(Node *root, vector<Ncbi_hit> *targets,
 
 /**********************************************************************/
 
-double Reads_aligner::query_match_score(Node *node, Fasta_entry *query, Model_factory *mf)
+double Reads_aligner::query_match_score(Node *node, Fasta_entry *query, Model_factory *mf, Sequence *query_sequence)
 {
 
 
     double org_dist = node->get_distance_to_parent();
     node->set_distance_to_parent(0.001);
 
-    Node * query_node = new Node();
+    Node query_leaf;
+    Node *query_node = &query_leaf;
     double r_dist = Settings_handle::st.get("query-distance").as<float>();
     query_node->set_distance_to_parent(r_dist);
 
     bool revcomp = query->query_strand==Fasta_entry::reverse_strand;
-    this->copy_node_details(query_node,query,revcomp);
+    if(!query_sequence && query->first_read_length <= 0)
+        query_sequence = this->get_query_sequence(query, revcomp, true);
+    this->copy_node_details(query_node,query,revcomp,query_sequence);
 
-    Node * tmpnode = new Node();
+    Node tmp;
+    Node *tmpnode = &tmp;
     tmpnode->set_name("(tmp)");
 
     tmpnode->add_left_child(node);
@@ -2292,7 +2760,10 @@ double Reads_aligner::query_match_score(Node *node, Fasta_entry *query, Model_fa
     {
 
         // For scoring (below)
-        Evol_model model = mf->alignment_model(r_dist+0.001);
+        Evol_model model(mf->get_sequence_data_type(), r_dist+0.001);
+
+        #pragma omp critical
+        model = mf->alignment_model(r_dist+0.001);
 
         int matching = 0;
         int aligned = 0;
@@ -2341,11 +2812,261 @@ double Reads_aligner::query_match_score(Node *node, Fasta_entry *query, Model_fa
     }
 
     tmpnode->has_left_child(false);
-    delete tmpnode;
+    tmpnode->has_right_child(false);
 
     return score;
 }
 
+void Reads_aligner::score_candidate_nodes(const vector<Node*> &candidates, Fasta_entry *read, Model_factory *mf, bool compare_reverse,
+                                          bool is_query, map<Node*,double> *scores, map<Node*,double> *scores_rc)
+{
+    // The candidates of one query are aligned in a batch, each node once,
+    // and the scores are ranked afterwards in the original order. Nodes
+    // that already have a score are skipped. With several threads, every
+    // thread aligns its own copy of the query.
+    vector<Node*> batch;
+    set<Node*> seen;
+    for(int i=0;i<(int)candidates.size();i++)
+    {
+        if(scores->find(candidates.at(i)) == scores->end() && seen.insert(candidates.at(i)).second)
+            batch.push_back(candidates.at(i));
+    }
+
+    Fasta_entry rev_seq = *read;
+    if(compare_reverse)
+        rev_seq.sequence = this->reverse_complement(rev_seq.sequence);
+
+    int n_threads = 1;
+    if(Settings_handle::st.is("threads"))
+    {
+        int nt = Settings_handle::st.get("threads").as<int>();
+        if(nt>0)
+            n_threads = nt;
+    }
+    if(n_threads > (int)batch.size())
+        n_threads = batch.size();
+
+    vector<double> fwd(batch.size(),0.0);
+    vector<double> rev(batch.size(),0.0);
+
+    if(n_threads <= 1)
+    {
+        for(int i=0;i<(int)batch.size();i++)
+        {
+            if(is_query)
+                fwd.at(i) = this->query_match_score(batch.at(i), read, mf);
+            else
+                fwd.at(i) = this->read_match_score(batch.at(i), read, mf);
+
+            if(compare_reverse)
+                rev.at(i) = this->read_match_score(batch.at(i), &rev_seq, mf);
+        }
+    }
+    else
+    {
+        // Sequences keep their edge iterators in the sites and cannot be
+        // shared between threads; paired reads get private copies anyway
+        vector<Sequence*> lanes(n_threads,(Sequence*)0);
+        vector<Sequence*> lanes_rc(n_threads,(Sequence*)0);
+
+        if(read->first_read_length <= 0)
+        {
+            bool revcomp = is_query && read->query_strand==Fasta_entry::reverse_strand;
+
+            for(int t=0;t<n_threads;t++)
+            {
+                lanes.at(t) = new Sequence(*read, read->data_type, false, true, revcomp);
+                lanes.at(t)->is_read_sequence(is_query);
+
+                if(compare_reverse)
+                    lanes_rc.at(t) = new Sequence(rev_seq, rev_seq.data_type, false, true);
+            }
+        }
+
+        #pragma omp parallel for num_threads(n_threads) schedule(dynamic,1)
+        for(int i=0;i<(int)batch.size();i++)
+        {
+            int t = omp_get_thread_num();
+
+            if(is_query)
+                fwd.at(i) = this->query_match_score(batch.at(i), read, mf, lanes.at(t));
+            else
+                fwd.at(i) = this->read_match_score(batch.at(i), read, mf, lanes.at(t));
+
+            if(compare_reverse)
+                rev.at(i) = this->read_match_score(batch.at(i), &rev_seq, mf, lanes_rc.at(t));
+        }
+
+        for(int t=0;t<n_threads;t++)
+        {
+            delete lanes.at(t);
+            delete lanes_rc.at(t);
+        }
+    }
+
+    for(int i=0;i<(int)batch.size();i++)
+    {
+        scores->insert(make_pair(batch.at(i),fwd.at(i)));
+        if(compare_reverse)
+            scores_rc->insert(make_pair(batch.at(i),rev.at(i)));
+    }
+}
+
+bool Reads_aligner::search_nodes_top_down(Node *root, const vector<string> &candidates, Fasta_entry *read, Model_factory *mf,
+                                          bool compare_reverse, set<string> *shortlist, map<Node*,double> *scores, map<Node*,double> *scores_rc)
+{
+    // The tree is searched level by level from the root. The score of an
+    // internal node, aligned to its ancestral sequence, stands for the
+    // subtree below it: the children of nodes scoring within the margin
+    // of the best score so far are scored next and the other subtrees are
+    // skipped. The candidates among the nodes scored are kept. The score
+    // of a node is no bound for those below it, so this is a heuristic and
+    // the placement can differ from the one of the exhaustive search.
+    if(!Settings_handle::st.is("top-down-search") || candidates.size() < 3)
+        return false;
+
+    float margin = Settings_handle::st.get("top-down-margin").as<float>();
+
+    set<string> wanted(candidates.begin(),candidates.end());
+
+    double best_score = -HUGE_VAL;
+    int num_scored = 0;
+
+    vector<Node*> level(1,root);
+    while(!level.empty())
+    {
+        this->score_candidate_nodes(level,read,mf,compare_reverse,false,scores,scores_rc);
+        num_scored += level.size();
+
+        vector<double> level_scores;
+        for(int i=0;i<(int)level.size();i++)
+        {
+            double score = (*scores)[level.at(i)];
+            if(compare_reverse)
+                score = max(score,(*scores_rc)[level.at(i)]);
+
+            level_scores.push_back(score);
+            best_score = max(best_score,score);
+        }
+
+        // nodes below the bound are dropped; if none of the level is within
+        // it, only the best internal node of the level is followed
+        vector<Node*> next_level;
+        int best_internal = -1;
+        for(int i=0;i<(int)level.size();i++)
+        {
+            if(level.at(i)->is_leaf())
+                continue;
+
+            if(best_internal<0 || level_scores.at(i) > level_scores.at(best_internal))
+                best_internal = i;
+
+            if(level_scores.at(i) >= best_score-margin)
+            {
+                next_level.push_back(level.at(i)->get_left_child());
+                next_level.push_back(level.at(i)->get_right_child());
+            }
+        }
+
+        if(next_level.empty() && best_internal>=0)
+        {
+            next_level.push_back(level.at(best_internal)->get_left_child());
+            next_level.push_back(level.at(best_internal)->get_right_child());
+        }
+
+        level.swap(next_level);
+    }
+
+    for(map<Node*,double>::iterator it = scores->begin(); it != scores->end(); it++)
+    {
+        if(wanted.find(it->first->get_name()) != wanted.end())
+            shortlist->insert(it->first->get_name());
+    }
+
+    // e.g. only terminal candidates and the search stopped above them
+    if(shortlist->empty())
+    {
+        stringstream ss;
+        ss<<"Query "<<read->name<<": "<<num_scored<<" nodes scored top-down but none of the candidates; scoring all "<<candidates.size()<<" candidate nodes.\n";
+        Log_output::write_out(ss.str(),1);
+        return false;
+    }
+
+    stringstream ss;
+    ss<<"Query "<<read->name<<": "<<num_scored<<" nodes scored top-down, "<<shortlist->size()<<" of "<<candidates.size()<<" candidate nodes kept.\n";
+    Log_output::write_out(ss.str(),2);
+
+    return true;
+}
+
+bool Reads_aligner::shortlist_nodes(const vector<string> &candidates, map<string,Node*> *nodes, Fasta_entry *query, bool compare_reverse, set<string> *shortlist)
+{
+    // The candidates are ranked with the cheap ungapped score and only the
+    // best ones (ties included) and those close to the best are aligned.
+    if(!Settings_handle::st.is("prescore-keep-best"))
+        return false;
+
+    int keep_best = Settings_handle::st.get("prescore-keep-best").as<int>();
+    if(keep_best < 1 || (int)candidates.size() <= keep_best)
+        return false;
+
+    bool is_protein = query->data_type == Model_factory::protein;
+    Ungapped_prescore prescore(is_protein);
+
+    string forward = query->sequence;
+    string reverse = "";
+    if(!is_protein && (compare_reverse || query->query_strand == Fasta_entry::reverse_strand))
+        reverse = this->reverse_complement(forward);
+    if(query->query_strand == Fasta_entry::reverse_strand)
+        forward.swap(reverse);
+
+    vector< pair<int,int> > scores;
+    for(int i=0;i<(int)candidates.size();i++)
+    {
+        map<string,Node*>::iterator nit = nodes->find(candidates.at(i));
+        if(nit == nodes->end())
+        {
+            shortlist->insert(candidates.at(i));
+            continue;
+        }
+
+        string target = nit->second->get_sequence()->get_sequence_string(false);
+        int score = prescore.score(forward,target);
+        if(reverse != "")
+            score = max(score,prescore.score(reverse,target));
+
+        scores.push_back(make_pair(-score,i));
+    }
+
+    if(scores.empty())
+        return false;
+
+    sort(scores.begin(),scores.end());
+
+    int best = -scores.at(0).first;
+    if(best == 0)
+        return false;
+
+    float keep_above = 100;
+    if(Settings_handle::st.is("prescore-keep-above"))
+        keep_above = Settings_handle::st.get("prescore-keep-above").as<float>();
+
+    int limit = -scores.at( min(keep_best,(int)scores.size())-1 ).first;
+
+    for(int i=0;i<(int)scores.size();i++)
+    {
+        int score = -scores.at(i).first;
+        if(score >= limit || score >= best*keep_above/100.0)
+            shortlist->insert(candidates.at(scores.at(i).second));
+    }
+
+    stringstream ss;
+    ss<<"Query "<<query->name<<": "<<shortlist->size()<<" of "<<candidates.size()<<" candidate nodes kept after pre-scoring.\n";
+    Log_output::write_out(ss.str(),2);
+
+    return true;
+}
+
 /**********************************************************************/
 
 
@@ -2458,6 +3179,13 @@ void Reads_aligner::find_targets_for_queries(Node *root, vector<Fasta_entry> *re
             ss<<"Read "<<reads->at(i).name<<" with TID "<<tid<<" matches "<<matching_nodes<<" nodes.\n";
             Log_output::write_out(ss.str(),2);
 
+            vector<Node*> batch;
+            for(map<string,hit>::iterator bit = exonerate_hits.begin();bit != exonerate_hits.end(); bit++)
+                batch.push_back(nodes.find(bit->first)->second);
+
+            map<Node*,double> scores, scores_rc;
+            this->score_candidate_nodes(batch,&reads->at(i),mf,compare_reverse,false,&scores,&scores_rc);
+
             map<string,hit>::iterator it = exonerate_hits.begin();
 
             for(;it != exonerate_hits.end(); it++)
@@ -2465,7 +3193,7 @@ void Reads_aligner::find_targets_for_queries(Node *root, vector<Fasta_entry> *re
                 string target_node = it->first;
 
                 map<string,Node*>::iterator nit = nodes.find(target_node);
-                double score = this->read_match_score( nit->second, &reads->at(i), mf);
+                double score = scores[nit->second];
 
                 stringstream ss;
                 ss<<target_node<<" with score "<<score<<"\n";
@@ -2484,10 +3212,7 @@ void Reads_aligner::find_targets_for_queries(Node *root, vector<Fasta_entry> *re
 
                 if(compare_reverse)
                 {
-                    Fasta_entry rev_seq = reads->at(i);
-                    rev_seq.sequence = this->reverse_complement(rev_seq.sequence);
-
-                    double score = this->read_match_score( nit->second, &rev_seq, mf);
+                    double score = scores_rc[nit->second];
 
                     stringstream ss;
                     ss<<target_node<<"(rc) with score "<<score<<"\n";
@@ -2719,10 +3444,38 @@ void Reads_aligner::find_nodes_for_queries(Node *root, vector<Fasta_entry> *read
                     ss<<"Read "<<reads->at(i).name<<" with TID "<<tid<<" matches "<<matching_nodes<<" nodes.\n";
                     Log_output::write_out(ss.str(),2);
 
+                    vector<string> candidates;
+                    multimap<string,string>::iterator cit = tit;
+                    for(int c=0;cit != tid_nodes.end() && c<matching_nodes;c++,cit++)
+                        candidates.push_back(cit->second);
+
+                    map<Node*,double> scores, scores_rc;
+                    set<string> shortlist;
+                    bool prescored = ( ignore_tid_tags &&
+                                       this->search_nodes_top_down(root,candidates,&reads->at(i),mf,compare_reverse,&shortlist,&scores,&scores_rc) )
+                                     || this->shortlist_nodes(candidates,&nodes,&reads->at(i),compare_reverse,&shortlist);
+
+                    vector<Node*> batch;
+                    cit = tit;
+                    for(int c=0;cit != tid_nodes.end() && c<matching_nodes;c++,cit++)
+                    {
+                        if(!prescored || shortlist.find(cit->second) != shortlist.end())
+                            batch.push_back(nodes.find(cit->second)->second);
+                    }
+
+                    this->score_candidate_nodes(batch,&reads->at(i),mf,compare_reverse,false,&scores,&scores_rc);
+
                     while(tit != tid_nodes.end() && matching_nodes>0)
                     {
+                        if(prescored && shortlist.find(tit->second) == shortlist.end())
+                        {
+                            tit++;
+                            matching_nodes--;
+                            continue;
+                        }
+
                         map<string,Node*>::iterator nit = nodes.find(tit->second);
-                        double score = this->read_match_score( nit->second, &reads->at(i), mf);
+                        double score = scores[nit->second];
 
                         stringstream ss;
                         ss<<tit->second<<" with score "<<score<<"\n";
@@ -2741,10 +3494,7 @@ void Reads_aligner::find_nodes_for_queries(Node *root, vector<Fasta_entry> *read
 
                         if(compare_reverse)
                         {
-                            Fasta_entry rev_seq = reads->at(i);
-                            rev_seq.sequence = this->reverse_complement(rev_seq.sequence);
-
-                            double score = this->read_match_score( nit->second, &rev_seq, mf);
+                            double score = scores_rc[nit->second];
 
                             stringstream ss;
                             ss<<tit->second<<"(rc) with score "<<score<<"\n";
@@ -3020,101 +3770,57 @@ void Reads_aligner::find_orfs(Fasta_entry *read,vector<Orf> *open_frames)
         return;
     }
 
-    for(int i=0;i<3;i++)
+    // All six frames are translated in one pass. Stop codons and codons
+    // with other characters than ACGT are 'X' and the ORFs are the runs
+    // between them, found with a plain character search.
+    string frames[6];
+    frame_translation.translate_six_frames(dna,frames,'X');
+
+    string rev_dna = Frame_translation::reverse_complement(dna);
+
+    if(min_orf_length < 1)
+        min_orf_length = 1;
+
+    for(int f=0;f<6;f++)
     {
-        string prot;
-        string sequence = dna.substr(i);
-        int start_site = i;
-        int end_site = i+2;
+        int i = f%3;
+        bool reverse = f>=3;
+        const string &prot = frames[f];
 
-        for (unsigned int j=0; j<sequence.length(); j+=3)
+        size_t begin = 0;
+        while(begin < prot.length())
         {
-            string codon = sequence.substr(j,3);
-            if (codon_to_aa.find(codon) == codon_to_aa.end()
-                    || codon_to_aa.find(codon)->second == "X" || codon_to_aa.find(codon)->second == "-" )
+            size_t end = prot.find('X',begin);
+            if(end == string::npos)
+                end = prot.length();
+
+            if((int)(end-begin) >= min_orf_length)
             {
-                if((int)prot.length() >= min_orf_length)
+                int start_site = i+3*begin;
+                int end_site = i+3*end-1;
+
+                Orf o;
+                o.translation = prot.substr(begin,end-begin);
+
+                if(!reverse)
                 {
-                    Orf o;
-                    o.translation = prot;
                     o.frame = i+1;
                     o.start = start_site;
                     o.end = end_site;
                     o.dna_sequence = dna.substr(start_site,end_site-start_site+1);
-
-                    open_frames->push_back(o);
                 }
-
-                prot = "";
-                start_site = j+i+3;
-            }
-            else
-            {
-                prot += codon_to_aa.find(codon)->second;
-            }
-            end_site = j+i+2;
-        }
-
-
-        if((int)prot.length() >= min_orf_length)
-        {
-            Orf o;
-            o.translation = prot;
-            o.frame = i+1;
-            o.start = start_site;
-            o.end = end_site;
-            o.dna_sequence = dna.substr(start_site,end_site-start_site+1);
-
-            open_frames->push_back(o);
-        }
-    }
-
-    dna = this->reverse_complement(read->dna_sequence);
-    for(int i=0;i<3;i++)
-    {
-        string prot;
-        string sequence = dna.substr(i);
-        int start_site = i;
-        int end_site = i+2;
-
-        for (unsigned int j=0; j<sequence.length(); j+=3)
-        {
-            string codon = sequence.substr(j,3);
-            if (codon_to_aa.find(codon) == codon_to_aa.end()
-                    || codon_to_aa.find(codon)->second == "X" || codon_to_aa.find(codon)->second == "-" )
-            {
-                if((int)prot.length() >= min_orf_length)
+                else
                 {
-                    Orf o;
-                    o.translation = prot;
                     o.frame = -1*(i+1);
                     o.start = length - end_site;
                     o.end = length - start_site;
-                    o.dna_sequence = dna.substr(start_site,end_site-start_site+1);
-
-                    open_frames->push_back(o);
+                    o.dna_sequence = rev_dna.substr(start_site,end_site-start_site+1);
                 }
 
-                prot = "";
-                start_site = j+i+3;
+                open_frames->push_back(o);
             }
-            else
-            {
-                prot += codon_to_aa.find(codon)->second;
-            }
-            end_site = j+i+2;
-        }
 
-        if((int)prot.length() >= min_orf_length)
-        {
-            Orf o;
-            o.translation = prot;
-            o.frame = -1*(i+1);
-            o.start = length - end_site;
-            o.end = length - start_site;
-            o.dna_sequence = dna.substr(start_site,end_site-start_site+1);
-
-            open_frames->push_back(o);
+            begin = end+1;
         }
     }
 
@@ -3123,31 +3829,7 @@ void Reads_aligner::find_orfs(Fasta_entry *read,vector<Orf> *open_frames)
 
 string Reads_aligner::reverse_complement(string dna)
 {
-    string rev = dna;
-    reverse(rev.begin(), rev.end());
-
-    Text_utils tu;
-
-    tu.replace_all(rev,'A','Z');
-    tu.replace_all(rev,'T','A');
-    tu.replace_all(rev,'Z','T');
-    tu.replace_all(rev,'C','Z');
-    tu.replace_all(rev,'G','C');
-    tu.replace_all(rev,'Z','G');
-    tu.replace_all(rev,'R','Z');
-    tu.replace_all(rev,'Y','R');
-    tu.replace_all(rev,'Z','Y');
-    tu.replace_all(rev,'K','Z');
-    tu.replace_all(rev,'M','K');
-    tu.replace_all(rev,'Z','M');
-    tu.replace_all(rev,'B','Z');
-    tu.replace_all(rev,'V','B');
-    tu.replace_all(rev,'Z','V');
-    tu.replace_all(rev,'D','Z');
-    tu.replace_all(rev,'H','D');
-    tu.replace_all(rev,'Z','H');
-
-    return rev;
+    return Frame_translation::reverse_complement(dna);
 }
 
 void Reads_aligner::define_translation_tables()
@@ -3191,6 +3873,8 @@ void Reads_aligner::define_translation_tables()
             aa_to_codon.insert(make_pair(unaa[i],codon[i]));
         }
     }
+
+    frame_translation.index_codons(codon_to_aa);
 }
 
 
@@ -3228,106 +3912,71 @@ void Reads_aligner::read_alignment_scores(Node * node, string read_name, string
         }
     }
 
-    if(Settings_handle::st.is("overlap-with-any"))
-    {
-        for( int j=1; j < node_sequence->sites_length(); j++ )
-        {
-            bool read_has_site = node->has_site_at_alignment_column(j,read_name);
-            bool any_other_has_site = node->any_other_has_site_at_alignment_column(j,read_name);
-            bool ref_root_has_site = node->has_site_at_alignment_column(j,ref_node_name);
-
-            if(read_has_site && any_other_has_site)
-            {
-
-                int state_read = node->get_state_at_alignment_column(j,read_name);
-                int state_ref  = node->get_state_at_alignment_column(j,ref_node_name);
-
-                if(state_read>=0 && state_read == state_ref)
-                {
-                    if(as_dna)
-                    {
-                        if(ref_pos+3 <= (int)ref_dna_string.length() && read_pos+3 <= (int)read_dna_string.length())
-                        {
-                            if(ref_dna_string.at(ref_pos) == read_dna_string.at(read_pos))
-                                matched++;
-                            if(ref_dna_string.at(ref_pos+1) == read_dna_string.at(read_pos+1))
-                                matched++;
-                            if(ref_dna_string.at(ref_pos+2) == read_dna_string.at(read_pos+2))
-                                matched++;
-                        }
-                    }
-                    else
-                    {
-                        matched++;
-                    }
-                }
-                if(as_dna)
-                    aligned += step;
-                else
-                    aligned++;
-            }
-
-            if(read_has_site)
-            {
-                read_length += step;
-                if(as_dna)
-                    read_pos += step;
-            }
+    // The columns are mapped to the sites of the read and the reference node
+    // in one pass each; the loop below then only looks them up.
+    int length = node_sequence->sites_length();
 
-            if(ref_root_has_site && as_dna)
-                    ref_pos += step;
+    vector<int> read_sites;
+    vector<int> ref_sites;
+    Node *read_node = node->map_alignment_columns(read_name,&read_sites);
+    Node *ref_node = node->map_alignment_columns(ref_node_name,&ref_sites);
 
-        }
+    boost::dynamic_bitset<> overlapping;
+    if(Settings_handle::st.is("overlap-with-any"))
+    {
+        node->get_other_leaf_columns(read_name,&overlapping);
     }
-
     else
     {
-        for( int j=1; j < node_sequence->sites_length(); j++ )
-        {
-            bool read_has_site = node->has_site_at_alignment_column(j,read_name);
-            bool ref_root_has_site = node->has_site_at_alignment_column(j,ref_node_name);
+        overlapping.resize(length);
+        for( int j=0; j < length; j++ )
+            overlapping[j] = ref_sites.at(j)>=0;
+    }
 
+    for( int j=1; j < length; j++ )
+    {
+        bool read_has_site = read_sites.at(j)>=0;
+        bool ref_root_has_site = ref_sites.at(j)>=0;
 
-            if(read_has_site && ref_root_has_site)
-            {
-                int state_read = node->get_state_at_alignment_column(j,read_name);
-                int state_ref  = node->get_state_at_alignment_column(j,ref_node_name);
+        if(read_has_site && overlapping[j])
+        {
+            int state_read = read_node->get_sequence()->get_site_at(read_sites.at(j))->get_state();
+            int state_ref  = ref_root_has_site ? ref_node->get_sequence()->get_site_at(ref_sites.at(j))->get_state() : -1;
 
-                if(state_read>=0 && state_read == state_ref)
+            if(state_read>=0 && state_read == state_ref)
+            {
+                if(as_dna)
                 {
-                    if(as_dna)
+                    if(ref_pos+3 <= (int)ref_dna_string.length() && read_pos+3 <= (int)read_dna_string.length())
                     {
-                        if(ref_pos+3 <= (int)ref_dna_string.length() && read_pos+3 <= (int)read_dna_string.length())
-                        {
-                            if(ref_dna_string.at(ref_pos) == read_dna_string.at(read_pos))
-                                matched++;
-                            if(ref_dna_string.at(ref_pos+1) == read_dna_string.at(read_pos+1))
-                                matched++;
-                            if(ref_dna_string.at(ref_pos+2) == read_dna_string.at(read_pos+2))
-                                matched++;
-                        }
-                    }
-                    else
-                    {
-                        matched++;
+                        if(ref_dna_string.at(ref_pos) == read_dna_string.at(read_pos))
+                            matched++;
+                        if(ref_dna_string.at(ref_pos+1) == read_dna_string.at(read_pos+1))
+                            matched++;
+                        if(ref_dna_string.at(ref_pos+2) == read_dna_string.at(read_pos+2))
+                            matched++;
                     }
                 }
-                if(as_dna)
-                    aligned += step;
                 else
-                    aligned++;
-            }
-
-            if(read_has_site)
-            {
-                read_length += step;
-                if(as_dna)
-                    read_pos += step;
+                {
+                    matched++;
+                }
             }
+            if(as_dna)
+                aligned += step;
+            else
+                aligned++;
+        }
 
-            if(ref_root_has_site && as_dna)
-                    ref_pos += step;
+        if(read_has_site)
+        {
+            read_length += step;
+            if(as_dna)
+                read_pos += step;
         }
+
+        if(ref_root_has_site && as_dna)
+                ref_pos += step;
     }
 
     stringstream ss;
@@ -3341,7 +3990,7 @@ void Reads_aligner::read_alignment_scores(Node * node, string read_name, string
     *identity = (float)matched/(float)aligned;
 }
 
-double Reads_aligner::read_match_score(Node *node, Fasta_entry *read, Model_factory *mf)
+double Reads_aligner::read_match_score(Node *node, Fasta_entry *read, Model_factory *mf, Sequence *query_sequence)
 {
 
     double r_dist = Settings_handle::st.get("query-distance").as<float>();
@@ -3349,13 +3998,22 @@ double Reads_aligner::read_match_score(Node *node, Fasta_entry *read, Model_fact
     double org_dist = node->get_distance_to_parent();
     node->set_distance_to_parent(0.001);
 
-    Node * reads_node1 = new Node();
+    // The temporary nodes live on the stack; the query sequence is shared
+    // by all candidates unless the alignment consumes its pair-end break.
+    Node reads_node;
+    Node *reads_node1 = &reads_node;
     reads_node1->set_distance_to_parent(r_dist);
     reads_node1->set_name(read->name);
     reads_node1->add_name_comment(read->comment);
-    reads_node1->add_sequence( *read, read->data_type, false, true);
+    if(query_sequence)
+        reads_node1->add_shared_sequence( query_sequence );
+    else if(read->first_read_length > 0)
+        reads_node1->add_sequence( *read, read->data_type, false, true);
+    else
+        reads_node1->add_shared_sequence( this->get_query_sequence(read, false, false) );
 
-    Node * tmpnode = new Node();
+    Node tmp;
+    Node *tmpnode = &tmp;
     tmpnode->set_name("(tmp)");
 
     tmpnode->add_left_child(node);
@@ -3371,7 +4029,10 @@ double Reads_aligner::read_match_score(Node *node, Fasta_entry *read, Model_fact
     {
 
         // For scoring (below)
-        Evol_model model = mf->alignment_model(r_dist+0.001);
+        Evol_model model(mf->get_sequence_data_type(), r_dist+0.001);
+
+        #pragma omp critical
+        model = mf->alignment_model(r_dist+0.001);
 
         int matching = 0;
         int aligned = 0;
@@ -3420,13 +4081,13 @@ double Reads_aligner::read_match_score(Node *node, Fasta_entry *read, Model_fact
     }
 
     tmpnode->has_left_child(false);
-    delete tmpnode;
+    tmpnode->has_right_child(false);
 
     return score;
 }
 
 
-bool Reads_aligner::correct_sites_index(Node *current_root, string ref_node_name, int alignments_done, map<string,Node*> *nodes_map)
+bool Reads_aligner::correct_sites_index(Node *current_root, string ref_node_name, int alignments_done, Node_index *node_index)
 {
 
     // correct the sites index at the parent node; insertions corrected later
@@ -3434,9 +4095,12 @@ bool Reads_aligner::correct_sites_index(Node *current_root, string ref_node_name
     vector<int> sites_index;
     int index_delta = 0;
 
-    for(int j=0; j<current_root->get_sequence()->sites_length(); j++)
+    vector<int> ref_sites;
+    current_root->map_alignment_columns(ref_node_name,&ref_sites);
+
+    for(int j=0; j<(int)ref_sites.size(); j++)
     {
-        if(current_root->has_site_at_alignment_column(j,ref_node_name))
+        if(ref_sites.at(j)>=0)
         {
             sites_index.push_back(index_delta);
             index_delta = 0;
@@ -3446,33 +4110,22 @@ bool Reads_aligner::correct_sites_index(Node *current_root, string ref_node_name
     }
 
 
-    Node *current_parent = 0;
-    map<string,Node*>::iterator mit = nodes_map->begin();
-    bool parent_found = false;
+    Node *current_parent = node_index->get_parent(ref_node_name);
+    bool parent_found = current_parent != 0;
 
     int is_left_child = true;
-    for(;mit != nodes_map->end();mit++)
+    if(parent_found)
     {
-//        if(!mit->second->is_leaf())
-//            cout<<mit->second->get_name()<<" "<<mit->second->get_left_child()->get_name()<<" "<<ref_node_name<<endl;
-        if(!mit->second->is_leaf() && mit->second->get_left_child()->get_name() == ref_node_name)
-        {
-            current_parent = mit->second;
+        if(current_parent->get_left_child()->get_name() == ref_node_name)
             current_parent->add_left_child(current_root);
-            parent_found = true;
-        }
-
-//        if(!mit->second->is_leaf())
-//            cout<<mit->second->get_name()<<" "<<mit->second->get_right_child()->get_name()<<" "<<ref_node_name<<endl;
-        if(!mit->second->is_leaf() && mit->second->get_right_child()->get_name() == ref_node_name)
+        else
         {
-            current_parent = mit->second;
             current_parent->add_right_child(current_root);
             is_left_child = false;
-            parent_found = true;
         }
     }
 
+    node_index->insert_node(current_root,current_parent);
 
     if(parent_found)
     {
@@ -3549,14 +4202,22 @@ bool Reads_aligner::correct_sites_index(Node *current_root, string ref_node_name
 
 /************************************************************************************************/
 
-void Reads_aligner::pair_and_sort(vector<Fasta_entry> *reads)
+void Reads_aligner::pair_and_sort(vector<Fasta_entry> *reads, int first_mate)
 {
     // Couple paired reads
     //
     if( Settings_handle::st.is("pair-end") )
     {
         Log_output::write_header("Aligning reads: find read pairs",0);
-        this->find_paired_reads( reads );
+        this->find_paired_reads( reads, first_mate );
+    }
+
+
+    // Place identical queries once
+    //
+    if( Settings_handle::st.is("collapse-duplicate-queries") )
+    {
+        this->collapse_duplicates( reads );
     }
 
 
@@ -3568,53 +4229,159 @@ void Reads_aligner::pair_and_sort(vector<Fasta_entry> *reads)
     }
 }
 
-void Reads_aligner::find_paired_reads(vector<Fasta_entry> *reads)
+void Reads_aligner::collapse_duplicates(vector<Fasta_entry> *reads)
 {
+    // Queries with the same sequence, quality, DNA and tid are merged into
+    // the first one: it keeps their names for the output and their total
+    // copy number for the consensus weights.
+    //
+    boost::unordered_map<string,int> first_copy;
+    vector<bool> keep(reads->size(),true);
+    int n_unique = 0;
 
-    vector<Fasta_entry>::iterator fit1 = reads->begin();
-
-    for(;fit1 != reads->end();fit1++)
+    for(int i=0;i<(int)reads->size();i++)
     {
-        string name1 = fit1->name;
-        if(name1.substr(name1.length()-2) != "/1")
+        Fasta_entry *read = &reads->at(i);
+
+        stringstream key;
+        key<<read->tid<<'\t'<<read->first_read_length<<'\t'<<read->sequence<<'\t'<<read->quality<<'\t'<<read->dna_sequence;
+
+        boost::unordered_map<string,int>::iterator it = first_copy.find(key.str());
+        if(it == first_copy.end())
         {
+            first_copy.insert(make_pair(key.str(),i));
+            n_unique++;
             continue;
         }
 
-        vector<Fasta_entry>::iterator fit2 = fit1;
-        fit2++;
+        Fasta_entry *first = &reads->at(it->second);
+        first->duplicates.push_back(make_pair(read->name,read->comment));
+        first->duplicates.insert(first->duplicates.end(),read->duplicates.begin(),read->duplicates.end());
+        first->num_duplicates += read->num_duplicates;
+        keep.at(i) = false;
+    }
 
-        for(;fit2 != reads->end();)
-        {
-            string name2 = fit2->name;
-            if(name2.substr(name2.length()-2) != "/2")
-            {
-                fit2++;
-                continue;
-            }
+    if(n_unique == (int)reads->size())
+        return;
 
-            if(name1.substr(0,name1.length()-2)==name2.substr(0,name2.length()-2))
-            {
-                Log_output::write_out("Pairing "+fit1->name+" and "+fit2->name+": new name ",2);
+    stringstream ss;
+    ss<<"Collapsed "<<reads->size()<<" queries into "<<n_unique<<" unique ones.\n";
+    Log_output::write_out(ss.str(),1);
+
+    int j = 0;
+    for(int i=0;i<(int)reads->size();i++)
+    {
+        if(!keep.at(i))
+            continue;
+        if(i != j)
+            this->move_read(&reads->at(j),&reads->at(i));
+        j++;
+    }
+    reads->resize(j);
+}
 
-                fit1->name = name1.substr(0,name1.length()-1)+"p12";
+void Reads_aligner::find_paired_reads(vector<Fasta_entry> *reads, int first_mate)
+{
+    // Reads from 'first_mate' on come from a separate mate file; otherwise
+    // the mates are the reads named '/2'. Mates are indexed by the name stem,
+    // merged into their first reads and then removed in one pass.
+    //
+    bool mate_file = first_mate >= 0;
+    int n_reads = reads->size();
+    int n_first = mate_file ? first_mate : n_reads;
 
-                Log_output::write_out(fit1->name+".\n",2);
+    boost::unordered_map<string,int> mates;
+    for(int i=mate_file ? first_mate : 0;i<n_reads;i++)
+    {
+        const string &name = reads->at(i).name;
+        int suffix = this->mate_suffix(name);
 
-                fit1->comment = fit2->comment;
-                fit1->first_read_length = fit1->sequence.length();
-                fit1->sequence += "0"+fit2->sequence;
-                if(fit1->quality!="")
-                    fit1->quality += "0"+fit2->quality;
+        if(!mate_file && suffix != 2)
+            continue;
 
-                reads->erase(fit2);
+        mates.insert(make_pair(suffix>0 ? name.substr(0,name.length()-2) : name,i));
+    }
 
-                continue;
-            }
+    vector<bool> merged(n_reads,false);
 
-            fit2++;
-        }
+    for(int i=0;i<n_first && !mates.empty();i++)
+    {
+        Fasta_entry *read1 = &reads->at(i);
+        int suffix = this->mate_suffix(read1->name);
+
+        if(!mate_file && suffix != 1)
+            continue;
+
+        string stem = suffix>0 ? read1->name.substr(0,read1->name.length()-2) : read1->name;
+
+        boost::unordered_map<string,int>::iterator mit = mates.find(stem);
+        if(mit == mates.end())
+            continue;
+
+        Fasta_entry *read2 = &reads->at(mit->second);
+
+        Log_output::write_out("Pairing "+read1->name+" and "+read2->name+": new name ",2);
+
+        read1->name = stem+"/p12";
+
+        Log_output::write_out(read1->name+".\n",2);
+
+        read1->comment = read2->comment;
+        read1->first_read_length = read1->sequence.length();
+        read1->sequence.reserve(read1->sequence.length()+1+read2->sequence.length());
+        read1->sequence += "0"+read2->sequence;
+        if(read1->quality!="")
+            read1->quality += "0"+read2->quality;
+
+        merged.at(mit->second) = true;
+        mates.erase(mit);
     }
+
+    int next = 0;
+    for(int i=0;i<n_reads;i++)
+    {
+        if(merged.at(i))
+            continue;
+
+        if(next != i)
+            this->move_read(&reads->at(next),&reads->at(i));
+        next++;
+    }
+    reads->erase(reads->begin()+next,reads->end());
+}
+
+int Reads_aligner::mate_suffix(const string &name)
+{
+    int length = name.length();
+    if(length>2 && name.at(length-2) == '/')
+    {
+        if(name.at(length-1) == '1')
+            return 1;
+        if(name.at(length-1) == '2')
+            return 2;
+    }
+    return 0;
+}
+
+void Reads_aligner::move_read(Fasta_entry *to, Fasta_entry *from)
+{
+    // the strings are swapped, not copied
+    to->name.swap(from->name);
+    to->comment.swap(from->comment);
+    to->sequence.swap(from->sequence);
+    to->dna_sequence.swap(from->dna_sequence);
+    to->quality.swap(from->quality);
+    to->edges.swap(from->edges);
+    to->tid.swap(from->tid);
+    to->node_to_align.swap(from->node_to_align);
+    to->data_type = from->data_type;
+    to->node_score = from->node_score;
+    to->first_read_length = from->first_read_length;
+    to->cluster_attempts = from->cluster_attempts;
+    to->reversed = from->reversed;
+    to->num_duplicates = from->num_duplicates;
+    to->query_strand = from->query_strand;
+    to->duplicates.swap(from->duplicates);
 }
 
 /**********************************************************************/
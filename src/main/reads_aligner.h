@@ -22,12 +22,16 @@
 #define READS_ALIGNER_H
 
 #include <vector>
+#include <set>
 #include "utils/settings.h"
 #include "utils/settings_handle.h"
 #include "utils/model_factory.h"
 #include "utils/fasta_entry.h"
 #include "utils/fasta_reader.h"
+#include "utils/frame_translation.h"
+#include "utils/placement_cache.h"
 #include "main/node.h"
+#include "main/node_index.h"
 #include "main/sequence.h"
 #include "main/viterbi_alignment.h"
 
@@ -49,22 +53,58 @@ struct Ncbi_hit {
 class Reads_aligner
 {
     Node *global_root;
+    bool discarded_opened;
+
+    // Leaf sequences of the query being scored (one per strand), shared by
+    // the temporary nodes of all its candidate alignments
+    struct Query_sequence
+    {
+        Fasta_entry entry;
+        bool turn_revcomp;
+        bool is_read;
+        Sequence *sequence;
+    };
+    vector<Query_sequence> query_sequences;
+
+    Sequence *get_query_sequence(Fasta_entry *read, bool turn_revcomp, bool is_read);
+    void clear_query_sequences();
+
+    Reads_aligner(const Reads_aligner &);
+    Reads_aligner &operator=(const Reads_aligner &);
     map<string,string> codon_to_aa;
     map<string,string> aa_to_codon;
+    Frame_translation frame_translation;
+
+    // Placements reused across runs; the chain is the key of the last
+    // query placed, as the tree grows with every placement
+    Placement_cache placement_cache;
+    string placement_chain;
+
+    bool open_placement_cache(Node *root, Model_factory *mf);
+    void save_placement_cache();
+    void find_cached_nodes_for_queries(Node *root, vector<Fasta_entry> *reads, Model_factory *mf,
+                                       map<string,string> *target_sequences, bool preselected_targets, bool is_dna);
 
     void pileup_alignment(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count);
     void translated_pileup_alignment(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count);
-    void query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna);
-    void query_placement_one(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna);
+    int query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna);
+    int query_placement_one(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna);
     void translated_query_placement_all(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count);
     void translated_query_placement_one(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count);
 
     void query_placement_one_ncbi(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count, bool is_dna);
 
+    bool can_stream_queries();
+    void streamed_query_placement(Node *root, Model_factory *mf, int count, string file);
+    void read_query_batch(istream *input, vector<Fasta_entry> *reads, int batch_size, map<string,int> *copy_num, string *messages, bool *more);
+    void write_discarded(Fasta_entry *read);
+    void collapse_duplicates(vector<Fasta_entry> *reads);
+
     void do_upwards_search(Node *root, Fasta_entry *read, Model_factory *mf);
     void do_upwards_search(Node *root, vector<Fasta_entry> *reads, Model_factory *mf);
 
-    void fix_branch_lengths(Node *root,Node *current_root);
+    void fix_branch_lengths(Node *root,Node *current_root,const Node_index *node_index=0);
+    void get_branch_rows(Node *top, Node *current_root, string *top_row, string *left_row, string *right_row);
 
     void find_orfs(Fasta_entry *read,vector<Orf> *open_frames);
     void define_translation_tables();
@@ -78,16 +118,23 @@ class Reads_aligner
 
     void select_node_for_query(Node *root, vector<Ncbi_hit> *targets, Fasta_entry *query, Model_factory *mf,bool is_dna);
 
-    double query_match_score(Node *node, Fasta_entry *read, Model_factory *mf);
-    double read_match_score(Node *node, Fasta_entry *read, Model_factory *mf);
+    double query_match_score(Node *node, Fasta_entry *read, Model_factory *mf, Sequence *query_sequence = 0);
+    bool shortlist_nodes(const vector<string> &candidates, map<string,Node*> *nodes, Fasta_entry *query, bool compare_reverse, set<string> *shortlist);
+    bool search_nodes_top_down(Node *root, const vector<string> &candidates, Fasta_entry *read, Model_factory *mf,
+                               bool compare_reverse, set<string> *shortlist, map<Node*,double> *scores, map<Node*,double> *scores_rc);
+    double read_match_score(Node *node, Fasta_entry *read, Model_factory *mf, Sequence *query_sequence = 0);
+    void score_candidate_nodes(const vector<Node*> &candidates, Fasta_entry *read, Model_factory *mf, bool compare_reverse,
+                               bool is_query, map<Node*,double> *scores, map<Node*,double> *scores_rc);
 
     void read_alignment_scores(Node * node, string read_name, string ref_node_name, float *overlap, float *identity);
     bool read_alignment_overlaps(Node * node, string read_name, string ref_node_name);
 
-    void pair_and_sort(vector<Fasta_entry> *reads);
-    void find_paired_reads(vector<Fasta_entry> *reads);
+    void pair_and_sort(vector<Fasta_entry> *reads, int first_mate=-1);
+    void find_paired_reads(vector<Fasta_entry> *reads, int first_mate=-1);
+    int mate_suffix(const string &name);
+    void move_read(Fasta_entry *to, Fasta_entry *from);
 
-    bool correct_sites_index(Node *current_root, string ref_node_name, int alignments_done, map<string,Node*> *nodes_map);
+    bool correct_sites_index(Node *current_root, string ref_node_name, int alignments_done, Node_index *node_index);
     void preselect_target_sequences(Node *root, vector<Fasta_entry> *reads, map<string,string> *target_sequences, bool is_dna);
     void preselect_target_sequences_ncbi(Node *root, vector<Fasta_entry> *reads, int num_ncbi_targets, bool is_dna);
 
@@ -144,15 +191,25 @@ class Reads_aligner
 
     static bool node_is_smaller_ncbi(const Ncbi_hit& l,const Ncbi_hit& r) { return true; }
 
-    void copy_node_details(Node *reads_node,Fasta_entry *read,bool turn_revcomp=false)
+    void copy_node_details(Node *reads_node,Fasta_entry *read,bool turn_revcomp=false,Sequence *shared_sequence=0)
     {
         double r_dist = Settings_handle::st.get("query-distance").as<float>();
 
         reads_node->set_distance_to_parent(r_dist);
         reads_node->set_name(read->name);
         reads_node->add_name_comment(read->comment);
-        reads_node->add_sequence( *read, read->data_type, false, true, turn_revcomp);
-        reads_node->get_sequence()->is_read_sequence(true);
+
+        // shared sequences are only for scoring nodes that are thrown away
+        if(shared_sequence)
+        {
+            reads_node->add_shared_sequence( shared_sequence );
+        }
+        else
+        {
+            reads_node->set_duplicate_queries(read->duplicates);
+            reads_node->add_sequence( *read, read->data_type, false, true, turn_revcomp);
+            reads_node->get_sequence()->is_read_sequence(true);
+        }
 
         if(read->dna_sequence.length()>0)
         {
@@ -255,9 +312,13 @@ class Reads_aligner
 
 public:
     Reads_aligner();
+    ~Reads_aligner();
     void align(Node *root, Model_factory *mf,int count);
 
     Node *get_global_root() { return global_root; }
+
+    string unbatched_mode();
+    int place_queries(Node *root, vector<Fasta_entry> *reads, Model_factory *mf, int count);
 };
 }
 
@@ -659,6 +659,8 @@ public:
 
 class Sequence
 {
+    friend class Tree_snapshot;
+
     int curr_site_index;
     int prev_site_index;
     int curr_edge_index;
@@ -165,6 +165,9 @@ void Viterbi_alignment::align(Sequence *left_sequence,Sequence *right_sequence,E
     align_array Y(boost::extents[left_length-1][right_length-1]);
     match = &M;    xgap = &X;    ygap = &Y;
 
+    this->define_matrix_slices();
+    terminal_edges = !Settings_handle::st.is("no-terminal-edges");
+
     Log_output::write_out("Viterbi_alignment: matrix created",3);
 
     // Dynamic programming loop
@@ -670,6 +673,34 @@ void Viterbi_alignment::initialise_array_corner_bwd()
     }
 }
 
+void Viterbi_alignment::define_matrix_slices()
+{
+    int i_max = match->shape()[0];
+    int j_max = match->shape()[1];
+
+    x_columns.clear(); y_columns.clear(); m_columns.clear();
+    x_rows.clear(); y_rows.clear(); m_rows.clear();
+
+    x_columns.reserve(j_max); y_columns.reserve(j_max); m_columns.reserve(j_max);
+    x_rows.reserve(i_max); y_rows.reserve(i_max); m_rows.reserve(i_max);
+
+    for(int j=0;j<j_max;j++)
+    {
+        x_columns.push_back( (*xgap)[ indices[ range( 0,i_max ) ][j] ] );
+        y_columns.push_back( (*ygap)[ indices[ range( 0,i_max ) ][j] ] );
+        m_columns.push_back( (*match)[ indices[ range( 0,i_max ) ][j] ] );
+    }
+
+    for(int i=0;i<i_max;i++)
+    {
+        x_rows.push_back( (*xgap)[ indices[i][ range( 0,j_max ) ] ] );
+        y_rows.push_back( (*ygap)[ indices[i][ range( 0,j_max ) ] ] );
+        m_rows.push_back( (*match)[ indices[i][ range( 0,j_max ) ] ] );
+    }
+}
+
+/********************************************/
+
 void Viterbi_alignment::compute_fwd_scores(int i,int j)
 {
     if(i==0 && j==0)
@@ -680,7 +711,7 @@ void Viterbi_alignment::compute_fwd_scores(int i,int j)
 
     if( j==0 || j == (int) match->shape()[1]-1 )
     {
-        if(!Settings_handle::st.is("no-terminal-edges"))
+        if(terminal_edges)
             j_gap_type = Viterbi_alignment::end_gap;
     }
 
@@ -691,7 +722,7 @@ void Viterbi_alignment::compute_fwd_scores(int i,int j)
 
     if( i==0 || i == (int) match->shape()[0]-1 )
     {
-        if(!Settings_handle::st.is("no-terminal-edges"))
+        if(terminal_edges)
             i_gap_type = Viterbi_alignment::end_gap;
     }
 
@@ -716,11 +747,7 @@ void Viterbi_alignment::compute_fwd_scores(int i,int j)
     {
         left_site = left->get_site_at(left_index);
 
-        align_slice x_slice = (*xgap)[ indices[ range( 0,xgap->shape()[0] ) ][j] ];
-        align_slice y_slice = (*ygap)[ indices[ range( 0,ygap->shape()[0] ) ][j] ];
-        align_slice m_slice = (*match)[ indices[ range( 0,match->shape()[0] ) ][j] ];
-
-        this->iterate_bwd_edges_for_gap(left_site,&x_slice,&y_slice,&m_slice,max_x,true,j_gap_type);
+        this->iterate_bwd_edges_for_gap(left_site,&x_columns[j],&y_columns[j],&m_columns[j],max_x,true,j_gap_type);
         max_x->y_ind = j;
 
     }
@@ -739,11 +766,7 @@ void Viterbi_alignment::compute_fwd_scores(int i,int j)
     {
         right_site = right->get_site_at(right_index);
 
-        align_slice x_slice = (*xgap)[ indices[i][ range( 0,xgap->shape()[1] ) ] ];
-        align_slice y_slice = (*ygap)[ indices[i][ range( 0,ygap->shape()[1] ) ] ];
-        align_slice m_slice = (*match)[ indices[i][ range( 0,match->shape()[1] ) ] ];
-
-        this->iterate_bwd_edges_for_gap(right_site,&y_slice,&x_slice,&m_slice,max_y,false,i_gap_type);
+        this->iterate_bwd_edges_for_gap(right_site,&y_rows[i],&x_rows[i],&m_rows[i],max_y,false,i_gap_type);
         max_y->x_ind = i;
 
     }
@@ -802,9 +825,7 @@ void Viterbi_alignment::compute_bwd_full_score(int i,int j)
     {
         left_site = left->get_site_at(left_index);
 
-        align_slice x_slice = (*xgap)[ indices[ range( 0,xgap->shape()[0] ) ][j] ];
-
-        this->iterate_fwd_edges_for_gap(left_site,&x_slice,max_x,max_y,max_m);
+        this->iterate_fwd_edges_for_gap(left_site,&x_columns[j],max_x,max_y,max_m);
 
     }
 
@@ -812,9 +833,7 @@ void Viterbi_alignment::compute_bwd_full_score(int i,int j)
     {
         right_site = right->get_site_at(right_index);
 
-        align_slice y_slice = (*ygap)[ indices[i][ range( 0,ygap->shape()[1] ) ] ];
-
-        this->iterate_fwd_edges_for_gap(right_site,&y_slice,max_y,max_x,max_m);
+        this->iterate_fwd_edges_for_gap(right_site,&y_rows[i],max_y,max_x,max_m);
 
     }
 
@@ -51,6 +51,14 @@ class Viterbi_alignment: public Basic_alignment
     align_array::index_gen indices;
     typedef align_array::array_view<1>::type align_slice;
 
+    // Row and column views of the three matrices and the terminal-edge
+    // setting, defined once per alignment instead of once per cell
+    vector<align_slice> x_columns, y_columns, m_columns;
+    vector<align_slice> x_rows, y_rows, m_rows;
+    bool terminal_edges;
+
+    void define_matrix_slices();
+
     /*********************************/
 
     void merge_sampled_sequence(Sequence *ancestral_sequence, Sequence *sampled_sequence);
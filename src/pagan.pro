@@ -39,7 +39,19 @@ SOURCES += main.cpp \
     utils/tree_node.cpp \
     utils/bppdist_tree.cpp \
     utils/bppphysamp_tree.cpp \
-    utils/bppancestors.cpp
+    utils/bppancestors.cpp \
+    utils/nj_tree.cpp \
+    utils/kmer_distance.cpp \
+    utils/ancestral_reconstruction.cpp \
+    utils/tree_sampler.cpp \
+    utils/subprocess.cpp \
+    utils/tree_snapshot.cpp \
+    main/placement_server.cpp \
+    main/node_index.cpp \
+    utils/gzip_input.cpp \
+    utils/ungapped_prescore.cpp \
+    utils/frame_translation.cpp \
+    utils/placement_cache.cpp
 HEADERS += utils/text_utils.h \
     main/node.h \
     main/sequence.h \
@@ -71,8 +83,20 @@ HEADERS += utils/text_utils.h \
     utils/tree_node.h \
     utils/bppdist_tree.h \
     utils/bppphysamp_tree.h \
-    utils/bppancestors.h
-LIBS += -lboost_program_options -lboost_regex -lboost_thread  -lboost_system -lrt -lgomp -lcurl
+    utils/bppancestors.h \
+    utils/nj_tree.h \
+    utils/kmer_distance.h \
+    utils/ancestral_reconstruction.h \
+    utils/tree_sampler.h \
+    utils/subprocess.h \
+    utils/tree_snapshot.h \
+    main/placement_server.h \
+    main/node_index.h \
+    utils/gzip_input.h \
+    utils/ungapped_prescore.h \
+    utils/frame_translation.h \
+    utils/placement_cache.h
+LIBS += -lboost_program_options -lboost_regex -lboost_thread  -lboost_system -lrt -lgomp -lcurl -lz
 INCLUDEPATH += /usr/include
 OTHER_FILES +=  ../VERSION_HISTORY
 
@@ -0,0 +1,388 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/ancestral_reconstruction.h"
+#include "utils/log_output.h"
+#include <omp.h>
+
+using namespace std;
+using namespace ppa;
+
+Ancestral_reconstruction::Ancestral_reconstruction()
+{
+    n_states = 0;
+    word_size = 1;
+}
+
+/************************************************************************************/
+
+void Ancestral_reconstruction::index_nodes(Node *node,int parent,map<string,int> *rows)
+{
+    Tree_index ti;
+    ti.left = -1;
+    ti.right = -1;
+    ti.parent = parent;
+    ti.distance = node->get_distance_to_parent();
+
+    map<string,int>::iterator ri = rows->find(node->get_name());
+    ti.row = ri != rows->end() ? ri->second : -1;
+
+    if(!node->is_leaf())
+    {
+        // children are indexed first; their parent index is patched below
+        this->index_nodes(node->get_left_child(),-1,rows);
+        ti.left = nodes.size()-1;
+        this->index_nodes(node->get_right_child(),-1,rows);
+        ti.right = nodes.size()-1;
+    }
+
+    nodes.push_back(ti);
+
+    if(!node->is_leaf())
+    {
+        int self = nodes.size()-1;
+        nodes.at(ti.left).parent = self;
+        nodes.at(ti.right).parent = self;
+    }
+}
+
+/************************************************************************************/
+
+int Ancestral_reconstruction::character_code(const char *c) const
+{
+    if(word_size==1)
+        return char_codes[(unsigned char)*c];
+
+    map<string,int>::const_iterator wi = word_codes.find(string(c,word_size));
+    if(wi != word_codes.end())
+        return wi->second;
+
+    return -1;
+}
+
+/************************************************************************************/
+
+bool Ancestral_reconstruction::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_sequences,Model_factory *mf,int n_threads)
+{
+    if(root->is_leaf() || aligned_sequences->empty())
+        return false;
+
+    if(n_threads<1)
+        n_threads = 1;
+
+    /*
+     * States and the coding of the observed characters
+     */
+    n_states = mf->get_char_alphabet_size();
+    vector<string> *alphabet = mf->get_character_alphabet();
+    states.assign(alphabet->begin(),alphabet->begin()+n_states);
+    word_size = states.at(0).length();
+
+    for(int i=0;i<256;i++)
+        char_codes[i] = -1;
+    word_codes.clear();
+    ambiguities.clear();
+
+    if(word_size==1)
+    {
+        for(int i=0;i<n_states;i++)
+        {
+            char_codes[(unsigned char)states.at(i).at(0)] = i;
+            char_codes[(unsigned char)tolower(states.at(i).at(0))] = i;
+        }
+
+        vector<Char_symbol> *symbols = mf->get_char_symbols();
+        if(mf->get_sequence_data_type()!=Model_factory::dna)
+            symbols = 0;
+
+        for(int i=0;symbols!=0 && i<(int)symbols->size();i++)
+        {
+            Char_symbol *cs = &symbols->at(i);
+            if(cs->n_units<2 || cs->n_units>=n_states || char_codes[(unsigned char)cs->symbol]!=-1)
+                continue;
+
+            vector<float> amb(n_states,0);
+            for(int j=0;j<(int)cs->residues.size();j++)
+            {
+                size_t at = mf->get_char_alphabet().find(cs->residues.at(j));
+                if(at != string::npos)
+                    amb.at(at) = 1.0;
+            }
+            char_codes[(unsigned char)cs->symbol] = n_states+ambiguities.size();
+            char_codes[(unsigned char)tolower(cs->symbol)] = n_states+ambiguities.size();
+            ambiguities.push_back(amb);
+        }
+    }
+    else
+    {
+        for(int i=0;i<n_states;i++)
+            word_codes.insert(make_pair(states.at(i),i));
+    }
+
+    /*
+     * Tree in postorder, with the rows of the alignment
+     */
+    map<string,int> rows;
+    for(int i=0;i<(int)aligned_sequences->size();i++)
+        rows.insert(make_pair(aligned_sequences->at(i).name,i));
+
+    nodes.clear();
+    this->index_nodes(root,-1,&rows);
+
+    int n_nodes = nodes.size();
+    int length = aligned_sequences->at(0).sequence.length();
+
+    for(int k=0;k<n_nodes;k++)
+    {
+        int row = nodes.at(k).row;
+        if(nodes.at(k).left<0 && row<0)
+        {
+            Log_output::write_out("Ancestral_reconstruction: no sequence for a leaf node.\n",1);
+            return false;
+        }
+        if(row>=0 && (int)aligned_sequences->at(row).sequence.length()!=length)
+        {
+            Log_output::write_out("Ancestral_reconstruction: sequences of different length.\n",1);
+            return false;
+        }
+    }
+
+    int n_columns = length/word_size;
+
+    /*
+     * P matrices for the branches and the stationary frequencies
+     */
+    p_matrices.assign(n_nodes,vector<float>());
+    for(int k=0;k<n_nodes-1;k++)
+    {
+        vector<double> p;
+        double distance = nodes.at(k).distance;
+        if(distance<0)
+            distance = 0;
+        mf->substitution_probabilities(distance,&p);
+        p_matrices.at(k).assign(p.begin(),p.end());
+    }
+
+    vector<float> pi(n_states);
+    for(int i=0;i<n_states;i++)
+        pi.at(i) = mf->get_char_pi(i);
+
+    /*
+     * Leaf observations and writable ancestral rows
+     */
+    vector< vector<short> > codes(n_nodes);
+    vector<char*> ancestral(n_nodes,(char*)0);
+
+    for(int k=0;k<n_nodes;k++)
+    {
+        string *seq = &aligned_sequences->at(nodes.at(k).row >= 0 ? nodes.at(k).row : 0).sequence;
+
+        if(nodes.at(k).left<0)
+        {
+            codes.at(k).resize(n_columns);
+            for(int c=0;c<n_columns;c++)
+                codes.at(k).at(c) = this->character_code(&seq->at(c*word_size));
+        }
+        else if(nodes.at(k).row>=0 && length>0)
+        {
+            ancestral.at(k) = &(*seq)[0];
+        }
+    }
+
+    /*
+     * Column blocks: three partial likelihood vectors per node and column
+     */
+    size_t per_column = (size_t)3*n_nodes*n_states*sizeof(float);
+    int block = (32<<20)/per_column;
+    if(block>256)
+        block = 256;
+    if(block<1)
+        block = 1;
+
+    int n_blocks = (n_columns+block-1)/block;
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        vector<float> down((size_t)n_nodes*block*n_states);
+        vector<float> message((size_t)n_nodes*block*n_states);
+        vector<float> up((size_t)n_nodes*block*n_states);
+
+        #pragma omp for schedule(dynamic,1)
+        for(int b=0;b<n_blocks;b++)
+        {
+            int start = b*block;
+            int width = min(block,n_columns-start);
+
+            // Pruning: subtree likelihoods and the messages sent to the parents
+            for(int k=0;k<n_nodes;k++)
+            {
+                Tree_index &ti = nodes.at(k);
+
+                for(int c=0;c<width;c++)
+                {
+                    float *d = &down[((size_t)k*block+c)*n_states];
+
+                    if(ti.left<0)
+                    {
+                        int code = codes.at(k).at(start+c);
+                        if(code<0)
+                            for(int s=0;s<n_states;s++) d[s] = 1.0;
+                        else if(code<n_states)
+                        {
+                            for(int s=0;s<n_states;s++) d[s] = 0;
+                            d[code] = 1.0;
+                        }
+                        else
+                        {
+                            vector<float> &amb = ambiguities.at(code-n_states);
+                            for(int s=0;s<n_states;s++) d[s] = amb[s];
+                        }
+                    }
+                    else
+                    {
+                        float *ml = &message[((size_t)ti.left*block+c)*n_states];
+                        float *mr = &message[((size_t)ti.right*block+c)*n_states];
+                        float max = 0;
+                        for(int s=0;s<n_states;s++)
+                        {
+                            d[s] = ml[s]*mr[s];
+                            if(d[s]>max) max = d[s];
+                        }
+                        if(max>0)
+                            for(int s=0;s<n_states;s++) d[s] /= max;
+                    }
+
+                    if(ti.parent<0)
+                        continue;
+
+                    float *m = &message[((size_t)k*block+c)*n_states];
+                    const float *p = &p_matrices.at(k)[0];
+                    for(int i=0;i<n_states;i++)
+                    {
+                        float sum = 0;
+                        const float *pr = p+i*n_states;
+                        for(int j=0;j<n_states;j++)
+                            sum += pr[j]*d[j];
+                        m[i] = sum;
+                    }
+                }
+            }
+
+            // Top-down: likelihoods of the rest of the tree and the posteriors
+            for(int k=n_nodes-1;k>=0;k--)
+            {
+                Tree_index &ti = nodes.at(k);
+
+                for(int c=0;c<width;c++)
+                {
+                    float *u = &up[((size_t)k*block+c)*n_states];
+
+                    if(ti.parent<0)
+                    {
+                        for(int s=0;s<n_states;s++) u[s] = pi[s];
+                    }
+                    else
+                    {
+                        Tree_index &pt = nodes.at(ti.parent);
+                        int sibling = pt.left==k ? pt.right : pt.left;
+                        float *pu = &up[((size_t)ti.parent*block+c)*n_states];
+                        float *sm = &message[((size_t)sibling*block+c)*n_states];
+                        const float *p = &p_matrices.at(k)[0];
+
+                        for(int j=0;j<n_states;j++) u[j] = 0;
+                        for(int i=0;i<n_states;i++)
+                        {
+                            float w = pu[i]*sm[i];
+                            if(w==0)
+                                continue;
+                            const float *pr = p+i*n_states;
+                            for(int j=0;j<n_states;j++)
+                                u[j] += w*pr[j];
+                        }
+                        float max = 0;
+                        for(int s=0;s<n_states;s++)
+                            if(u[s]>max) max = u[s];
+                        if(max>0)
+                            for(int s=0;s<n_states;s++) u[s] /= max;
+                    }
+
+                    char *seq = ancestral.at(k);
+                    if(seq==0)
+                        continue;
+
+                    char *site = seq+(size_t)(start+c)*word_size;
+                    if(*site=='-' || *site=='.')
+                        continue;
+
+                    float *d = &down[((size_t)k*block+c)*n_states];
+                    int best = 0;
+                    float best_p = -1;
+                    for(int s=0;s<n_states;s++)
+                    {
+                        float post = d[s]*u[s];
+                        if(post>best_p)
+                        {
+                            best_p = post;
+                            best = s;
+                        }
+                    }
+                    for(int w=0;w<word_size;w++)
+                        site[w] = states.at(best).at(w);
+                }
+            }
+        }
+    }
+
+    /*
+     * As after bppancestor, the root copies the closer child where both
+     * children have a residue and the other child where only one has
+     */
+    Tree_index &rt = nodes.at(n_nodes-1);
+    int left_row = nodes.at(rt.left).row;
+    int right_row = nodes.at(rt.right).row;
+
+    if(rt.row>=0 && left_row>=0 && right_row>=0)
+    {
+        bool copy_left = nodes.at(rt.left).distance < nodes.at(rt.right).distance;
+
+        string &root_seq = aligned_sequences->at(rt.row).sequence;
+        const string &left_seq = aligned_sequences->at(left_row).sequence;
+        const string &right_seq = aligned_sequences->at(right_row).sequence;
+
+        for(int i=0;i<(int)root_seq.length();i++)
+        {
+            bool left_gap  = left_seq.at(i)=='-'  || left_seq.at(i)=='.';
+            bool right_gap = right_seq.at(i)=='-' || right_seq.at(i)=='.';
+
+            if(left_gap && right_gap)
+                ;
+            else if(left_gap && !right_gap)
+                root_seq.at(i) = right_seq.at(i);
+            else if(!left_gap && right_gap)
+                root_seq.at(i) = left_seq.at(i);
+            else if(copy_left)
+                root_seq.at(i) = left_seq.at(i);
+            else
+                root_seq.at(i) = right_seq.at(i);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef ANCESTRAL_RECONSTRUCTION_H
+#define ANCESTRAL_RECONSTRUCTION_H
+
+/*
+ * Marginal ML reconstruction of the ancestral sequences. Felsenstein's
+ * pruning gives the subtree likelihoods and a second, top-down pass the
+ * likelihoods of the rest of the tree; their product is the posterior at
+ * each internal node. Gaps are treated as missing data and only the
+ * non-gap sites of the ancestral rows are replaced. Columns are processed
+ * in blocks that are divided between the threads. The root row is then
+ * filled from its children, as was done after bppancestor.
+ */
+
+#include "utils/fasta_entry.h"
+#include "utils/model_factory.h"
+#include "main/node.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace ppa
+{
+
+class Ancestral_reconstruction
+{
+    struct Tree_index
+    {
+        int left;
+        int right;
+        int parent;
+        int row;
+        double distance;
+    };
+
+    vector<Tree_index> nodes;        // postorder, root last
+    vector< vector<float> > p_matrices;
+
+    int n_states;
+    int word_size;
+    vector<string> states;
+    vector< vector<float> > ambiguities;
+
+    void index_nodes(Node *node,int parent,map<string,int> *rows);
+    int character_code(const char *c) const;
+
+    int char_codes[256];
+    map<string,int> word_codes;
+
+public:
+    Ancestral_reconstruction();
+    bool infer_ancestors(Node *root,vector<Fasta_entry> *aligned_sequences,Model_factory *mf,int n_threads);
+};
+}
+
+#endif // ANCESTRAL_RECONSTRUCTION_H
@@ -98,42 +98,9 @@ bool BppAncestors::test_executable()
 bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_sequences,bool isCodon)
 {
 
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream f_name;
-    stringstream t_name;
-    stringstream o_name;
-
-    int r = rand();
-    while(true)
-    {
-
-        f_name.str("");
-        t_name.str("");
-        o_name.str("");
-
-        f_name <<tmp_dir<<"f"<<r<<".fas";
-        ifstream f_file(f_name.str().c_str());
-
-        t_name <<tmp_dir<<"t"<<r<<".tre";
-        ifstream t_file(t_name.str().c_str());
-
-        o_name <<tmp_dir<<"o"<<r<<".fas";
-        ifstream o_file(t_name.str().c_str());
-
-        if(!f_file && !t_file && !o_file)
-        {
-            ofstream f_tmp;
-            f_tmp.open(f_name.str().c_str(), (ios::out) );
-            ofstream t_tmp;
-            t_tmp.open(t_name.str().c_str(), (ios::out) );
-            ofstream o_tmp;
-            o_tmp.open(o_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        r = rand();
-    }
+    Subprocess_file f_file("f",".fas");
+    Subprocess_file t_file("t",".tre");
+    Subprocess_file o_file("o",".fas");
 
 
     ////////////
@@ -142,8 +109,7 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
     bool isDna = root->get_sequence()->get_data_type() == Model_factory::dna;
 
 
-    ofstream f_output;
-    f_output.open( f_name.str().c_str(), (ios::out) );
+    stringstream f_output;
 
     int count = 0;
     map<string,string> tmp_names;
@@ -165,7 +131,7 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
         else
             f_output<<">"<<name.str()<<"\n"<<si->sequence<<"\n";
     }
-    f_output.close();
+    f_file.write(f_output.str());
 
 
     int add = root->get_number_of_leaves();
@@ -178,18 +144,15 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
             tree.replace(pos, it->first.length(), it->second);
     }
 
-    ofstream t_output;
-    t_output.open( t_name.str().c_str(), (ios::out) );
-    t_output<<tree<<endl;
-    t_output.close();
+    t_file.write(tree+"\n");
 
 
     ////////////
 
 
     stringstream command;
-    command << bppdistpath<<"bppancestor input.sequence.file="<<f_name.str()<<" input.sequence.format=Fasta input.sequence.sites_to_use=all input.tree.file="<<t_name.str()<<
-            " input.tree.format=NHX input.sequence.max_gap_allowed=100% initFreqs=observed output.sequence.file="<<o_name.str()<<" output.sequence.format=Phylip";
+    command << bppdistpath<<"bppancestor input.sequence.file="<<f_file.get_path()<<" input.sequence.format=Fasta input.sequence.sites_to_use=all input.tree.file="<<t_file.get_path()<<
+            " input.tree.format=NHX input.sequence.max_gap_allowed=100% initFreqs=observed output.sequence.file="<<o_file.get_path()<<" output.sequence.format=Phylip";
 
     if(isCodon)
     {
@@ -208,26 +171,24 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
         }
     }
 
-    command << " 2>&1";
-
     Log_output::write_out("BppAncestors: command: "+command.str()+"\n",2);
 
 
     try {
 
-        FILE *fpipe;
-        char line[256];
+        string output, errors;
+        int status = Subprocess::run(command.str(),0,&output,&errors);
 
-        if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-        {
-            Log_output::write_out("Problems with bppancestor pipe.\nExiting.\n",0);
-            exit(1);
-        }
-        while ( fgets( line, sizeof line, fpipe))
+        vector<string> lines;
+        Subprocess::split_lines(output+errors,&lines);
+        for(int i=0;i<(int)lines.size();i++)
+            Log_output::write_out("BppAncestors: "+lines.at(i),3);
+
+        if(status != 0)
         {
-            Log_output::write_out("BppAncestors: "+string(line),3);
+            Log_output::write_out("BppAncestors: bppancestor returned exit status "+Log_output::itos(status)+".\n",1);
+            throw IOException("BppAncestors: bppancestor failed");
         }
-        pclose(fpipe);
 
 
         ////////////
@@ -237,7 +198,10 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
 
         Fasta_reader fr;
 
-        fr.read_bpp_phylip(o_name.str().c_str(),&bppa_sequences);
+        string contents;
+        o_file.read(&contents);
+        istringstream o_input(contents);
+        fr.read_bpp_phylip(o_input,&bppa_sequences);
 
         si = aligned_sequences->begin();
         for(;si!=aligned_sequences->end();si++)
@@ -257,16 +221,9 @@ bool BppAncestors::infer_ancestors(Node *root,vector<Fasta_entry> *aligned_seque
     {
         Log_output::write_out("\nReconstructing ML ancestral sequences failed. Outputting parsimony ancestors.\n\n",0);
 
-        if(!Settings_handle::st.is("keep-temp-files"))
-            this->delete_files(r);
-
         return false;
     }
 
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
-
-
     ////////////
 
 
@@ -468,26 +425,3 @@ void BppAncestors::count_events(Node *root,vector<Fasta_entry> *aligned_sequence
     }
 
 }
-
-void BppAncestors::delete_files(int r)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream t_name;
-    t_name <<tmp_dir<<"t"<<r<<".tre";
-
-    stringstream f_name;
-    f_name <<tmp_dir<<"f"<<r<<".fas";
-
-    stringstream o_name;
-    o_name <<tmp_dir<<"o"<<r<<".fas";
-
-    if ( remove( t_name.str().c_str() ) != 0 )
-        perror( "Error deleting file" );
-    if ( remove( f_name.str().c_str() ) != 0 )
-        perror( "Error deleting file");
-    if ( remove( o_name.str().c_str() ) != 0 )
-        perror( "Error deleting file");
-
-}
@@ -24,8 +24,7 @@
 #include "utils/fasta_entry.h"
 #include "main/node.h"
 #include "utils/settings_handle.h"
-
-#include <sys/stat.h>
+#include "utils/subprocess.h"
 
 namespace ppa
 {
@@ -34,22 +33,6 @@ class BppAncestors
 {
     std::string bppdistpath;
 
-    std::string get_temp_dir()
-    {
-        std::string tmp_dir = "/tmp/";
-
-        if(Settings_handle::st.is("temp-folder"))
-            tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
-
-        struct stat st;
-        if(stat(tmp_dir.c_str(),&st) != 0)
-            tmp_dir = "";
-
-        return tmp_dir;
-    }
-
-    void delete_files(int r);
-
 public:
     BppAncestors();
     bool test_executable();
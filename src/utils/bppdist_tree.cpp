@@ -88,219 +88,50 @@ bool BppDist_tree::test_executable()
 
 string BppDist_tree::infer_phylogeny(std::vector<Fasta_entry> *sequences,bool is_protein,int n_threads)
 {
+    Subprocess_file f_file("d",".fas");
+    Subprocess_file t_file("d",".tre");
 
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream f_name;
-    stringstream t_name;
-
-    int r = rand();
-    while(true)
-    {
-
-        f_name <<tmp_dir<<"d"<<r<<".fas";
-        ifstream f_file(f_name.str().c_str());
-
-        t_name <<tmp_dir<<"d"<<r<<".tre";
-        ifstream t_file(t_name.str().c_str());
-
-        if(!f_file && !t_file)
-        {
-            break;
-        }
-        r = rand();
-    }
-
-
-    stringstream command;
-    command << bppdistpath<<"bppdist method=bionj output.tree.file="<<t_name.str()<<" output.matrix.file=none input.sequence.file="<<f_name.str()<<" input.sequence.format=Fasta "
-               "input.sequence.sites_to_use=all optimization.method=init optimization.verbose=0 input.sequence.max_gap_allowed=100 initFreqs=observed ";
-    if(is_protein)
-        command << "alphabet=Protein model=WAG01";
-    else
-        command << "alphabet=DNA model=HKY85";
-
-//    command << " > bppdist.log";
-
-    Log_output::write_out("BppDist_tree: command: "+command.str()+"\n",2);
-
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with bppdist pipe.\nExiting.\n",0);
-        exit(1);
-    }
-
-    ofstream f_output;
-    f_output.open( f_name.str().c_str(), (ios::out) );
-
+    stringstream f_output;
     vector<Fasta_entry>::iterator si = sequences->begin();
     for(;si!=sequences->end();si++)
     {
         f_output<<">"<<si->name<<"\n"<<si->sequence<<"\n";
     }
-    f_output.close();
-
-    char line[256];
-
-    while ( fgets( line, sizeof line, fpipe))
-    {
-        Log_output::write_out("BppDist: "+string(line),2);
-    }
-    pclose(fpipe);
-
-    ifstream input(t_name.str().c_str(), ios::in);
-    string temp,tree = "";
-
-    while(!input.eof())
+    if(!f_file.write(f_output.str()))
     {
-        getline(input, temp, '\n');
-        tree += temp;
-    }
-    input.close();
-
-
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
-
-    return tree;
-}
-
-
-string BppDist_tree::infer_phylogeny_fifo(std::vector<Fasta_entry> *sequences,bool is_protein,int n_threads)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream f_name;
-    stringstream t_name;
-
-    int r = rand();
-    while(true)
-    {
-        f_name <<tmp_dir<<"d"<<r<<".fas";
-        ifstream f_file(f_name.str().c_str());
-
-        t_name <<tmp_dir<<"d"<<r<<".tre";
-        ifstream t_file(t_name.str().c_str());
-
-        if(!f_file && !t_file)
-        {
-            break;
-        }
-        r = rand();
+        Log_output::write_out("Problems writing bppdist input.\nExiting.\n",0);
+        exit(1);
     }
 
-
     stringstream command;
-    command << bppdistpath<<"bppdist method=bionj output.tree.file="<<t_name.str()<<" output.matrix.file=none input.sequence.file="<<f_name.str()<<" input.sequence.format=Fasta "
+    command << bppdistpath<<"bppdist method=bionj output.tree.file="<<t_file.get_path()<<" output.matrix.file=none input.sequence.file="<<f_file.get_path()<<" input.sequence.format=Fasta "
                "input.sequence.sites_to_use=all optimization.method=init optimization.verbose=0 input.sequence.max_gap_allowed=100 initFreqs=observed ";
     if(is_protein)
         command << "alphabet=Protein model=WAG01";
     else
         command << "alphabet=DNA model=HKY85";
 
-//    command << " > bppdist.log";
-
     Log_output::write_out("BppDist_tree: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with bppdist pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    string output, errors;
+    int status = Subprocess::run(command.str(),0,&output,&errors);
 
-    int rv = mkfifo (f_name.str().c_str(), S_IRUSR| S_IWUSR);
-    if (rv < 0) {
-        Log_output::write_out("Problems with biodist fifo.\nExiting.\n",0);
-        exit(1);
-    }
+    vector<string> lines;
+    Subprocess::split_lines(output+errors,&lines);
+    for(int i=0;i<(int)lines.size();i++)
+        Log_output::write_out("BppDist: "+lines.at(i),2);
 
-    rv = mkfifo (t_name.str().c_str(), S_IRUSR| S_IWUSR);
-    if (rv < 0) {
-        Log_output::write_out("Problems with biodist fifo.\nExiting.\n",0);
-        exit(1);
-    }
+    if(status != 0)
+        Log_output::write_out("BppDist_tree: bppdist returned exit status "+Log_output::itos(status)+".\n",1);
 
-    FILE *ffifo;
-    if((ffifo = fopen(f_name.str().c_str(), "w")) == NULL)
-    {
-        Log_output::write_out("Problems with biodist fifo.\nExiting.\n",0);
-        exit(1);
-    }
+    string contents,tree = "";
+    t_file.read(&contents);
 
-    vector<Fasta_entry>::iterator si = sequences->begin();
-    for(;si!=sequences->end();si++)
+    for(int i=0;i<(int)contents.length();i++)
     {
-        fprintf(ffifo,">%s\n%s\n",si->name.c_str(),si->sequence.c_str());
+        if(contents.at(i)!='\n' && contents.at(i)!='\r')
+            tree += contents.at(i);
     }
 
-
-    fclose(ffifo);
-
-    cout<<"fasta closed\n";
-
-    FILE *tfifo;
-    if((tfifo = fopen(t_name.str().c_str(), "r")) == NULL)
-    {
-        Log_output::write_out("Problems with biodist fifo.\nExiting.\n",0);
-        exit(1);
-    }
-
-    cout<<"tree opened\n";
-
-    char line[5000];
-    string tree = "";
-
-    while ( fgets( line, sizeof line, tfifo))
-    {
-        cout<<line<<endl;
-        tree += string(line);
-    }
-
-//    ifstream input(t_name.str().c_str(), ios::in);
-//    string temp,tree = "";
-
-//    while(!input.eof())
-//    {
-//        getline(input, temp, '\n');
-//        tree += temp;
-//    }
-//    input.close();
-
-
-    fclose(tfifo);
-
-    cout<<"tree closed\n";
-
-    while ( fgets( line, sizeof line, fpipe))
-    {
-        Log_output::write_out("BppDist: "+string(line),2);
-    }
-    pclose(fpipe);
-
-
-    this->delete_files(r);
-
     return tree;
 }
-
-void BppDist_tree::delete_files(int r)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream f_name;
-    f_name <<tmp_dir<<"d"<<r<<".fas";
-
-    if ( remove( f_name.str().c_str() ) != 0 )
-        Log_output::write_out( "Error deleting file", 1);
-
-    stringstream t_name;
-    t_name <<tmp_dir<<"d"<<r<<".tre";
-
-    if ( remove( t_name.str().c_str() ) != 0 )
-        Log_output::write_out( "Error deleting file", 1);
-
-}
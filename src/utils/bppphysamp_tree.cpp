@@ -102,7 +102,7 @@ void BppPhySamp_tree::reduce_sequences(set<string> *toremove,bool is_protein)
     {
         // Copy fasta file
         //
-        string tmpseqfile = seqfile+".clean";
+        Subprocess_file seq_file("physamp",".fas");
         try
         {
             Fasta_reader fr;
@@ -114,13 +114,16 @@ void BppPhySamp_tree::reduce_sequences(set<string> *toremove,bool is_protein)
 
             for(int i=0;i<(int)sequences.size();i++)
                 sequences.at(i).comment="";
-            fr.write(tmpseqfile,sequences,"fasta");
+
+            stringstream seq_output;
+            fr.write(seq_output,sequences,"fasta");
+            if(!seq_file.write(seq_output.str()))
+                throw IOException("BppPhySamp_tree: failed to write sequences");
         }
         catch (ppa::IOException& e) {
-            Log_output::write_out("Error writing a temporary sequence file for BppPhySamp: '"+seqfile+"' or '"+tmpseqfile+"' fails.\nExiting.\n\n",0);
+            Log_output::write_out("Error writing a temporary sequence file for BppPhySamp: '"+seqfile+"' fails.\nExiting.\n\n",0);
             exit(1);
         }
-        tmpseqfile.append(".fas");
 
         // Copy newick file
         //
@@ -144,13 +147,12 @@ void BppPhySamp_tree::reduce_sequences(set<string> *toremove,bool is_protein)
             tree = tn.get_rooted_tree(tree);
             tmp_root = nr.parenthesis_to_tree(tree);
         }
-        string tmptreefile = treefile+".clean";
-        tmp_root->write_nhx_tree(tmptreefile,"tre");
-        tmptreefile.append(".tre");
+        Subprocess_file tree_file("physamp",".tre");
+        tree_file.write(tmp_root->print_nhx_tree()+"\n");
         //
 
         stringstream command;
-        command << bppdistpath<<"bppphysamp input.tree.file="<<tmptreefile<<" input.sequence.file="<<tmpseqfile<<" input.method=tree "
+        command << bppdistpath<<"bppphysamp input.tree.file="<<tree_file.get_path()<<" input.sequence.file="<<seq_file.get_path()<<" input.method=tree "
                    << " input.sequence.format=Fasta input.tree.format=Newick choice_criterion=length output.sequence.format=Fasta ";
 
         if(is_protein)
@@ -172,20 +174,20 @@ void BppPhySamp_tree::reduce_sequences(set<string> *toremove,bool is_protein)
         Log_output::write_out("BppPhySamp_tree: command: "+command.str()+"\n",2);
 
 //        cout<<endl<<command.str()<<endl;
-        FILE *fpipe;
-        if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-        {
-            Log_output::write_out("Problems with bppphysamp pipe.\n",0);
-            return;
-        }
+        string output;
+        int status = Subprocess::run(command.str(),0,&output);
 
-        char line[256];
+        if(status != 0)
+            Log_output::write_out("BppPhySamp_tree: bppphysamp returned exit status "+Log_output::itos(status)+".\n",1);
 
-        while ( fgets( line, sizeof line, fpipe))
+        vector<string> lines;
+        Subprocess::split_lines(output,&lines);
+
+        for(int i=0;i<(int)lines.size();i++)
         {
-            Log_output::write_out("BppPhySamp: "+string(line),2);
+            Log_output::write_out("BppPhySamp: "+lines.at(i),2);
 
-            string linestr = string(line);
+            string linestr = lines.at(i);
             if(linestr.find("Remove sequence") != string::npos)
             {
                 linestr = linestr.substr(linestr.find(":")+2);
@@ -193,35 +195,9 @@ void BppPhySamp_tree::reduce_sequences(set<string> *toremove,bool is_protein)
                 toremove->insert(linestr);
             }
         }
-        pclose(fpipe);
-
-        if( remove( tmpseqfile.c_str() ) != 0 )
-           Log_output::write_out( "Error deleting file", 1);
-        if( remove( tmptreefile.c_str() ) != 0 )
-           Log_output::write_out( "Error deleting file", 1);
     }
 }
 
 // bppphysamp input.tree.file=reference_tree2.nhx input.sequence.file=reference_codon.fas input.method=tree sample_size=12 output.sequence.file=samples.fas alphabet=DNA deletion_method=sample input.sequence.format=Fasta input.tree.format=Newick choice_criterion=length output.sequence.format=Fasta
 
 // bppphysamp input.tree.file=reference_tree2.nhx input.sequence.file=reference_codon.fas input.method=tree output.sequence.file=samples.fas alphabet=DNA deletion_method=threshold threshold=0.3 input.sequence.format=Fasta input.tree.format=Newick choice_criterion=length output.sequence.format=Fasta
-
-
-void BppPhySamp_tree::delete_files(int r)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream f_name;
-    f_name <<tmp_dir<<"d"<<r<<".fas";
-
-    if ( remove( f_name.str().c_str() ) != 0 )
-        Log_output::write_out( "Error deleting file", 1);
-
-    stringstream t_name;
-    t_name <<tmp_dir<<"d"<<r<<".tre";
-
-    if ( remove( t_name.str().c_str() ) != 0 )
-        Log_output::write_out( "Error deleting file", 1);
-
-}
@@ -23,10 +23,10 @@
 
 #include "utils/settings_handle.h"
 #include "utils/fasta_entry.h"
+#include "utils/subprocess.h"
 #include <fstream>
 #include <string>
 #include <set>
-#include <sys/stat.h>
 
 using namespace std;
 
@@ -36,22 +36,6 @@ class BppPhySamp_tree
 {
     string bppdistpath;
 
-    std::string get_temp_dir()
-    {
-        std::string tmp_dir = "/tmp/";
-
-        if(Settings_handle::st.is("temp-folder"))
-            tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
-
-        struct stat st;
-        if(stat(tmp_dir.c_str(),&st) != 0)
-            tmp_dir = "";
-
-        return tmp_dir;
-    }
-
-    void delete_files(int r);
-
 public:
     BppPhySamp_tree();
     bool test_executable();
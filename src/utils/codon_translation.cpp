@@ -83,14 +83,28 @@ void Codon_translation::define_translation_tables()
     {
         codon_to_aa.insert(make_pair(cod[i],aa[i]));
     }
+
+    frame_translation.index_codons(codon_to_aa);
 }
 
 string Codon_translation::gapped_DNA_to_protein(string *sequence) const
 {
     string prot;
+    prot.reserve(sequence->length()/3+1);
 
     for (unsigned int j=0; j<sequence->length(); j+=3)
     {
+        // plain codons from the table, ambiguous and gapped ones from the map
+        char aa = 0;
+        if(j+3 <= sequence->length())
+            aa = frame_translation.translate_codon(sequence->data()+j);
+
+        if(aa != 0)
+        {
+            prot += aa;
+            continue;
+        }
+
         string codon = sequence->substr(j,3);
         if (codon_to_aa.find(codon) == codon_to_aa.end())
         {
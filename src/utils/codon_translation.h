@@ -23,12 +23,14 @@
 
 #include <string>
 #include <map>
+#include "utils/frame_translation.h"
 
 namespace ppa {
 
 class Codon_translation
 {
     std::map<std::string,std::string> codon_to_aa;
+    Frame_translation frame_translation;
 
 public:
     Codon_translation();
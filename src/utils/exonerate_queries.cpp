@@ -37,12 +37,31 @@
 using namespace std;
 using namespace ppa;
 
+int Exonerate_queries::executable_found = -1;
+string Exonerate_queries::executable_path = "";
+
 Exonerate_queries::Exonerate_queries()
 {
 
 }
 
 bool Exonerate_queries::test_executable()
+{
+    // the probe runs the shell a few times and is called for every query
+    #pragma omp critical(exonerate_probe)
+    {
+        if(executable_found < 0)
+        {
+            executable_found = this->probe_executable() ? 1 : 0;
+            executable_path = exoneratepath;
+        }
+    }
+
+    exoneratepath = executable_path;
+    return executable_found == 1;
+}
+
+bool Exonerate_queries::probe_executable()
 {
 
     int status = -1;
@@ -150,171 +169,75 @@ bool Exonerate_queries::split_vulgar_string(const string& row,hit *h)
 }
 
 
-void Exonerate_queries::write_exonerate_input(string *str1, string *str2, int *r)
+bool Exonerate_queries::write_exonerate_input(string *str1, string *str2, Subprocess_file *q_file, Subprocess_file *t_file)
 {
     // create exonerate input
     //
-    ofstream q_output;
-    ofstream t_output;
-
-    while(true)
-    {
-
-        stringstream q_name;
-        stringstream t_name;
-
-        string tmp_dir = this->get_temp_dir();
-
-        q_name <<tmp_dir<<"q"<<*r<<".fas";
-        t_name <<tmp_dir<<"t"<<*r<<".fas";
-
-        ifstream q_file(q_name.str().c_str());
-        ifstream t_file(t_name.str().c_str());
-
-        if(!q_file && !t_file)
-        {
-            q_output.open( q_name.str().c_str(), (ios::out) );
-            t_output.open( t_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        *r = rand();
-    }
+    stringstream q_output;
+    stringstream t_output;
 
     t_output<<">t\n"<<*str2<<endl;
-    t_output.close();
+    bool t_file_written = t_file->write(t_output.str());
 
     q_output<<">q\n"<<*str1<<endl;
-    q_output.close();
+    bool q_file_written = q_file->write(q_output.str());
 
-    return;
+    return q_file_written && t_file_written;
 }
 
-void Exonerate_queries::write_exonerate_input(map<string,string> *target_sequences, vector<Fasta_entry> *reads, int *r)
+bool Exonerate_queries::write_exonerate_input(map<string,string> *target_sequences, vector<Fasta_entry> *reads, Subprocess_file *q_file, Subprocess_file *t_file)
 {
 
     // create exonerate input
     //
-    ofstream q_output;
-    ofstream t_output;
-
-    while(true)
-    {
-
-        stringstream q_name;
-        stringstream t_name;
-
-        string tmp_dir = this->get_temp_dir();
-
-        q_name <<tmp_dir<<"q"<<*r<<".fas";
-        t_name <<tmp_dir<<"t"<<*r<<".fas";
-
-        ifstream q_file(q_name.str().c_str());
-        ifstream t_file(t_name.str().c_str());
-
-        if(!q_file && !t_file)
-        {
-            q_output.open( q_name.str().c_str(), (ios::out) );
-            t_output.open( t_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        *r = rand();
-    }
+    stringstream q_output;
+    stringstream t_output;
 
     vector<Fasta_entry>::iterator it = reads->begin();
     for(;it!=reads->end();it++)
         q_output<<">"<<it->name<<endl<<it->sequence<<endl;
 
-    q_output.close();
+    bool q_file_written = q_file->write(q_output.str());
 
 
     map<string,string>::iterator it2 = target_sequences->begin();
     for(;it2!=target_sequences->end();it2++)
         t_output<<">"<<it2->first<<endl<<it2->second<<endl;
 
-    t_output.close();
+    bool t_file_written = t_file->write(t_output.str());
 
-    return;
+    return q_file_written && t_file_written;
 }
 
-void Exonerate_queries::write_exonerate_input(map<string,string> *target_sequences, Fasta_entry *read, int *r)
+bool Exonerate_queries::write_exonerate_input(map<string,string> *target_sequences, Fasta_entry *read, Subprocess_file *q_file, Subprocess_file *t_file)
 {
 
     // create exonerate input
     //
-    ofstream q_output;
-    ofstream t_output;
-
-    while(true)
-    {
-
-        stringstream q_name;
-        stringstream t_name;
-
-        string tmp_dir = this->get_temp_dir();
-
-        q_name <<tmp_dir<<"q"<<*r<<".fas";
-        t_name <<tmp_dir<<"t"<<*r<<".fas";
-
-        ifstream q_file(q_name.str().c_str());
-        ifstream t_file(t_name.str().c_str());
-
-        if(!q_file && !t_file)
-        {
-            q_output.open( q_name.str().c_str(), (ios::out) );
-            t_output.open( t_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        *r = rand();
-    }
+    stringstream q_output;
+    stringstream t_output;
 
     q_output<<">"<<read->name<<endl<<read->sequence<<endl;
 
-    q_output.close();
+    bool q_file_written = q_file->write(q_output.str());
 
 
     map<string,string>::iterator it2 = target_sequences->begin();
     for(;it2!=target_sequences->end();it2++)
         t_output<<">"<<it2->first<<endl<<it2->second<<endl;
 
-    t_output.close();
+    bool t_file_written = t_file->write(t_output.str());
 
-    return;
+    return q_file_written && t_file_written;
 }
 
-void Exonerate_queries::write_exonerate_input(Node *root, vector<Fasta_entry> *reads, map<string,string> *names, int *r)
+bool Exonerate_queries::write_exonerate_input(Node *root, vector<Fasta_entry> *reads, map<string,string> *names, Subprocess_file *q_file, Subprocess_file *t_file)
 {
 
     // create exonerate input
     //
-    ofstream q_output;
-    ofstream t_output;
-
-    while(true)
-    {
-
-        stringstream q_name;
-        stringstream t_name;
-
-        string tmp_dir = this->get_temp_dir();
-
-        q_name <<tmp_dir<<"q"<<*r<<".fas";
-        t_name <<tmp_dir<<"t"<<*r<<".fas";
-
-        ifstream q_file(q_name.str().c_str());
-        ifstream t_file(t_name.str().c_str());
-
-        if(!q_file && !t_file)
-        {
-            q_output.open( q_name.str().c_str(), (ios::out) );
-            t_output.open( t_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        *r = rand();
-    }
+    stringstream q_output;
+    stringstream t_output;
 
     vector<Fasta_entry>::iterator it = reads->begin();
     for(;it!=reads->end();it++)
@@ -324,7 +247,7 @@ void Exonerate_queries::write_exonerate_input(Node *root, vector<Fasta_entry> *r
         else
             q_output<<">"<<it->name<<endl<<it->sequence<<endl;
     }
-    q_output.close();
+    bool q_file_written = q_file->write(q_output.str());
 
 
     map<string,string*> unaligned_seqs;
@@ -342,48 +265,24 @@ void Exonerate_queries::write_exonerate_input(Node *root, vector<Fasta_entry> *r
             t_output<<">"<<it2->first<<endl<<*(it2->second)<<endl;
         }
     }
-    t_output.close();
+    bool t_file_written = t_file->write(t_output.str());
 
-    return;
+    return q_file_written && t_file_written;
 }
 
-void Exonerate_queries::write_exonerate_input(Node *root, Fasta_entry *read, map<string,string> *names, int *r)
+bool Exonerate_queries::write_exonerate_input(Node *root, Fasta_entry *read, map<string,string> *names, Subprocess_file *q_file, Subprocess_file *t_file)
 {
 
     // create exonerate input
     //
-    ofstream q_output;
-    ofstream t_output;
-
-    while(true)
-    {
-
-        stringstream q_name;
-        stringstream t_name;
-
-        string tmp_dir = this->get_temp_dir();
-
-        q_name <<tmp_dir<<"q"<<*r<<".fas";
-        t_name <<tmp_dir<<"t"<<*r<<".fas";
-
-        ifstream q_file(q_name.str().c_str());
-        ifstream t_file(t_name.str().c_str());
-
-        if(!q_file && !t_file)
-        {
-            q_output.open( q_name.str().c_str(), (ios::out) );
-            t_output.open( t_name.str().c_str(), (ios::out) );
-
-            break;
-        }
-        *r = rand();
-    }
+    stringstream q_output;
+    stringstream t_output;
 
     if(Settings_handle::st.is("score-as-dna") && read->dna_sequence.length()>0)
         q_output<<">"<<read->name<<endl<<read->dna_sequence<<endl;
     else
         q_output<<">"<<read->name<<endl<<read->sequence<<endl;
-    q_output.close();
+    bool q_file_written = q_file->write(q_output.str());
 
 
     if(Settings_handle::st.is("score-as-dna"))
@@ -429,9 +328,9 @@ void Exonerate_queries::write_exonerate_input(Node *root, Fasta_entry *read, map
             }
         }
     }
-    t_output.close();
+    bool t_file_written = t_file->write(t_output.str());
 
-    return;
+    return q_file_written && t_file_written;
 }
 
 
@@ -439,10 +338,10 @@ void Exonerate_queries::preselect_targets(map<string,string> *target_sequences,
 {
     Log_output::append_msg(" preselecting targets with Exonerate.",0);
 
-    int r = rand();
-    string tmp_dir = this->get_temp_dir();
+    Subprocess_file q_file("q",".fas");
+    Subprocess_file t_file("t",".fas");
 
-    this->write_exonerate_input(target_sequences,reads,&r);
+    bool input_written = this->write_exonerate_input(target_sequences,reads,&q_file,&t_file);
 
 
     string data_type = "-T protein -Q protein";
@@ -452,27 +351,25 @@ void Exonerate_queries::preselect_targets(map<string,string> *target_sequences,
     // exonerate command for local alignment
 
     stringstream command;
-    command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no "<<data_type<<" 2>&1";
+    command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no "<<data_type;
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with exonerate pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    vector<string> lines;
+    if(input_written)
+        this->run_exonerate(command.str(),&lines);
+    else
+        Log_output::write_out("Exonerate_queries: failed to write the exonerate input; no hits.\n",1);
 
     Log_output::write_out("Exonerate_queries: command: "+command.str()+"\n",2);
 
     // read exonerate output, summing the multiple hit scores
 
-    char line[256];
     map<string,multimap<string,hit> > all_hits;
 
-    while ( fgets( line, sizeof line, fpipe))
+    for(int li=0;li<(int)lines.size();li++)
     {
+        const string &line = lines.at(li);
         this->read_output_line(&all_hits,line);
     }
-    pclose(fpipe);
 
 
     this->find_hits_for_queries(&all_hits, reads, best_hits);
@@ -505,7 +402,7 @@ void Exonerate_queries::preselect_targets(map<string,string> *target_sequences,
 void Exonerate_queries::read_output_line(map<string,multimap<string,hit> > *all_hits, string line)
 {
     hit h;
-    bool valid = this->split_sugar_string(string(line),&h);
+    bool valid = this->split_sugar_string(line,&h);
 
     if(valid)
     {
@@ -660,11 +557,11 @@ void Exonerate_queries::local_alignment(map<string,string> *target_sequences, Fa
     else
         Log_output::append_msg(" running Exonerate with one query sequence (gapped).",0);
 
-    int r = rand();
-    string tmp_dir = this->get_temp_dir();
+    Subprocess_file q_file("q",".fas");
+    Subprocess_file t_file("t",".fas");
 
 
-    this->write_exonerate_input(target_sequences,read,&r);
+    bool input_written = this->write_exonerate_input(target_sequences,read,&q_file,&t_file);
 
     // exonerate command for local alignment
 
@@ -674,29 +571,28 @@ void Exonerate_queries::local_alignment(map<string,string> *target_sequences, Fa
 
     stringstream command;
     if(is_local)
-        command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no "<<data_type<<" 2>&1";
+        command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no "<<data_type;
     else
-        command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no -m affine:local "<<data_type<<" 2>&1";
+        command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no -m affine:local "<<data_type;
 
     Log_output::write_out("Exonerate_local: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with exonerate pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    vector<string> lines;
+    if(input_written)
+        this->run_exonerate(command.str(),&lines);
+    else
+        Log_output::write_out("Exonerate_queries: failed to write the exonerate input; no hits.\n",1);
 
     // read exonerate output, summing the multiple hit scores
 
-    char line[256];
     map<string,hit> all_hits;
     vector<string> hit_names;
 
-    while ( fgets( line, sizeof line, fpipe))
+    for(int li=0;li<(int)lines.size();li++)
     {
+        const string &line = lines.at(li);
         hit h;
-        bool valid = split_sugar_string(string(line),&h);
+        bool valid = split_sugar_string(line,&h);
 
         if(valid)
         {
@@ -728,7 +624,6 @@ void Exonerate_queries::local_alignment(map<string,string> *target_sequences, Fa
             }
         }
     }
-    pclose(fpipe);
 
 
     Log_output::write_out("Exonerate_reads: "+read->name+" has "+Log_output::itos(hit_names.size())+" hits\n",2);
@@ -805,8 +700,6 @@ void Exonerate_queries::local_alignment(map<string,string> *target_sequences, Fa
         read->node_to_align = "discarded_read";
     }
 
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
 
 }
 
@@ -817,8 +710,8 @@ void Exonerate_queries::local_alignment(Node *root, Fasta_entry *read, multimap<
     else
         Log_output::append_msg(" running Exonerate with one query sequence (gapped).",0);
 
-    int r = rand();
-    string tmp_dir = this->get_temp_dir();
+    Subprocess_file q_file("q",".fas");
+    Subprocess_file t_file("t",".fas");
 
 
     map<string,string> names;
@@ -838,7 +731,7 @@ void Exonerate_queries::local_alignment(Node *root, Fasta_entry *read, multimap<
         }
     }
 
-    this->write_exonerate_input(root,read,&names,&r);
+    bool input_written = this->write_exonerate_input(root,read,&names,&q_file,&t_file);
 
     string data_type = "-T protein -Q protein";
     if(is_dna)
@@ -848,29 +741,28 @@ void Exonerate_queries::local_alignment(Node *root, Fasta_entry *read, multimap<
 
     stringstream command;
     if(is_local)
-        command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no "<<data_type<<" 2>&1";
+        command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no "<<data_type;
     else
-        command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no -m affine:local "<<data_type<<" 2>&1";
+        command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no -m affine:local "<<data_type;
 
     Log_output::write_out("Exonerate_local: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with exonerate pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    vector<string> lines;
+    if(input_written)
+        this->run_exonerate(command.str(),&lines);
+    else
+        Log_output::write_out("Exonerate_queries: failed to write the exonerate input; no hits.\n",1);
 
     // read exonerate output, summing the multiple hit scores
 
-    char line[256];
     map<string,hit> all_hits;
     vector<string> hit_names;
 
-    while ( fgets( line, sizeof line, fpipe))
+    for(int li=0;li<(int)lines.size();li++)
     {
+        const string &line = lines.at(li);
         hit h;
-        bool valid = split_sugar_string(string(line),&h);
+        bool valid = split_sugar_string(line,&h);
 
         if(valid)
         {
@@ -902,7 +794,6 @@ void Exonerate_queries::local_alignment(Node *root, Fasta_entry *read, multimap<
             }
         }
     }
-    pclose(fpipe);
 
 
     Log_output::write_out("Exonerate_reads: "+read->name+" has "+Log_output::itos(hit_names.size())+" hits\n",2);
@@ -983,53 +874,45 @@ void Exonerate_queries::local_alignment(Node *root, Fasta_entry *read, multimap<
         read->node_to_align = "discarded_read";
     }
 
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
 }
 
 /****************************************************************************/
 
 void Exonerate_queries::local_pairwise_alignment(string *str1,string *str2,vector<Substring_hit> *hits,int *best_reverse_hit)
 {
-    int r = rand();
-    string tmp_dir = this->get_temp_dir();
+    Subprocess_file q_file("q",".fas");
+    Subprocess_file t_file("t",".fas");
 
-    this->write_exonerate_input(str1,str2,&r);
+    bool input_written = this->write_exonerate_input(str1,str2,&q_file,&t_file);
 
     // exonerate command for local alignment
 
     stringstream command;
-    command <<exoneratepath << "exonerate -q "+tmp_dir+"q"<<r<<".fas -t "+tmp_dir+"t"<<r<<".fas --showalignment no --showsugar yes --showvulgar no 2>&1";
+    command <<exoneratepath << "exonerate -q "<<q_file.get_path()<<" -t "<<t_file.get_path()<<" --showalignment no --showsugar yes --showvulgar no";
 
     Log_output::write_out("Exonerate_pairwise: command: "+command.str()+"\n",2);
 
 
-    FILE *fpipe;
-
-//    #pragma omp critical
-//    {
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with exonerate pipe.\nExiting.\n",0);
-        exit(1);
-    }
-//    }
+    vector<string> lines;
+    if(input_written)
+        this->run_exonerate(command.str(),&lines);
+    else
+        Log_output::write_out("Exonerate_queries: failed to write the exonerate input; no hits.\n",1);
 
     // read exonerate output, summing the multiple hit scores
 
-    char line[256];
     vector<hit> best_hits;
 
-    while ( fgets( line, sizeof line, fpipe))
+    for(int li=0;li<(int)lines.size();li++)
     {
+        const string &line = lines.at(li);
 //        cout<<line;
         hit h;
-        bool valid = split_sugar_string(string(line),&h);
+        bool valid = split_sugar_string(line,&h);
 
         if(valid)
             best_hits.push_back( h);
     }
-    pclose(fpipe);
 
 
     if(best_hits.size()>0)
@@ -1085,26 +968,25 @@ void Exonerate_queries::local_pairwise_alignment(string *str1,string *str2,vecto
         }
     }
 
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
 
 }
 
 /****************************************************************************/
 
+/****************************************************************************/
 
-void Exonerate_queries::delete_files(int r)
+void Exonerate_queries::run_exonerate(const string &command,vector<string> *lines)
 {
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream q_name;
-    q_name <<tmp_dir<<"q"<<r<<".fas";
+    string output, errors;
+    int status = Subprocess::run(command,0,&output,&errors);
 
-    stringstream t_name;
-    t_name <<tmp_dir<<"t"<<r<<".fas";
+    if(status < 0)
+    {
+        Log_output::write_out("Problems running exonerate.\nExiting.\n",0);
+        exit(1);
+    }
+    if(status != 0)
+        Log_output::write_out("Exonerate_queries: exonerate returned exit status "+Log_output::itos(status)+": "+errors+"\n",1);
 
-    if( remove( q_name.str().c_str() ) != 0 )
-       Log_output::write_out( "Error deleting file", 1);
-    if( remove( t_name.str().c_str() ) != 0 )
-       Log_output::write_out( "Error deleting file", 1 );
+    Subprocess::split_lines(output,lines);
 }
@@ -23,12 +23,12 @@
 
 #include "utils/fasta_entry.h"
 #include "utils/substring_hit.h"
+#include "utils/subprocess.h"
 #include "main/node.h"
 #include <fstream>
 #include <string>
 #include <vector>
 #include <map>
-#include <sys/stat.h>
 
 #include <omp.h>
 
@@ -60,27 +60,18 @@ class Exonerate_queries
 
     bool split_sugar_string(const std::string& row,hit *h);
     bool split_vulgar_string(const std::string& row,hit *h);
-    void write_exonerate_input(string *str1, string *str2, int *r);
-    void write_exonerate_input(Node *root, vector<Fasta_entry> *reads, map<string,string> *names, int *r);
-    void write_exonerate_input(Node *root, Fasta_entry *read, map<string,string> *names, int *r);
-    void write_exonerate_input(map<string,string> *target_sequences, vector<Fasta_entry> *reads, int *r);
-    void write_exonerate_input(map<string,string> *target_sequences, Fasta_entry *reads, int *r);
-    void delete_files(int r);
-
-    string get_temp_dir()
-    {
-        string tmp_dir = "/tmp/";
-        if(Settings_handle::st.is("temp-folder"))
-            tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
-
-        struct stat st;
-        if(stat(tmp_dir.c_str(),&st) != 0)
-            tmp_dir = "";
-
-        return tmp_dir;
-    }
+    bool write_exonerate_input(string *str1, string *str2, Subprocess_file *q_file, Subprocess_file *t_file);
+    bool write_exonerate_input(Node *root, vector<Fasta_entry> *reads, map<string,string> *names, Subprocess_file *q_file, Subprocess_file *t_file);
+    bool write_exonerate_input(Node *root, Fasta_entry *read, map<string,string> *names, Subprocess_file *q_file, Subprocess_file *t_file);
+    bool write_exonerate_input(map<string,string> *target_sequences, vector<Fasta_entry> *reads, Subprocess_file *q_file, Subprocess_file *t_file);
+    bool write_exonerate_input(map<string,string> *target_sequences, Fasta_entry *reads, Subprocess_file *q_file, Subprocess_file *t_file);
+    void run_exonerate(const string &command,vector<string> *lines);
+
+    bool probe_executable();
 
     string exoneratepath;
+    static int executable_found;
+    static string executable_path;
 public:
     Exonerate_queries();
     bool test_executable();
@@ -56,6 +56,7 @@ struct Fasta_entry
     bool reversed;
     int num_duplicates;
     int query_strand;
+    vector< pair<string,string> > duplicates; // names and comments of identical queries collapsed into this one
 };
 
 }
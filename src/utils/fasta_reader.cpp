@@ -69,7 +69,15 @@ knowledge of the CeCILL license and that you accept its terms.
 #include <algorithm>
 #include <iostream>
 #include <set>
+#include <sstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/unordered_map.hpp>
 #include "utils/fasta_reader.h"
+#include "utils/gzip_input.h"
 #include "utils/text_utils.h"
 #include "utils/settings_handle.h"
 
@@ -109,13 +117,23 @@ void Fasta_reader::read(istream & input, vector<Fasta_entry> & seqs, bool short_
         exit(1);
     }
 
+    this->rename_duplicates(seqs);
+}
+
+void Fasta_reader::rename_duplicates(vector<Fasta_entry> & seqs) const
+{
     map<string,int> copy_num;
+    this->rename_duplicates(seqs, &copy_num, 0);
+}
+
+void Fasta_reader::rename_duplicates(vector<Fasta_entry> & seqs, map<string,int> *copy_num, string *messages) const
+{
     for(int i=0;i<(int)seqs.size();i++)
     {
         string name = seqs.at(i).name;
 
-        map<string,int>::iterator it = copy_num.find(name);
-        if(it != copy_num.end())
+        map<string,int>::iterator it = copy_num->find(name);
+        if(it != copy_num->end())
         {
             it->second++;
 
@@ -123,16 +141,471 @@ void Fasta_reader::read(istream & input, vector<Fasta_entry> & seqs, bool short_
             ss<<"."<<it->second;
             name.append(ss.str());
 
-            Log_output::write_out("Warning: duplicate names found. '"+seqs.at(i).name+"' is renamed '"+name+"'.\n",2);
+            string msg = "Warning: duplicate names found. '"+seqs.at(i).name+"' is renamed '"+name+"'.\n";
+            if(messages != 0)
+                messages->append(msg);
+            else
+                Log_output::write_out(msg,2);
 
             seqs.at(i).name = name;
         }
         else
         {
-            copy_num.insert( pair<string,int>(name,0) );
+            copy_num->insert( pair<string,int>(name,0) );
+        }
+    }
+}
+
+void Fasta_reader::translate_sequences(vector<Fasta_entry> & seqs) const throw (Exception)
+{
+    if(Settings_handle::st.is("translate")
+    || Settings_handle::st.is("mt-translate")
+    || Settings_handle::st.is("find-best-orf")
+    || Settings_handle::st.is("find-orfs") )
+    {
+        if(this->check_sequence_data_type(&seqs) == Model_factory::dna)
+        {
+            int n_threads = this->get_threads();
+
+            #pragma omp parallel for num_threads(n_threads) schedule(dynamic,64)
+            for(int i=0;i<(int)seqs.size();i++)
+            {
+                Fasta_entry *it = &seqs.at(i);
+
+                string dna = it->sequence;
+                this->rna_to_DNA(&dna);
+
+                it->sequence = this->DNA_to_protein(&dna);
+
+                it->dna_sequence = dna;
+            }
+        }
+        else
+        {
+            Log_output::write_out("Option '--translate' cannot be used for proteins. Exiting.\n\n",0);
+            exit(0);
+        }
+    }
+}
+
+int Fasta_reader::get_threads() const
+{
+    int n_threads = 1;
+    if(Settings_handle::st.is("threads"))
+    {
+        int nt = Settings_handle::st.get("threads").as<int>();
+        if(nt>0)
+            n_threads = nt;
+    }
+    return n_threads;
+}
+
+/****************************************************************************************/
+
+void Fasta_reader::read(const string & path, vector<Fasta_entry> & seqs, bool short_names, bool degap) const throw (Exception)
+{
+    // Regular files are mapped and parsed in place, records in parallel;
+    // gzip files are first inflated into memory. Pipes, empty files and
+    // graph files go through the istream reader.
+    struct stat st;
+    int fd = open(path.c_str(), O_RDONLY);
+    void *mapped = MAP_FAILED;
+    size_t length = 0;
+
+    if(fd >= 0 && fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        length = st.st_size;
+        mapped = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if(fd >= 0)
+        close(fd);
+
+    bool parsed = false;
+    if(mapped != MAP_FAILED)
+    {
+        #if defined (MADV_SEQUENTIAL)
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        #endif
+
+        const char *data = (const char*) mapped;
+        if(Gzip_input::is_gzip(data, length))
+        {
+            string buffer;
+            Gzip_input gz;
+            try
+            {
+                gz.decompress(data, length, &buffer, this->get_threads());
+            }
+            catch(IOException &e)
+            {
+                munmap(mapped, length);
+                throw;
+            }
+            munmap(mapped, length);
+
+            if(!this->read_buffer(buffer.data(), buffer.length(), seqs, short_names, degap))
+            {
+                istringstream input(buffer);
+                read(input, seqs, short_names, degap);
+            }
+            return;
+        }
+
+        parsed = this->read_buffer(data, length, seqs, short_names, degap);
+        munmap(mapped, length);
+    }
+
+    if(!parsed)
+    {
+        Gzip_streambuf buffer(path);
+        istream input(&buffer);
+        if(!buffer.is_open())
+            input.setstate(ios::failbit);
+
+        read(input, seqs, short_names, degap);
+    }
+}
+
+bool Fasta_reader::read_buffer(const char *data, size_t length, vector<Fasta_entry> & seqs, bool short_names, bool degap) const throw (Exception)
+{
+    size_t pos = 0;
+    while(pos<length && (data[pos]==' ' || data[pos]=='\n'))
+        pos++;
+
+    if(pos == length || (data[pos] != '>' && data[pos] != '@'))
+        return false;
+
+    bool is_fastq = data[pos] == '@';
+    int n_threads = this->get_threads();
+
+    vector<size_t> starts;
+    this->find_record_starts(data, pos, length, is_fastq, n_threads, &starts);
+
+    int n_records = starts.size();
+    starts.push_back(length);
+
+    vector<Fasta_entry> parsed(n_records);
+    vector<bool> valid(n_records,true);
+    string error = "";
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,256)
+    for(int i=0;i<n_records;i++)
+    {
+        if(is_fastq)
+        {
+            string msg;
+            if(!this->parse_fastq_record(data+starts.at(i), data+starts.at(i+1), &parsed.at(i), &msg))
+            {
+                #pragma omp critical (fasta_reader_error)
+                {
+                    if(error == "")
+                        error = msg;
+                }
+            }
+        }
+        else
+        {
+            this->parse_fasta_record(data+starts.at(i), data+starts.at(i+1), &parsed.at(i), short_names, degap);
+            valid.at(i) = parsed.at(i).sequence != "";
+        }
+    }
+
+    if(error != "")
+    {
+        Log_output::write_out(error,0);
+        exit(1);
+    }
+
+    size_t first = seqs.size();
+    int n_valid = 0;
+    for(int i=0;i<n_records;i++)
+        if(valid.at(i))
+            n_valid++;
+
+    seqs.resize(first+n_valid);
+
+    // the entries are moved by swapping their strings, not copied
+    for(int i=0,j=first;i<n_records;i++)
+    {
+        if(!valid.at(i))
+            continue;
+
+        Fasta_entry *from = &parsed.at(i);
+        Fasta_entry *to = &seqs.at(j++);
+
+        to->name.swap(from->name);
+        to->comment.swap(from->comment);
+        to->sequence.swap(from->sequence);
+        to->quality.swap(from->quality);
+        to->tid.swap(from->tid);
+        to->first_read_length = from->first_read_length;
+        to->cluster_attempts = from->cluster_attempts;
+        to->num_duplicates = from->num_duplicates;
+    }
+
+    if(!is_fastq)
+        this->translate_sequences(seqs);
+
+    this->rename_duplicates(seqs);
+
+    return true;
+}
+
+void Fasta_reader::find_record_starts(const char *data, size_t begin, size_t end, bool is_fastq, int n_threads, vector<size_t> *starts) const
+{
+    // The buffer is cut in slices scanned in parallel; each slice reports
+    // the records that start inside it.
+    int n_slices = n_threads;
+    if(end-begin < (size_t) n_slices * 1048576)
+        n_slices = 1;
+
+    size_t slice_length = (end-begin)/n_slices;
+    vector< vector<size_t> > slice_starts(n_slices);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(static,1)
+    for(int k=0;k<n_slices;k++)
+    {
+        size_t s_begin = begin + k*slice_length;
+        size_t s_end = k==n_slices-1 ? end : s_begin + slice_length;
+
+        if(is_fastq)
+            this->find_fastq_starts(data, begin, s_begin, s_end, end, &slice_starts.at(k));
+        else
+            this->find_fasta_starts(data, begin, s_begin, s_end, &slice_starts.at(k));
+    }
+
+    for(int k=0;k<n_slices;k++)
+        starts->insert(starts->end(), slice_starts.at(k).begin(), slice_starts.at(k).end());
+}
+
+void Fasta_reader::find_fasta_starts(const char *data, size_t first, size_t begin, size_t end, vector<size_t> *starts) const
+{
+    // a record starts at every '>' that begins a line
+    size_t pos = begin;
+    while(pos < end)
+    {
+        const char *hit = (const char*) memchr(data+pos, '>', end-pos);
+        if(hit == 0)
+            break;
+
+        pos = hit-data;
+        if(pos == first || data[pos-1] == '\n')
+            starts->push_back(pos);
+        pos++;
+    }
+}
+
+void Fasta_reader::find_fastq_starts(const char *data, size_t first, size_t begin, size_t end, size_t length, vector<size_t> *starts) const
+{
+    // '@' may also begin a quality line: a header is an '@' line whose
+    // second next line begins with '+', as sequence lines never do
+    size_t pos = begin;
+    if(pos != first)
+    {
+        size_t search = pos-1;
+        while(true)
+        {
+            const char *nl = (const char*) memchr(data+search, '\n', length-search);
+            if(nl == 0)
+                return;
+            pos = nl-data+1;
+            if(pos >= end)
+                return;
+            search = pos;
+            if(data[pos] != '@')
+                continue;
+
+            const char *l2 = (const char*) memchr(data+pos, '\n', length-pos);
+            if(l2 != 0)
+                l2 = (const char*) memchr(l2+1, '\n', data+length-l2-1);
+            if(l2 != 0 && l2+1 < data+length && l2[1] == '+')
+                break;
+        }
+    }
+
+    // then step over four-line records, skipping empty lines between them
+    while(pos < end)
+    {
+        if(data[pos] == '\n' || data[pos] == '\r')
+        {
+            pos++;
+            continue;
+        }
+        starts->push_back(pos);
+
+        for(int l=0;l<4 && pos<length;l++)
+        {
+            const char *nl = (const char*) memchr(data+pos, '\n', length-pos);
+            pos = nl == 0 ? length : nl-data+1;
+        }
+    }
+}
+
+void Fasta_reader::parse_header(const string & header, Fasta_entry *fe, bool is_fastq) const
+{
+    String_tokenizer st(header, " ", true, false);
+    string name = st.next_token();
+    name.erase(name.begin());  // Character >/@ deletion
+    fe->name = name;
+
+    fe->comment = "";
+    fe->tid = "";
+    fe->num_duplicates = 1;
+
+    while (st.has_more_token())
+    {
+        string block = st.next_token();
+        block = Text_utils::remove_surrounding_whitespaces(block);
+        if(is_fastq)
+            fe->comment += block+" ";
+        else
+            fe->comment += " "+block;
+
+        if(block.substr(0,4)=="TID=")
+            fe->tid = block.substr(4);
+
+        if(block.substr(0,14)=="NumDuplicates=")
+        {
+            stringstream ss(block.substr(14));
+            ss >> fe->num_duplicates;
+        }
+    }
+}
+
+void Fasta_reader::parse_fasta_record(const char *begin, const char *end, Fasta_entry *fe, bool short_names, bool degap) const
+{
+    const char *eol = (const char*) memchr(begin, '\n', end-begin);
+    if(eol == 0)
+        eol = end;
+
+    string header = Text_utils::remove_last_whitespaces(string(begin, eol));
+
+    if(short_names)
+        this->parse_header(header, fe, false);
+    else
+    {
+        fe->name = header.substr(1);
+        fe->comment = "";
+        fe->tid = "";
+        fe->num_duplicates = 1;
+    }
+
+    fe->sequence.reserve(end-eol);
+    for(const char *c = eol; c < end; c++)
+    {
+        if(*c == '\n' || *c == '\r' || (degap && *c == '-'))
+            continue;
+        fe->sequence.push_back( toupper((unsigned char)*c) );
+    }
+
+    fe->quality = "";
+    fe->first_read_length = -1;
+    fe->cluster_attempts = 0;
+}
+
+bool Fasta_reader::parse_fastq_record(const char *begin, const char *end, Fasta_entry *fe, string *error) const
+{
+    string lines[4];
+    const char *pos = begin;
+    for(int l=0;l<4;l++)
+    {
+        const char *eol = (const char*) memchr(pos, '\n', end-pos);
+        if(eol == 0)
+            eol = end;
+        lines[l] = Text_utils::remove_last_whitespaces(string(pos, eol));
+        pos = eol < end ? eol+1 : end;
+    }
+
+    if(lines[0].length() == 0 || lines[0][0] != '@')
+    {
+        *error = "FASTQ file parse error. Expecting a line starting with '@':  \n"+lines[0]+".\n\nExiting.\n\n";
+        return false;
+    }
+
+    this->parse_header(lines[0], fe, true);
+    fe->sequence = Text_utils::to_upper(lines[1]);
+
+    if(lines[2].length() == 0 || lines[2][0] != '+')
+    {
+        *error = "Error in FASTQ comment:"+lines[2]+"\nExiting.\n\n";
+        return false;
+    }
+
+    if(lines[2].length()>1)
+    {
+        fe->comment += " ; ";
+        fe->comment += lines[2].substr(1);
+    }
+
+    fe->quality = lines[3];
+    fe->first_read_length = -1;
+    fe->cluster_attempts = 0;
+
+    return true;
+}
+
+bool Fasta_reader::read_batch(istream & input, vector<Fasta_entry> & seqs, int max_seqs, map<string,int> *copy_num, string *messages, bool short_names, bool degap) const throw (Exception)
+{
+    // Reads up to 'max_seqs' records from where the previous batch stopped;
+    // 'copy_num' carries the duplicate names across batches. Returns false
+    // once the input is exhausted.
+    vector<Fasta_entry> batch;
+    string line, record;
+    bool is_fastq = false;
+
+    while(input.peek() == ' ' || input.peek() == '\n' || input.peek() == '\r')
+        input.get();
+
+    if(input.peek() == '@')
+        is_fastq = true;
+    else if(input.peek() != '>' && input.peek() != EOF)
+    {
+        Log_output::write_out("Input file format unrecognized. Only FASTA and FASTQ formats supported. Exiting.\n\n",0);
+        exit(1);
+    }
+
+    while((int)batch.size() < max_seqs && input.peek() != EOF)
+    {
+        Fasta_entry fe;
+
+        if(is_fastq)
+        {
+            record = "";
+            for(int l=0;l<4 && getline(input, line, '\n');l++)
+                record += line+"\n";
+
+            string error;
+            if(!this->parse_fastq_record(record.data(), record.data()+record.length(), &fe, &error))
+            {
+                Log_output::write_out(error,0);
+                exit(1);
+            }
+            batch.push_back(fe);
+
+            while(input.peek() == '\n' || input.peek() == '\r')
+                input.get();
+        }
+        else
+        {
+            getline(input, record, '\n');
+            record += "\n";
+            while(input.peek() != '>' && getline(input, line, '\n'))
+                record += line+"\n";
+
+            this->parse_fasta_record(record.data(), record.data()+record.length(), &fe, short_names, degap);
+            if(fe.sequence != "")
+                batch.push_back(fe);
         }
     }
 
+    if(!is_fastq)
+        this->translate_sequences(batch);
+
+    this->rename_duplicates(batch, copy_num, messages);
+
+    seqs.insert(seqs.end(), batch.begin(), batch.end());
+
+    return input.peek() != EOF;
 }
 
 void Fasta_reader::read_fasta(istream & input, vector<Fasta_entry> & seqs, bool short_names, bool degap) const throw (Exception)
@@ -236,32 +709,7 @@ void Fasta_reader::read_fasta(istream & input, vector<Fasta_entry> & seqs, bool
         seqs.push_back(fe);
     }
 
-    if(Settings_handle::st.is("translate")
-    || Settings_handle::st.is("mt-translate")
-    || Settings_handle::st.is("find-best-orf")
-    || Settings_handle::st.is("find-orfs") )
-    {
-        if(this->check_sequence_data_type(&seqs) == Model_factory::dna)
-        {
-            vector<Fasta_entry>::iterator it = seqs.begin();
-            for(;it != seqs.end(); it++)
-            {
-//                it->dna_sequence = it->sequence;
-
-                string dna = it->sequence;
-                this->rna_to_DNA(&dna);
-
-                it->sequence = this->DNA_to_protein(&dna);
-
-                it->dna_sequence = dna;
-            }
-        }
-        else
-        {
-            Log_output::write_out("Option '--translate' cannot be used for proteins. Exiting.\n\n",0);
-            exit(0);
-        }
-    }
+    this->translate_sequences(seqs);
 }
 
 void Fasta_reader::read_fastq(istream & input, vector<Fasta_entry> & seqs) const throw (Exception)
@@ -515,65 +963,217 @@ void Fasta_reader::write(ostream & output, const vector<Fasta_entry> & seqs, str
     // Checking the existence of specified file, and possibility to open it in write mode
     if (! output) { throw IOException ("Fasta_reader::write. Failed to open file"); }
 
-    string seq, temp = "";  // Initialization
+    vector<string> names;
+    vector<Fasta_entry>::const_iterator vi = seqs.begin();
+    for (; vi != seqs.end(); vi++)
+        names.push_back(vi->name);
 
-    multimap<string,int> copy_num;
-    vector<Fasta_entry>::const_iterator vi1 = seqs.begin();
-    for (; vi1 != seqs.end(); vi1++)
+    // Entries are copied only if some names have to be numbered
+    //
+    if(this->number_duplicate_names(&names))
     {
-        vector<Fasta_entry>::const_iterator vi2 = vi1;
-        vi2++;
+        vector<Fasta_entry> seqs2 = seqs;
+        for(unsigned int i=0;i<seqs2.size();i++)
+            seqs2.at(i).name = names.at(i);
 
-        int copy = 1;
-        for (; vi2 != seqs.end(); vi2++)
+        this->write_formatted(output,seqs2,format);
+    }
+    else
+        this->write_formatted(output,seqs,format);
+}
+
+void Fasta_reader::write_formatted(ostream & output, const vector<Fasta_entry> & seqs, string format) const throw (Exception)
+{
+    if(format == "fasta")
+        write_fasta(output,seqs);
+    else if(format == "raxml")
+        this->write_long_sequential(output,seqs);
+    else if (format == "phylipi")
+        this->write_interleaved(output,seqs);
+    else if (format == "phylip")
+        this->write_interleaved(output,seqs);
+    else if (format == "phylips")
+        this->write_sequential(output,seqs,true);
+    else if (format == "nexus")
+        this->write_simple_nexus(output,seqs);
+    else if (format == "paml")
+        this->write_sequential(output,seqs,false);
+    else
+    {
+        Log_output::write_out("Outformat '"+format+"' not recognised.\nAccepted formats: fasta, raxml, paml, phylips, phylipi, nexus.\n Using 'fasta'.",0);
+        write_fasta(output,seqs);
+    }
+}
+
+bool Fasta_reader::number_duplicate_names(vector<string> *names) const
+{
+    map<string,int> copies;
+    for(unsigned int i=0;i<names->size();i++)
+        copies[names->at(i)]++;
+
+    if(copies.size() == names->size())
+        return false;
+
+    map<string,int> copy_num;
+    for(unsigned int i=0;i<names->size();i++)
+    {
+        if(copies.find(names->at(i))->second > 1)
         {
-            if(vi1->name == vi2->name)
+            stringstream ss;
+            ss << names->at(i) << "/" << ++copy_num[names->at(i)];
+            names->at(i) = ss.str();
+        }
+    }
+    return true;
+}
+
+/****************************************************************************************/
+
+namespace ppa
+{
+
+// Writes rows as the tree produces them; only one row is held in memory.
+//
+class Alignment_row_writer : public Alignment_row_sink
+{
+    ostream *output;
+    string format;
+    const vector<string> *names;
+    unsigned int chars_by_line;
+    int next_row;
+
+public:
+    Alignment_row_writer(ostream *o, string f, const vector<string> *n, unsigned int c) :
+        output(o), format(f), names(n), chars_by_line(c), next_row(0) {}
+
+    void add_row(Node *node, const string &row)
+    {
+        this->write_row(node->get_name_comment(),row);
+
+        const vector< pair<string,string> > *duplicates = node->get_duplicate_queries();
+        for(unsigned int i=0;i<duplicates->size();i++)
+            this->write_row(duplicates->at(i).second,row);
+    }
+
+private:
+    void write_row(const string &comment, const string &row)
+    {
+        const string &name = names->at(next_row);
+
+        if(format == "fasta")
+        {
+            *output << ">" << name << comment << endl;
+            for(unsigned int offset=0;offset<row.length();offset+=chars_by_line)
+                *output << row.substr(offset,chars_by_line) << endl;
+        }
+        else
+        {
+            if(next_row == 0)
+                *output << names->size() << " " << row.length() << endl;
+
+            if(format == "raxml")
+                *output << name << endl << row << endl;
+            else
             {
-                if(copy==1)
-                    copy_num.insert( pair<string,int>(vi1->name,copy) );
+                if(format == "phylips")
+                    *output << (name+"          ").substr(0,10) << " " << endl;
+                else
+                    *output << name << endl;
 
-                copy++;
-                copy_num.insert( pair<string,int>(vi2->name,copy) );
+                for(unsigned int offset=0;offset<row.length();offset+=chars_by_line)
+                    *output << row.substr(offset,chars_by_line) << endl;
             }
         }
+        next_row++;
     }
+};
 
-    vector<Fasta_entry> seqs2;
+}
 
-    vector<Fasta_entry>::const_iterator vi = seqs.begin();
-    for (; vi != seqs.end(); vi++)
+void Fasta_reader::write_alignment(ostream & output, Node *root, string format, bool include_internal_nodes) const throw (Exception)
+{
+    if (! output) { throw IOException ("Fasta_reader::write_alignment. Failed to open file"); }
+
+    // Interleaved formats need all the rows at once
+    //
+    bool sequential = format == "fasta" || format == "raxml" || format == "phylips" || format == "paml";
+
+    if(!sequential || !root->can_stream_alignment_rows(include_internal_nodes))
     {
-        Fasta_entry e = *vi;
-        multimap<string,int>::iterator cit = copy_num.find(vi->name);
-        if(cit!=copy_num.end())
-        {
-            stringstream ss;
-            ss << e.name << "/" << cit->second;
-            e.name = ss.str();
-            copy_num.erase(cit);
-        }
-        seqs2.push_back(e);
+        vector<Fasta_entry> aligned_sequences;
+        root->get_alignment(&aligned_sequences,include_internal_nodes);
+
+        // The pileup consensus is not a leaf
+        if(!include_internal_nodes && (int)aligned_sequences.size() > root->get_number_of_leaves())
+            aligned_sequences.resize(root->get_number_of_leaves());
+
+        vector<Fasta_entry> expanded;
+        if(this->expand_duplicate_rows(root,aligned_sequences,&expanded,include_internal_nodes))
+            this->write(output,expanded,format);
+        else
+            this->write(output,aligned_sequences,format);
+        return;
     }
 
-    if(format == "fasta")
-        write_fasta(output,seqs2);
-    else if(format == "raxml")
-        this->write_long_sequential(output,seqs2);
-    else if (format == "phylipi")
-        this->write_interleaved(output,seqs2);
-    else if (format == "phylip")
-        this->write_interleaved(output,seqs2);
-    else if (format == "phylips")
-        this->write_sequential(output,seqs2,true);
-    else if (format == "nexus")
-        this->write_simple_nexus(output,seqs2);
-    else if (format == "paml")
-        this->write_sequential(output,seqs2,false);
+    vector<Node*> nodes;
+    if(include_internal_nodes)
+        root->get_all_nodes(&nodes);
     else
+        root->get_leaf_nodes(&nodes);
+
+    vector<string> names;
+    for(unsigned int i=0;i<nodes.size();i++)
     {
-        Log_output::write_out("Outformat '"+format+"' not recognised.\nAccepted formats: fasta, raxml, paml, phylips, phylipi, nexus.\n Using 'fasta'.",0);
-        write_fasta(output,seqs2);
+        names.push_back(nodes.at(i)->get_name());
+
+        const vector< pair<string,string> > *duplicates = nodes.at(i)->get_duplicate_queries();
+        for(unsigned int j=0;j<duplicates->size();j++)
+            names.push_back(duplicates->at(j).first);
+    }
+
+    this->number_duplicate_names(&names);
+
+    Alignment_row_writer writer(&output,format,&names,chars_by_line);
+    root->stream_alignment_rows(&writer,include_internal_nodes);
+}
+
+bool Fasta_reader::expand_duplicate_rows(Node *root, const vector<Fasta_entry> &aligned_sequences, vector<Fasta_entry> *expanded, bool include_internal_nodes) const
+{
+    // The rows come in the node order of get_alignment(); the rows of
+    // collapsed identical queries are copies of their representative's.
+    vector<Node*> nodes;
+    if(include_internal_nodes)
+        root->get_all_nodes(&nodes);
+    else
+        root->get_leaf_nodes(&nodes);
+
+    int n_copies = 0;
+    for(unsigned int i=0;i<nodes.size();i++)
+        n_copies += nodes.at(i)->get_duplicate_queries()->size();
+
+    if(n_copies == 0)
+        return false;
+
+    expanded->reserve(aligned_sequences.size()+n_copies);
+
+    for(unsigned int i=0;i<aligned_sequences.size();i++)
+    {
+        expanded->push_back(aligned_sequences.at(i));
+
+        if(i >= nodes.size())
+            continue;
+
+        const vector< pair<string,string> > *duplicates = nodes.at(i)->get_duplicate_queries();
+        for(unsigned int j=0;j<duplicates->size();j++)
+        {
+            Fasta_entry copy = aligned_sequences.at(i);
+            copy.name = duplicates->at(j).first;
+            copy.comment = duplicates->at(j).second;
+            expanded->push_back(copy);
+        }
     }
+
+    return true;
 }
 
 string Fasta_reader::get_format_suffix(string format) const throw (Exception)
@@ -745,6 +1345,21 @@ void Fasta_reader::get_DNA_seqs(Node *root, const vector<Fasta_entry> *org_seqs,
         dna_seqs->insert(pair<string,string>(it->name,seq));
     }
 
+    // A reference read from a snapshot has no input rows; its leaves keep the DNA
+    vector<Node*> leaf_nodes;
+    root->get_leaf_nodes(&leaf_nodes);
+
+    for (vector<Node*>::iterator lit = leaf_nodes.begin(); lit != leaf_nodes.end(); lit++)
+    {
+        if((*lit)->get_sequence()->is_read_sequence() || dna_seqs->find((*lit)->get_name()) != dna_seqs->end())
+            continue;
+
+        string seq = *(*lit)->get_sequence()->get_dna_sequence();
+        tu.replace_all(seq,"-","");
+
+        dna_seqs->insert(pair<string,string>((*lit)->get_name(),seq));
+    }
+
     vector<Node*> read_nodes;
     root->get_read_nodes_below(&read_nodes);
 
@@ -1170,7 +1785,7 @@ void Fasta_reader::remove_gaps(vector<Fasta_entry> *seqs) const throw (Exception
 bool Fasta_reader::check_alphabet(vector<Fasta_entry> * sequences,int data_type) throw (Exception)
 {
 
-    bool allow_gaps = Settings_handle::st.is("ref-seqfile");
+    bool allow_gaps = Settings_handle::st.is("ref-seqfile") || Settings_handle::st.is("ref-snapshot");
 
     if(data_type<0)
         data_type = this->check_sequence_data_type(sequences);
@@ -1292,11 +1907,44 @@ bool Fasta_reader::check_alphabet(vector<Fasta_entry> * sequences,int data_type)
 
 int Fasta_reader::check_sequence_data_type(const vector<Fasta_entry> *sequences) const
 {
+    int dna = 0;
+    int protein = 0;
+    this->count_sequence_alphabet(sequences,&dna,&protein);
 
-    vector<Fasta_entry>::const_iterator vi = sequences->begin();
+    if( ((float)dna )/ (float)protein > 0.9)
+        return Model_factory::dna;
+    else
+        return Model_factory::protein;
+}
 
+int Fasta_reader::check_sequence_data_type(istream & input, int max_seqs) const
+{
+    // Counts over all records of the stream, 'max_seqs' at a time, so that
+    // the type is the same as for the whole file read at once
     int dna = 0;
     int protein = 0;
+
+    map<string,int> copy_num;
+    string messages;
+    bool more = true;
+    while(more)
+    {
+        vector<Fasta_entry> batch;
+        more = this->read_batch(input, batch, max_seqs, &copy_num, &messages, true, false);
+        this->count_sequence_alphabet(&batch,&dna,&protein);
+    }
+
+    if( ((float)dna )/ (float)protein > 0.9)
+        return Model_factory::dna;
+    else
+        return Model_factory::protein;
+}
+
+void Fasta_reader::count_sequence_alphabet(const vector<Fasta_entry> *sequences, int *dna, int *protein) const
+{
+
+    vector<Fasta_entry>::const_iterator vi = sequences->begin();
+
     string dna_alphabet = "ACGTUN";
     string protein_alphabet = Model_factory::get_protein_char_alphabet();
 
@@ -1309,19 +1957,14 @@ int Fasta_reader::check_sequence_data_type(const vector<Fasta_entry> *sequences)
             char c = *si;
             if(dna_alphabet.find(c) != string::npos)
             {
-                dna++;
+                (*dna)++;
             }
             if(protein_alphabet.find(c) != string::npos)
             {
-                protein++;
+                (*protein)++;
             }
         }
     }
-
-    if( ((float)dna )/ (float)protein > 0.9)
-        return Model_factory::dna;
-    else
-        return Model_factory::protein;
 }
 
 
@@ -1379,14 +2022,27 @@ void Fasta_reader::define_translation_tables()
             aa_to_codon.insert(make_pair(unaa[i],codon[i]));
         }
     }
+
+    frame_translation.index_codons(codon_to_aa);
 }
 
 string Fasta_reader::DNA_to_protein(string *sequence) const
 {
     string prot;
+    prot.reserve(sequence->length()/3+1);
 
     for (unsigned int j=0; j<sequence->length(); j+=3)
     {
+        char aa = 0;
+        if(j+3 <= sequence->length())
+            aa = frame_translation.translate_codon(sequence->data()+j);
+
+        if(aa != 0)
+        {
+            prot += aa;
+            continue;
+        }
+
         string codon = sequence->substr(j,3);
         if (codon_to_aa.find(codon) == codon_to_aa.end())
         {
@@ -1446,17 +2102,18 @@ string Fasta_reader::protein_to_mockDNA(string *prot) const
 
 bool Fasta_reader::check_sequence_names(const vector<Fasta_entry> *sequences,const vector<Node*> *leaf_nodes) const
 {
+    boost::unordered_map<string,int> leaf_names;
+    vector<Node*>::const_iterator ni = leaf_nodes->begin();
+    for (; ni != leaf_nodes->end(); ni++)
+        leaf_names[(*ni)->get_name()]++;
+
     unsigned int names_match = 0;
     vector<Fasta_entry>::const_iterator si = sequences->begin();
     for (; si != sequences->end(); si++)
     {
-        string s_name = si->name;
-        vector<Node*>::const_iterator ni = leaf_nodes->begin();
-        for (; ni != leaf_nodes->end(); ni++)
-        {
-            if((*ni)->get_name() == s_name)
-                names_match++;
-        }
+        boost::unordered_map<string,int>::const_iterator li = leaf_names.find(si->name);
+        if(li != leaf_names.end())
+            names_match += li->second;
     }
 
     // All the leafs in the guidetree need a sequence. Not all sequences need to be in the tree.
@@ -1542,18 +2199,18 @@ void Fasta_reader::place_sequences_to_nodes(const vector<Fasta_entry> *sequences
     if(data_type<0)
         data_type = this->check_sequence_data_type(sequences);
 
+    boost::unordered_multimap<string,Node*> leaves;
+    for (vector<Node*>::iterator ni = leaf_nodes->begin(); ni != leaf_nodes->end(); ni++)
+        leaves.insert(make_pair((*ni)->get_name(),*ni));
+
     vector<Fasta_entry>::const_iterator si = sequences->begin();
     for (; si != sequences->end(); si++)
     {
-        string s_name = si->name;
-
-        vector<Node*>::iterator ni = leaf_nodes->begin();
-        for (; ni != leaf_nodes->end(); ni++)
+        pair<boost::unordered_multimap<string,Node*>::iterator,boost::unordered_multimap<string,Node*>::iterator> range = leaves.equal_range(si->name);
+        for (boost::unordered_multimap<string,Node*>::iterator li = range.first; li != range.second; li++)
         {
-            if((*ni)->get_name() == s_name) {
-                (*ni)->add_name_comment( si->comment );
-                (*ni)->add_sequence( *si, data_type, gapped);
-            }
+            li->second->add_name_comment( si->comment );
+            li->second->add_sequence( *si, data_type, gapped);
         }
     }
 }
@@ -28,6 +28,7 @@
 #include "utils/exceptions.h"
 #include "main/node.h"
 #include "utils/fasta_entry.h"
+#include "utils/frame_translation.h"
 
 using namespace std;
 
@@ -41,13 +42,30 @@ class Fasta_reader
 
     std::map<std::string,std::string> codon_to_aa;
     std::map<std::string,std::string> aa_to_codon;
+    Frame_translation frame_translation;
 
     void rna_to_DNA(string *sequence) const;
+    void count_sequence_alphabet(const vector<Fasta_entry> * sequences, int *dna, int *protein) const;
     void define_translation_tables();
 
     string DNA_to_protein(string *sequence) const;
     string protein_to_mockDNA(string *prot) const;
     string protein_to_DNA(string *dna,string *prot) const;
+
+    int get_threads() const;
+    void rename_duplicates(vector<Fasta_entry> & seqs) const;
+    bool number_duplicate_names(vector<string> *names) const;
+    void write_formatted(ostream & output, const vector<Fasta_entry> & seqs, string format) const throw (Exception);
+    void rename_duplicates(vector<Fasta_entry> & seqs, map<string,int> *copy_num, string *messages) const;
+    void translate_sequences(vector<Fasta_entry> & seqs) const throw (Exception);
+
+    bool read_buffer(const char *data, size_t length, vector<Fasta_entry> & seqs, bool short_names, bool degap) const throw (Exception);
+    void find_record_starts(const char *data, size_t begin, size_t end, bool is_fastq, int n_threads, vector<size_t> *starts) const;
+    void find_fasta_starts(const char *data, size_t first, size_t begin, size_t end, vector<size_t> *starts) const;
+    void find_fastq_starts(const char *data, size_t first, size_t begin, size_t end, size_t length, vector<size_t> *starts) const;
+    void parse_header(const string & header, Fasta_entry *fe, bool is_fastq) const;
+    void parse_fasta_record(const char *begin, const char *end, Fasta_entry *fe, bool short_names, bool degap) const;
+    bool parse_fastq_record(const char *begin, const char *end, Fasta_entry *fe, string *error) const;
 public:
 
     enum output_mode {plain_alignment,contig_alignment,consensus_only};
@@ -59,12 +77,8 @@ public:
     void set_chars_by_line(int n) { chars_by_line = n; }
 
     void read(istream & input, vector<Fasta_entry> & seqs, bool short_names, bool degap) const throw (Exception);
-    void read(const string & path, vector<Fasta_entry> & seqs, bool short_names=false, bool degap=false) const throw (Exception)
-    {
-        ifstream input(path.c_str(), ios::in);
-        read(input, seqs, short_names,degap);
-        input.close();
-    }
+    void read(const string & path, vector<Fasta_entry> & seqs, bool short_names=false, bool degap=false) const throw (Exception);
+    bool read_batch(istream & input, vector<Fasta_entry> & seqs, int max_seqs, map<string,int> *copy_num, string *messages, bool short_names=false, bool degap=false) const throw (Exception);
     void read_fasta(istream & input, vector<Fasta_entry> & seqs, bool short_names=false, bool degap=false) const throw (Exception);
     void read_fastq(istream & input, vector<Fasta_entry> & seqs) const throw (Exception);
     void read_graph(istream & input, vector<Fasta_entry> & seqs, bool short_names) const throw (Exception);
@@ -80,6 +94,16 @@ public:
         output.close();
     }
 
+    void write_alignment(ostream & output, Node *root, string format, bool include_internal_nodes=false) const throw (Exception);
+    void write_alignment(const string & path, Node *root, string format, bool include_internal_nodes=false, bool overwrite=true) const throw (Exception)
+    {
+        string suffix = this->get_format_suffix(format);
+        ofstream output( (path+suffix).c_str(), overwrite ? (ios::out) : (ios::out|ios::app));
+        write_alignment(output, root, format, include_internal_nodes);
+        output.close();
+    }
+
+    bool expand_duplicate_rows(Node *root, const vector<Fasta_entry> &aligned_sequences, vector<Fasta_entry> *expanded, bool include_internal_nodes) const;
     string get_format_suffix(string format) const throw (Exception);
     void write_fasta(ostream & output, const vector<Fasta_entry> & seqs) const throw (Exception);
     void write_interleaved(ostream & output, const vector<Fasta_entry> & seqs) const throw (Exception);
@@ -133,7 +157,9 @@ public:
     bool check_sequence_names(const vector<Fasta_entry> *sequences,const vector<Node*> *leaf_nodes) const;
 
     float* base_frequencies() { return dna_pi; }
+    void set_base_frequencies(const float *pi) { for(int i=0;i<4;i++) dna_pi[i] = pi[i]; }
     int check_sequence_data_type(const vector<Fasta_entry> * sequences) const;
+    int check_sequence_data_type(istream & input, int max_seqs) const;
 
     void place_sequences_to_nodes(const vector<Fasta_entry> *sequences,vector<Node*> *leaf_nodes, bool gapped = false, int data_type = -1);
 
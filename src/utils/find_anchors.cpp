@@ -21,7 +21,9 @@
 #include "utils/find_anchors.h"
 #include "utils/settings_handle.h"
 #include "utils/log_output.h"
+#include "utils/subprocess.h"
 #include <iostream>
+#include <sstream>
 #include <algorithm>
 
 using namespace ppa;
@@ -131,22 +133,26 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
     len1 = seq1->length();
     len2 = seq2->length();
 
-    ofstream h_in("hmmer_in.fas");
-    h_in<<">1\n"<<*seq1<<endl<<">2\n"<<*seq2<<endl;
+    // sequences are fed through stdin: nothing is written in the working directory
+    string h_in = ">1\n"+*seq1+"\n>2\n"+*seq2+"\n";
 
     stringstream command;
-    command <<"hmmsearch --max  pagan.hmm hmmer_in.fas 2>&1";
+    command <<"hmmsearch --max --tformat fasta pagan.hmm - 2>&1";
 
     Log_output::write_out("Hmmer_anchors: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
+    string output;
+    int status = Subprocess::run(command.str(),&h_in,&output);
+    if (status < 0)
     {
         Log_output::write_out("Problems with hmmer pipe.\nExiting.\n",0);
         exit(1);
     }
+    if (status != 0)
+        Log_output::write_out("Hmmer_anchors: hmmsearch returned exit status "+Log_output::itos(status)+".\n",1);
 
-    char line[256];
+    vector<string> lines;
+    Subprocess::split_lines(output,&lines);
 
     int a,g,h,j,k,m,n;
     string b,i,l,o;
@@ -156,21 +162,20 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
     hitS.length = 5;
     hitE.length = 5;
 
-    while ( fgets( line, sizeof line, fpipe))
+    for(int li=0; li<(int)lines.size(); li++)
     {
-        string str(line);
+        string str = lines.at(li);
 
-        cout<<line;
+        cout<<str;
 
         if(str.find(">> 1") != string::npos)
         {
             float minE=10000;
 
-            char *no_warn = fgets( line, sizeof line, fpipe);
-            no_warn = fgets( line, sizeof line, fpipe);
-            while ( fgets( line, sizeof line, fpipe))
+            li += 2;
+            while ( ++li < (int)lines.size() )
             {
-                str = line;
+                str = lines.at(li);
                 if(str.length()<=1)
                     break;
 
@@ -183,7 +188,7 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
                     hitE.start_site_1 = k-h+22;
                     minE = e;
                 }
-                cout<<line;
+                cout<<str;
 //                cout<<e<<" "<<g<<" "<<h<<" "<<j<<" "<<k<<endl;
             }
         }
@@ -191,11 +196,10 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
         {
             float minE=10000;
 
-            char *no_warn =  fgets( line, sizeof line, fpipe);
-            no_warn = fgets( line, sizeof line, fpipe);
-            while ( fgets( line, sizeof line, fpipe))
+            li += 2;
+            while ( ++li < (int)lines.size() )
             {
-                str = line;
+                str = lines.at(li);
                 if(str.length()<=1)
                     break;
 
@@ -209,7 +213,7 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
                     minE = e;
                 }
 
-                cout<<line;
+                cout<<str;
 //                cout<<e<<" "<<g<<" "<<h<<" "<<j<<" "<<k<<endl;
             }
         }
@@ -218,8 +222,6 @@ void Find_anchors::find_hmmer_anchors(std::string *seq1,std::string *seq2,std::v
     hits->push_back(hitE);
     cout<<"anchor: "<<hitS.start_site_1<<" "<<hitS.start_site_2<<endl;
     cout<<"anchor: "<<hitE.start_site_1<<" "<<hitE.start_site_2<<endl;
-    pclose(fpipe);
-
 }
 
 void Find_anchors::check_hits_order_conflict(std::string *seq1,std::string *seq2,vector<Substring_hit> *hits)
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/frame_translation.h"
+
+using namespace std;
+using namespace ppa;
+
+Frame_translation::Frame_translation()
+{
+    for(int i=0;i<64;i++)
+        codon_table[i] = 0;
+}
+
+void Frame_translation::index_codons(const map<string,string> &codon_to_aa)
+{
+    string bases = "ACGT";
+
+    for(int i=0;i<64;i++)
+    {
+        string codon;
+        codon += bases.at(i>>4);
+        codon += bases.at((i>>2)&3);
+        codon += bases.at(i&3);
+
+        map<string,string>::const_iterator it = codon_to_aa.find(codon);
+        if(it != codon_to_aa.end() && it->second.length() == 1)
+            codon_table[i] = it->second.at(0);
+        else
+            codon_table[i] = 0;
+    }
+}
+
+/*
+ * Frames 0-2 are the forward frames starting at positions 0-2, frames 3-5
+ * those of the reverse complement starting at its positions 0-2. The
+ * forward and the reverse codon of every window are packed in the same
+ * pass; codons that cannot be indexed are given the character 'unknown'.
+ */
+void Frame_translation::translate_six_frames(const string &dna, string *frames, char unknown) const
+{
+    int length = dna.length();
+
+    for(int f=0;f<3;f++)
+    {
+        int n_codons = length>f ? (length-f)/3 : 0;
+
+        frames[f].clear();
+        frames[f].reserve(n_codons);
+        frames[f+3].assign(n_codons,unknown);
+    }
+
+    int fwd = 0;
+    int rev = 0;
+    int last_unknown = -1;
+
+    for(int p=0;p<length;p++)
+    {
+        int c = base_code(dna[p]);
+        if(c<0)
+        {
+            last_unknown = p;
+            c = 0;
+        }
+
+        fwd = ((fwd<<2)|c)&63;
+        rev = (rev>>2)|((3-c)<<4);
+
+        if(p<2)
+            continue;
+
+        int s = p-2;
+
+        char f_aa = unknown;
+        char r_aa = unknown;
+        if(last_unknown < s)
+        {
+            if(codon_table[fwd] != 0)
+                f_aa = codon_table[fwd];
+            if(codon_table[rev] != 0)
+                r_aa = codon_table[rev];
+        }
+
+        frames[s%3].push_back(f_aa);
+
+        int r = length-3-s;
+        frames[3+r%3].at(r/3) = r_aa;
+    }
+}
+
+string Frame_translation::reverse_complement(const string &dna)
+{
+    string rev(dna.rbegin(),dna.rend());
+
+    for(string::iterator it = rev.begin(); it != rev.end(); it++)
+    {
+        switch(*it)
+        {
+            case 'A': *it = 'T'; break;
+            case 'T': *it = 'A'; break;
+            case 'C': *it = 'G'; break;
+            case 'G': *it = 'C'; break;
+            case 'R': *it = 'Y'; break;
+            case 'Y': *it = 'R'; break;
+            case 'K': *it = 'M'; break;
+            case 'M': *it = 'K'; break;
+            case 'B': *it = 'V'; break;
+            case 'V': *it = 'B'; break;
+            case 'D': *it = 'H'; break;
+            case 'H': *it = 'D'; break;
+            default: break;
+        }
+    }
+
+    return rev;
+}
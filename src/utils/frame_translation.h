@@ -0,0 +1,80 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FRAME_TRANSLATION_H
+#define FRAME_TRANSLATION_H
+
+/*
+ * Codon translation through a flat table. The three bases of a codon are
+ * packed two bits each (A=0, C=1, G=2, T=3) into an index of a 64-entry
+ * table that is filled from the codon map of the caller, so the genetic
+ * code (standard or mitochondrial) and the handling of stop codons stay
+ * those of the map. Codons with other characters are left to the caller.
+ */
+
+#include <string>
+#include <map>
+
+using namespace std;
+
+namespace ppa {
+
+class Frame_translation
+{
+    char codon_table[64];
+
+    static int base_code(char c)
+    {
+        switch(c)
+        {
+            case 'A': return 0;
+            case 'C': return 1;
+            case 'G': return 2;
+            case 'T': return 3;
+            default:  return -1;
+        }
+    }
+
+public:
+    Frame_translation();
+
+    void index_codons(const map<string,string> &codon_to_aa);
+
+    // Amino acid of the codon starting at 'codon' or 0 if the codon
+    // has other characters than ACGT or is not in the codon map
+    char translate_codon(const char *codon) const
+    {
+        int a = base_code(codon[0]);
+        int b = base_code(codon[1]);
+        int c = base_code(codon[2]);
+
+        if(a<0 || b<0 || c<0)
+            return 0;
+
+        return codon_table[(a<<4)|(b<<2)|c];
+    }
+
+    void translate_six_frames(const string &dna, string *frames, char unknown = 'X') const;
+
+    static string reverse_complement(const string &dna);
+};
+}
+
+#endif // FRAME_TRANSLATION_H
@@ -0,0 +1,222 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cstring>
+#include "utils/gzip_input.h"
+
+using namespace std;
+using namespace ppa;
+
+namespace
+{
+    unsigned int get_le16(const char *p)
+    {
+        const unsigned char *u = (const unsigned char*) p;
+        return u[0] | (u[1]<<8);
+    }
+
+    unsigned int get_le32(const char *p)
+    {
+        const unsigned char *u = (const unsigned char*) p;
+        return u[0] | (u[1]<<8) | (u[2]<<16) | ((unsigned int)u[3]<<24);
+    }
+}
+
+bool Gzip_input::is_gzip(const char *data, size_t length)
+{
+    return length >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+
+void Gzip_input::decompress(const char *data, size_t length, string *output, int n_threads) const throw (IOException)
+{
+    vector<Block> blocks;
+    if(this->find_bgzf_blocks(data, length, &blocks))
+        this->inflate_bgzf(data, blocks, output, n_threads);
+    else
+        this->inflate_gzip(data, length, output);
+}
+
+bool Gzip_input::find_bgzf_blocks(const char *data, size_t length, vector<Block> *blocks) const
+{
+    // Every member has to carry the 'BC' field; anything else is read as plain gzip.
+    size_t pos = 0;
+    size_t out_pos = 0;
+
+    while(pos < length)
+    {
+        if(length-pos < 18 || !is_gzip(data+pos, length-pos) || data[pos+2] != 8 || !(data[pos+3] & 4))
+            return false;
+
+        size_t xlen = get_le16(data+pos+10);
+        if(length-pos < 12+xlen)
+            return false;
+
+        size_t block_size = 0;
+        for(size_t x = pos+12; x+4 <= pos+12+xlen; )
+        {
+            size_t slen = get_le16(data+x+2);
+            if(data[x] == 'B' && data[x+1] == 'C' && slen == 2 && x+6 <= pos+12+xlen)
+                block_size = get_le16(data+x+4) + 1;
+            x += 4+slen;
+        }
+
+        if(block_size < 12+xlen+8 || length-pos < block_size)
+            return false;
+
+        Block b;
+        b.offset = pos+12+xlen;
+        b.length = block_size-12-xlen-8;
+        b.crc = get_le32(data+pos+block_size-8);
+        b.out_length = get_le32(data+pos+block_size-4);
+        b.out_offset = out_pos;
+        blocks->push_back(b);
+
+        out_pos += b.out_length;
+        pos += block_size;
+    }
+
+    return blocks->size() > 0;
+}
+
+void Gzip_input::inflate_bgzf(const char *data, const vector<Block> &blocks, string *output, int n_threads) const throw (IOException)
+{
+    const Block &last = blocks.back();
+    output->assign(last.out_offset+last.out_length, '\0');
+    if(output->empty())
+        return;
+
+    char *out = &(*output)[0];
+    int n_blocks = blocks.size();
+    int failed = -1;
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,16)
+    for(int i=0;i<n_blocks;i++)
+    {
+        const Block &b = blocks.at(i);
+        if(b.out_length == 0)
+            continue;
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        bool ok = inflateInit2(&zs, -MAX_WBITS) == Z_OK;
+        if(ok)
+        {
+            zs.next_in = (Bytef*)(data+b.offset);
+            zs.avail_in = b.length;
+            zs.next_out = (Bytef*)(out+b.out_offset);
+            zs.avail_out = b.out_length;
+
+            ok = ::inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out == b.out_length &&
+                 crc32(0L, (const Bytef*)(out+b.out_offset), b.out_length) == b.crc;
+            inflateEnd(&zs);
+        }
+
+        if(!ok)
+        {
+            #pragma omp critical (gzip_input_error)
+            {
+                if(failed < 0 || i < failed)
+                    failed = i;
+            }
+        }
+    }
+
+    if(failed >= 0)
+        throw IOException("Gzip_input::decompress. Corrupted BGZF block.");
+}
+
+void Gzip_input::inflate_gzip(const char *data, size_t length, string *output) const throw (IOException)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, 16+MAX_WBITS) != Z_OK)
+        throw IOException("Gzip_input::decompress. Failed to initialise zlib.");
+
+    output->clear();
+    vector<char> chunk(262144);
+    size_t in_pos = 0;
+
+    // zlib counts the input in 32-bit units; large files are fed in pieces
+    while(true)
+    {
+        if(zs.avail_in == 0 && in_pos < length)
+        {
+            size_t n = min(length-in_pos, (size_t)1<<30);
+            zs.next_in = (Bytef*)(data+in_pos);
+            zs.avail_in = n;
+            in_pos += n;
+        }
+
+        zs.next_out = (Bytef*)&chunk[0];
+        zs.avail_out = chunk.size();
+
+        int ret = ::inflate(&zs, Z_NO_FLUSH);
+        output->append(&chunk[0], chunk.size()-zs.avail_out);
+
+        if(ret == Z_STREAM_END)
+        {
+            size_t consumed = in_pos-zs.avail_in;
+            if(is_gzip(data+consumed, length-consumed))
+            {
+                inflateReset(&zs);
+                continue;
+            }
+            break;
+        }
+
+        if((ret != Z_OK && ret != Z_BUF_ERROR) || (ret == Z_BUF_ERROR && zs.avail_in == 0 && in_pos == length))
+        {
+            inflateEnd(&zs);
+            throw IOException("Gzip_input::decompress. Corrupted or truncated gzip file.");
+        }
+    }
+
+    inflateEnd(&zs);
+}
+
+/****************************************************************************************/
+
+Gzip_streambuf::Gzip_streambuf(const string &path)
+{
+    file = gzopen(path.c_str(), "rb");
+    setg(buffer, buffer, buffer);
+}
+
+Gzip_streambuf::~Gzip_streambuf()
+{
+    if(file != 0)
+        gzclose(file);
+}
+
+int Gzip_streambuf::underflow()
+{
+    if(gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if(file == 0)
+        return traits_type::eof();
+
+    int n = gzread(file, buffer, sizeof(buffer));
+    if(n <= 0)
+        return traits_type::eof();
+
+    setg(buffer, buffer, buffer+n);
+    return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,86 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef GZIP_INPUT_H
+#define GZIP_INPUT_H
+
+/*
+ * Reading of gzip-compressed input files. Plain gzip files, also ones
+ * made of concatenated members, are inflated with a single zlib stream.
+ * BGZF files (as written by bgzip) are series of independent gzip members
+ * of at most 64 kB whose headers give the compressed block size in a 'BC'
+ * extra field and whose trailers give the inflated size; their blocks are
+ * located first and then inflated in parallel, each directly into its
+ * own place in the output. Gzip_streambuf reads a file through zlib's
+ * gzFile for the istream readers; uncompressed files pass through as such.
+ */
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <zlib.h>
+#include "utils/exceptions.h"
+
+using namespace std;
+
+namespace ppa
+{
+
+class Gzip_input
+{
+    struct Block
+    {
+        size_t offset;
+        size_t length;
+        size_t out_offset;
+        size_t out_length;
+        unsigned int crc;
+    };
+
+    bool find_bgzf_blocks(const char *data, size_t length, vector<Block> *blocks) const;
+    void inflate_bgzf(const char *data, const vector<Block> &blocks, string *output, int n_threads) const throw (IOException);
+    void inflate_gzip(const char *data, size_t length, string *output) const throw (IOException);
+
+public:
+    static bool is_gzip(const char *data, size_t length);
+    void decompress(const char *data, size_t length, string *output, int n_threads=1) const throw (IOException);
+};
+
+class Gzip_streambuf : public streambuf
+{
+    gzFile file;
+    char buffer[65536];
+
+    Gzip_streambuf(const Gzip_streambuf &);
+    Gzip_streambuf &operator=(const Gzip_streambuf &);
+
+protected:
+    int underflow();
+
+public:
+    Gzip_streambuf(const string &path);
+    ~Gzip_streambuf();
+
+    bool is_open() const { return file != 0; }
+};
+
+}
+
+#endif // GZIP_INPUT_H
@@ -25,11 +25,16 @@
 #include "utils/fasta_reader.h"
 #include "utils/mafft_alignment.h"
 #include "utils/bppancestors.h"
+#include "utils/ancestral_reconstruction.h"
 #include "utils/bppdist_tree.h"
+#include "utils/kmer_distance.h"
+#include "utils/nj_tree.h"
 #include "utils/bppphysamp_tree.h"
+#include "utils/tree_sampler.h"
 #include "utils/raxml_tree.h"
 #include "utils/exonerate_queries.h"
 #include "utils/xml_writer.h"
+#include "utils/tree_snapshot.h"
 #include "utils/model_factory.h"
 #include "utils/evol_model.h"
 #include "main/node.h"
@@ -170,16 +175,22 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
         try {
             root = nr.parenthesis_to_tree(tree);
         }
-        catch(exception e)
+        catch(const exception &e)
         {
             Log_output::write_out("The guide tree should be a rooted binary tree. Trying mid-point rooting.\n\n",0);
 
             Tree_node tn;
             tree = tn.get_rooted_tree(tree);
-            root = nr.parenthesis_to_tree(tree);
-        }
 
-        root = nr.parenthesis_to_tree(tree);
+            try {
+                root = nr.parenthesis_to_tree(tree);
+            }
+            catch(const exception &e)
+            {
+                Log_output::write_out("Error reading the guide tree file '"+treefile+"'.\nExiting.\n\n",0);
+                exit(1);
+            }
+        }
     }
     else if(Settings_handle::st.is("ref-treefile"))
     {
@@ -200,7 +211,7 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
         try {
             root = nr.parenthesis_to_tree(tree);
         }
-        catch(exception e)
+        catch(const exception &e)
         {
             Log_output::write_out("The reference guide tree should be a rooted binary tree. \nExiting.\n\n",0);
             exit(1);
@@ -290,32 +301,14 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
 
             int data_type = fr->check_sequence_data_type(sequences);
 
-            if(reference_alignment && rt.test_executable())
+            if(Settings_handle::st.is("kmer-guidetree"))
             {
-                bool is_protein = (data_type==Model_factory::protein);
-
-                vector<Fasta_entry> *input = sequences;
-                vector<Fasta_entry> translated;
-
-                if(Settings_handle::st.is("codons") && data_type==Model_factory::dna)
-                {
-                    this->translate_codons(sequences,&translated);
-                    input = &translated;
-                    is_protein = true;
-                }
-
-                Log_output::write_msg("Computing BppDist guidetree for the given input alignment.",0);
-                string tree = rt.infer_phylogeny(sequences,is_protein,n_threads);
-
-                Tree_node tn;
-                tree = tn.get_rooted_tree(tree);
-
-                Newick_reader nr;
-                root = nr.parenthesis_to_tree(tree);
+                root = this->kmer_guidetree(sequences,data_type,n_threads);
             }
-            else if(ma.test_executable() && rt.test_executable())
+            else if(reference_alignment || ma.test_executable())
             {
                 bool is_protein = (data_type==Model_factory::protein);
+                bool use_bppdist = !Settings_handle::st.is("bionj-tree") && rt.test_executable();
 
                 vector<Fasta_entry> *input = sequences;
                 vector<Fasta_entry> translated;
@@ -327,11 +320,26 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
                     is_protein = true;
                 }
 
-                Log_output::write_msg("Computing an initial alignment with MAFFT.",0);
-                ma.align_sequences(input);
+                string source = "the given input alignment";
+                if(!reference_alignment)
+                {
+                    Log_output::write_msg("Computing an initial alignment with MAFFT.",0);
+                    ma.align_sequences(input);
+                    source = "the initial alignment";
+                }
 
-                Log_output::write_msg("Computing BppDist guidetree for the initial alignment.",0);
-                string tree = rt.infer_phylogeny(input,is_protein,n_threads);
+                string tree;
+                if(use_bppdist)
+                {
+                    Log_output::write_msg("Computing BppDist guidetree for "+source+".",0);
+                    tree = rt.infer_phylogeny(input,is_protein,n_threads);
+                }
+                else
+                {
+                    Log_output::write_msg("Computing BIONJ guidetree for "+source+".",0);
+                    Nj_tree nj;
+                    tree = nj.infer_phylogeny(input,is_protein,n_threads);
+                }
 
                 Tree_node tn;
                 tree = tn.get_rooted_tree(tree);
@@ -341,10 +349,9 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
             }
             else
             {
-                Log_output::write_out("\nError: No tree file defined. MAFFT and/or BppDist not found.\n",0);
-                Settings_handle::st.info();
+                Log_output::write_out("Warning: MAFFT not found. Using k-mer distances for the guidetree.\n",1);
 
-                exit(1);
+                root = this->kmer_guidetree(sequences,data_type,n_threads);
             }
         }
 
@@ -364,6 +371,34 @@ Node *Input_output_parser::parse_input_tree(Fasta_reader *fr,vector<Fasta_entry>
 
 /************************************************************************************/
 
+Node * Input_output_parser::kmer_guidetree(vector<Fasta_entry> *sequences, int data_type, int n_threads)
+{
+    bool is_protein = (data_type==Model_factory::protein);
+
+    vector<Fasta_entry> *input = sequences;
+    vector<Fasta_entry> translated;
+
+    if(Settings_handle::st.is("codons") && data_type==Model_factory::dna)
+    {
+        this->translate_codons(sequences,&translated);
+        input = &translated;
+        is_protein = true;
+    }
+
+    Log_output::write_msg("Computing k-mer distance guidetree for the input sequences.",0);
+
+    Kmer_distance kd;
+    string tree = kd.infer_phylogeny(input,is_protein,n_threads);
+
+    Tree_node tn;
+    tree = tn.get_rooted_tree(tree);
+
+    Newick_reader nr;
+    return nr.parenthesis_to_tree(tree);
+}
+
+/************************************************************************************/
+
 void Input_output_parser::match_sequences_and_tree(Fasta_reader *fr, std::vector<Fasta_entry> *sequences,Node *root,bool reference_alignment,int *data_type)
 {
     /***********************************************************************/
@@ -448,7 +483,58 @@ void Input_output_parser::define_alignment_model(Fasta_reader *fr,Model_factory
 
 /************************************************************************************/
 
-void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<Fasta_entry> *sequences,Node *root)
+Node *Input_output_parser::read_reference_snapshot(Fasta_reader *fr,int *data_type)
+{
+    if(Settings_handle::st.is("ref-seqfile") || Settings_handle::st.is("ref-treefile") ||
+       Settings_handle::st.is("seqfile") || Settings_handle::st.is("treefile"))
+    {
+        Log_output::write_out("Incorrect command: '--ref-snapshot' replaces the reference alignment and tree files.\nExiting.\n\n",0);
+        exit(1);
+    }
+
+    string snapshotfile =  Settings_handle::st.get("ref-snapshot").as<string>();
+    Log_output::write_out("Reference snapshot file: "+snapshotfile+"\n",1);
+    Log_output::write_header("Reading reference snapshot",0);
+
+    Node *root;
+    float dna_pi[4];
+    try
+    {
+        Tree_snapshot ts;
+        root = ts.read(snapshotfile,data_type,dna_pi);
+    }
+    catch (ppa::IOException& e) {
+        Log_output::write_out("Error reading the reference snapshot file '"+snapshotfile+"': "+e.what()+"\nExiting.\n\n",0);
+        exit(1);
+    }
+
+    fr->set_base_frequencies(dna_pi);
+
+    return root;
+}
+
+/************************************************************************************/
+
+void Input_output_parser::save_reference_snapshot(Fasta_reader *fr,Node *root,int data_type)
+{
+    string snapshotfile =  Settings_handle::st.get("save-ref-snapshot").as<string>();
+
+    try
+    {
+        Tree_snapshot ts;
+        ts.write(snapshotfile,root,data_type,fr->base_frequencies());
+    }
+    catch (ppa::IOException& e) {
+        Log_output::write_out("Error writing the reference snapshot file '"+snapshotfile+"': "+e.what()+"\n",0);
+        return;
+    }
+
+    Log_output::write_out("Reference snapshot file: "+snapshotfile+"\n",1);
+}
+
+/************************************************************************************/
+
+void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<Fasta_entry> *sequences,Node *root,Model_factory *mf,int n_threads)
 {
 
     /***********************************************************************/
@@ -462,8 +548,18 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
 
 
 
+    bool do_ancestors = Settings_handle::st.is("events") || Settings_handle::st.is("output-ancestors") || Settings_handle::st.is("xml") || Settings_handle::st.is("xml-nhx");
+
+    bool do_translation = Settings_handle::st.is("translate") || Settings_handle::st.is("mt-translate")
+                            || Settings_handle::st.is("find-best-orf") || Settings_handle::st.is("find-orfs");
+
+    // The full alignment, with the internal nodes, is only kept if something
+    // other than the plain alignment output needs it
+    //
     vector<Fasta_entry> aligned_sequences;
-    root->get_alignment(&aligned_sequences,true);
+    if( do_ancestors || do_translation ||
+          Settings_handle::st.is("prune-extended-alignment") || Settings_handle::st.is("trim-extended-alignment") )
+        root->get_alignment(&aligned_sequences,true);
 
     Log_output::clean_output();
 
@@ -492,21 +588,20 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
         else
             Log_output::write_out("Alignment file: "+outfile+fr->get_format_suffix(format)+"\n",0);
 
-        if(!Settings_handle::st.is("treefile") && !Settings_handle::st.is("ref-treefile"))
+        if(!Settings_handle::st.is("treefile") && !Settings_handle::st.is("ref-treefile") && !Settings_handle::st.is("ref-snapshot"))
             Log_output::write_out("Guidetree file: "+outfile+".tre\n",0);
 
-
-        bool do_ancestors = Settings_handle::st.is("events") || Settings_handle::st.is("output-ancestors") || Settings_handle::st.is("xml") || Settings_handle::st.is("xml-nhx");
-
         BppAncestors bppa;
-        bool infer_bppa_ancestors = ( bppa.test_executable() && not Settings_handle::st.is("no-bppancestors") &&
-                                      ( do_ancestors ) &&
-                                      (int)sequences->size()<500 );
+        bool infer_ml_ancestors = ( not Settings_handle::st.is("no-bppancestors") && do_ancestors );
 
-        if(infer_bppa_ancestors)
+        if(infer_ml_ancestors)
         {
-            bool worked = bppa.infer_ancestors(root,&aligned_sequences);
+            Ancestral_reconstruction ar;
+            infer_ml_ancestors = ar.infer_ancestors(root,&aligned_sequences,mf,n_threads);
+        }
 
+        if(infer_ml_ancestors)
+        {
             bppa.count_events(root,&aligned_sequences,outfile);
 
             if(Settings_handle::st.is("events"))
@@ -520,7 +615,7 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
         }
         else if( do_ancestors )
         {
-            Log_output::write_out("\nWarning: BppAncestors not used. Performing approximate ancestor reconstruction.\n\n",0);
+            Log_output::write_out("\nWarning: ML ancestors not inferred. Performing approximate ancestor reconstruction.\n\n",0);
         }
 
 
@@ -532,16 +627,7 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
         }
         else
         {
-            vector<Fasta_entry> leaf_sequences;
-            set<string> names;
-            root->get_leaf_node_names(&names);
-            vector<Fasta_entry>::iterator si = aligned_sequences.begin();
-            for(;si!=aligned_sequences.end();si++)
-            {
-                if(names.find(si->name) != names.end())
-                    leaf_sequences.push_back(*si);
-            }
-            fr->write(outfile, leaf_sequences, format, true);
+            fr->write_alignment(outfile, root, format, false, true);
         }
 
         // Write alignment as HSAML
@@ -555,8 +641,7 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
             xw.write(outfile, root, aligned_sequences, true);
         }
 
-        if( Settings_handle::st.is("translate") || Settings_handle::st.is("mt-translate")
-            || Settings_handle::st.is("find-best-orf") || Settings_handle::st.is("find-orfs") )
+        if( do_translation )
         {
             string outfile =  "outfile";
             if(Settings_handle::st.is("outfile"))
@@ -589,13 +674,17 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
                         leaf_sequences.push_back(*si);
                     }
                 }
-                fr->backtranslate_dna(leaf_sequences,&dna_seqs,dna_sequences,infer_bppa_ancestors);
+                fr->backtranslate_dna(leaf_sequences,&dna_seqs,dna_sequences,infer_ml_ancestors);
             }
-            else if(infer_bppa_ancestors )
+            else if(infer_ml_ancestors )
             {
-                fr->backtranslate_dna(aligned_sequences,&dna_seqs,dna_sequences,infer_bppa_ancestors);
+                fr->backtranslate_dna(aligned_sequences,&dna_seqs,dna_sequences,infer_ml_ancestors);
 
-                ancestors_done = bppa.infer_ancestors(root,&dna_sequences,true);
+                Model_factory cmf(int(Model_factory::codon));
+                cmf.codon_model(&Settings_handle::st);
+
+                Ancestral_reconstruction ar;
+                ancestors_done = ar.infer_ancestors(root,&dna_sequences,&cmf,n_threads);
 
                 if( ancestors_done )
                 {
@@ -841,9 +930,6 @@ void Input_output_parser::output_aligned_sequences(Fasta_reader *fr,std::vector<
 
 void Input_output_parser::prune_extended_alignment(Fasta_reader *fr,Node *root,vector<Fasta_entry> *aligned_sequences)
 {
-    bool is_protein = root->get_sequence()->get_data_type()==Model_factory::protein;
-
-
     if(Settings_handle::st.is("prune-keep-number"))
     {
 
@@ -857,25 +943,19 @@ void Input_output_parser::prune_extended_alignment(Fasta_reader *fr,Node *root,v
         set<string> readnames;
         root->get_read_node_names(&readnames);
 
-        if(Settings_handle::st.get("prune-keep-number").as<int>()>1)
+        if(Settings_handle::st.get("prune-keep-number").as<int>()>1 || Settings_handle::st.is("prune-keep-threshold"))
         {
-            BppPhySamp_tree bppphys;
-            if(bppphys.test_executable())
-            {
-                removenames.clear();
-                bppphys.reduce_sequences(&removenames,is_protein);
+            removenames.clear();
 
-                tmp_root->set_has_sequence();
-                tmp_root->unset_has_sequence(&removenames);
-                tmp_root->set_has_sequence(&readnames);
-                tmp_root->prune_tree();
+            Tree_sampler ts;
+            ts.reduce_sequences(root,aligned_sequences,&readnames,&removenames);
 
-                this->output_pruned_alignment(fr,root,tmp_root,aligned_sequences,"Pruned",".pruned");
-            }
-            else
-            {
-                Log_output::write_out("The executable for BppPhySamp not found! The alignment cannot be pruned!",0);
-            }
+            tmp_root->set_has_sequence();
+            tmp_root->unset_has_sequence(&removenames);
+            tmp_root->set_has_sequence(&readnames);
+            tmp_root->prune_tree();
+
+            this->output_pruned_alignment(fr,root,tmp_root,aligned_sequences,"Pruned",".pruned");
         }
         else
         {
@@ -39,9 +39,12 @@ public:
     Node * parse_input_tree(ppa::Fasta_reader *fr,vector<Fasta_entry> *sequences, bool reference_alignment, int n_threads);
     void match_sequences_and_tree(ppa::Fasta_reader *fr,vector<Fasta_entry> *sequences, Node *root, bool reference_alignment,int *data_type);
     void define_alignment_model(ppa::Fasta_reader *fr,Model_factory *mf, int data_type);
-    void output_aligned_sequences(ppa::Fasta_reader *fr,vector<Fasta_entry> *sequences, Node *root);
+    Node * read_reference_snapshot(ppa::Fasta_reader *fr,int *data_type);
+    void save_reference_snapshot(ppa::Fasta_reader *fr,Node *root,int data_type);
+    void output_aligned_sequences(ppa::Fasta_reader *fr,vector<Fasta_entry> *sequences, Node *root, Model_factory *mf, int n_threads);
     void prune_extended_alignment(Fasta_reader *fr,Node *root,vector<Fasta_entry> *aligned_sequences);
     void output_pruned_alignment(Fasta_reader *fr,Node *root,Node *tmp_root,vector<Fasta_entry> *aligned_sequences,string desc, string prefix);
+    Node * kmer_guidetree(vector<Fasta_entry> *sequences, int data_type, int n_threads);
 
 
     void translate_codons(vector<Fasta_entry> *sequences, vector<Fasta_entry> *translated)
@@ -0,0 +1,211 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/kmer_distance.h"
+#include "utils/nj_tree.h"
+#include "utils/log_output.h"
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+using namespace std;
+using namespace ppa;
+
+Kmer_distance::Kmer_distance()
+{
+    kmer_length = 0;
+    sketch_size = 500;
+    bits_per_char = 2;
+
+    if(Settings_handle::st.is("kmer-sketch-size"))
+        sketch_size = Settings_handle::st.get("kmer-sketch-size").as<int>();
+}
+
+/************************************************************************************/
+
+void Kmer_distance::define_alphabet(bool is_protein)
+{
+    for(int i=0;i<256;i++)
+        char_code[i] = -1;
+
+    string alphabet = "ACGT";
+    bits_per_char = 2;
+    kmer_length = 10;
+
+    if(is_protein)
+    {
+        alphabet = "ACDEFGHIKLMNPQRSTVWY";
+        bits_per_char = 5;
+        kmer_length = 4;
+    }
+
+    for(int i=0;i<(int)alphabet.length();i++)
+    {
+        char_code[(unsigned char)alphabet.at(i)] = i;
+        char_code[(unsigned char)tolower(alphabet.at(i))] = i;
+    }
+
+    if(!is_protein)
+    {
+        char_code[(unsigned char)'U'] = 3;
+        char_code[(unsigned char)'u'] = 3;
+    }
+
+    if(Settings_handle::st.is("kmer-length"))
+        kmer_length = Settings_handle::st.get("kmer-length").as<int>();
+
+    int max_length = 64/bits_per_char;
+    if(kmer_length > max_length)
+        kmer_length = max_length;
+    if(kmer_length < 1)
+        kmer_length = 1;
+}
+
+/************************************************************************************/
+
+void Kmer_distance::sketch_sequence(const string *sequence, vector<unsigned long long> *sketch)
+{
+    unsigned long long mask = ~0ULL;
+    if(kmer_length*bits_per_char < 64)
+        mask = (1ULL<<(kmer_length*bits_per_char))-1;
+
+    unsigned long long kmer = 0;
+    int valid = 0;
+
+    sketch->reserve(sequence->length());
+
+    for(int i=0;i<(int)sequence->length();i++)
+    {
+        char c = sequence->at(i);
+        if(c=='-' || c=='.')
+            continue;
+
+        int code = char_code[(unsigned char)c];
+        if(code<0)
+        {
+            valid = 0;
+            kmer = 0;
+            continue;
+        }
+
+        kmer = ((kmer<<bits_per_char) | code) & mask;
+        valid++;
+
+        if(valid>=kmer_length)
+            sketch->push_back(hash_kmer(kmer));
+    }
+
+    sort(sketch->begin(),sketch->end());
+    sketch->erase(unique(sketch->begin(),sketch->end()),sketch->end());
+
+    if(sketch_size>0 && (int)sketch->size()>sketch_size)
+        sketch->resize(sketch_size);
+
+    vector<unsigned long long>(*sketch).swap(*sketch);
+}
+
+/************************************************************************************/
+
+float Kmer_distance::sketch_distance(const vector<unsigned long long> *s1, const vector<unsigned long long> *s2)
+{
+    int n1 = s1->size();
+    int n2 = s2->size();
+
+    // Bottom-s estimate of the Jaccard index: walk the merged sketches
+    // until s union elements have been seen and count the shared ones.
+    int limit = n1+n2;
+    if(sketch_size>0 && sketch_size<limit)
+        limit = sketch_size;
+
+    int i=0, j=0, shared=0, total=0;
+    while(total<limit && i<n1 && j<n2)
+    {
+        unsigned long long a = (*s1)[i];
+        unsigned long long b = (*s2)[j];
+        if(a<b)
+            i++;
+        else if(b<a)
+            j++;
+        else
+        {
+            shared++;
+            i++;
+            j++;
+        }
+        total++;
+    }
+    if(total<limit)
+        total += min(limit-total, (n1-i)+(n2-j));
+
+    if(shared==0 || total==0)
+        return 1.0;
+
+    float jaccard = float(shared)/total;
+    float dist = -1.0/kmer_length*log(2.0*jaccard/(1.0+jaccard));
+
+    if(dist<0)
+        dist = 0;
+    if(dist>1.0)
+        dist = 1.0;
+
+    return dist;
+}
+
+/************************************************************************************/
+
+void Kmer_distance::compute_distances(vector<Fasta_entry> *sequences, bool is_protein, int n_threads, vector<float> *distances)
+{
+    this->define_alphabet(is_protein);
+
+    int n = sequences->size();
+    vector< vector<unsigned long long> > sketches(n);
+
+    if(n_threads<1)
+        n_threads = 1;
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,16)
+    for(int i=0;i<n;i++)
+        this->sketch_sequence(&sequences->at(i).sequence,&sketches[i]);
+
+    distances->assign((size_t)n*(n-1)/2,0);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,1)
+    for(int i=1;i<n;i++)
+    {
+        size_t row = (size_t)i*(i-1)/2;
+        for(int j=0;j<i;j++)
+            (*distances)[row+j] = this->sketch_distance(&sketches[i],&sketches[j]);
+    }
+}
+
+/************************************************************************************/
+
+string Kmer_distance::infer_phylogeny(vector<Fasta_entry> *sequences, bool is_protein, int n_threads)
+{
+    vector<float> distances;
+    this->compute_distances(sequences,is_protein,n_threads,&distances);
+
+    vector<string> names;
+    for(int i=0;i<(int)sequences->size();i++)
+        names.push_back(sequences->at(i).name);
+
+    Nj_tree nj;
+    return nj.infer_phylogeny(&names,&distances,n_threads);
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef KMER_DISTANCE_H
+#define KMER_DISTANCE_H
+
+/*
+ * Alignment-free distances for guide tree computation.
+ * Each sequence is reduced to a bottom-s sketch of hashed k-mers and the
+ * pairwise Jaccard estimates are converted to Mash distances.
+ */
+
+#include "utils/settings_handle.h"
+#include "utils/fasta_entry.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace ppa {
+
+class Kmer_distance
+{
+    int kmer_length;
+    int sketch_size;
+    int bits_per_char;
+    int char_code[256];
+
+    static unsigned long long hash_kmer(unsigned long long key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    void define_alphabet(bool is_protein);
+    void sketch_sequence(const string *sequence, vector<unsigned long long> *sketch);
+    float sketch_distance(const vector<unsigned long long> *s1, const vector<unsigned long long> *s2);
+
+public:
+    Kmer_distance();
+
+    // Packed lower triangle: d(i,j), i>j, is at i*(i-1)/2+j
+    void compute_distances(vector<Fasta_entry> *sequences, bool is_protein, int n_threads, vector<float> *distances);
+    string infer_phylogeny(vector<Fasta_entry> *sequences, bool is_protein, int n_threads);
+};
+}
+
+#endif // KMER_DISTANCE_H
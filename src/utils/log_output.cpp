@@ -20,6 +20,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <boost/thread/recursive_mutex.hpp>
 
 #include "utils/log_output.h"
 #include "utils/settings_handle.h"
@@ -45,6 +46,14 @@ string Log_output::prev_header;
 string Log_output::prev_msg;
 string Log_output::prev_msg2;
 
+// Candidate nodes may be aligned in parallel and write to the log; the
+// writers lock the stream and the message lengths together. The lock is
+// recursive as the writers call each other.
+namespace
+{
+    boost::recursive_mutex log_mutex;
+}
+
 void Log_output::open_stream()
 {
     if(Settings_handle::st.is("log-output-file"))
@@ -53,6 +62,11 @@ void Log_output::open_stream()
         os = &fs;
         newline = true;
     }
+    else if(Settings_handle::st.is("placement-server"))
+    {
+        // stdout carries the placement results
+        os = &cerr;
+    }
 }
 
 void Log_output::write_out(const string str,const string option)
@@ -60,6 +74,8 @@ void Log_output::write_out(const string str,const string option)
     if(!Settings_handle::st.is(option))
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(msg_length>0)
         *os<<endl;
     *os<<str;
@@ -73,6 +89,8 @@ void Log_output::write_out(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     for(int i=0;i<priority;i++)
         *os<<" ";
     *os<<str;
@@ -83,6 +101,8 @@ void Log_output::write_msg(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(newline || Settings::noise > 0)
     {
         Log_output::write_out(str+"\n",priority);
@@ -111,6 +131,8 @@ void Log_output::append_msg(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(newline || Settings::noise > 0)
     {
         Log_output::write_out(str+"\n",priority);
@@ -137,6 +159,8 @@ void Log_output::write_header(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(newline || Settings::noise > 0)
     {
         Log_output::write_out(str+"\n",priority);
@@ -175,6 +199,8 @@ void Log_output::write_new_header(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(newline || Settings::noise > 0)
     {
         Log_output::write_out(str+"\n",priority);
@@ -202,6 +228,8 @@ void Log_output::write_warning(const string str,const int priority)
     if(priority>Settings::noise)
         return;
 
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     if(newline || Settings::noise > 0)
     {
         Log_output::write_out(str+"\n",priority);
@@ -216,6 +244,8 @@ void Log_output::write_warning(const string str,const int priority)
 
 void Log_output::clean_output()
 {
+    boost::recursive_mutex::scoped_lock lock(log_mutex);
+
     for(int i=0;i<msg_length+msg2_length;i++)
         *os<<'\b';
    for(int i=0;i<msg_length+msg2_length;i++)
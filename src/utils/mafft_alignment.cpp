@@ -91,61 +91,49 @@ bool Mafft_alignment::test_executable()
 
 void Mafft_alignment::align_sequences(vector<Fasta_entry> *sequences)
 {
-    ofstream m_output;
-    string tmp_dir = this->get_temp_dir();
-
     int input_sequences = (int) sequences->size();
 
-    stringstream m_name;
-
-    int r = rand();
-    while(true)
-    {
-        m_name <<tmp_dir<<"m"<<r<<".fas";
-        ifstream m_file(m_name.str().c_str());
-
-        if(!m_file)
-        {
-            m_output.open( m_name.str().c_str(), (ios::out) );
-            break;
-        }
-        r = rand();
-    }
-
+    Subprocess_file m_file("m",".fas");
 
     map<string,string> dna_seqs;
     bool has_dna_seqs = (sequences->at(0).sequence.length() > 0);
 
+    stringstream m_output;
     vector<Fasta_entry>::iterator si = sequences->begin();
     for(;si!=sequences->end();si++)
     {
-        m_output<<">"<<si->name<<endl<<si->sequence<<endl;
+        m_output<<">"<<si->name<<"\n"<<si->sequence<<"\n";
         if(has_dna_seqs)
             dna_seqs.insert(pair<string,string>(si->name,si->dna_sequence));
     }
-    m_output.close();
+    if(!m_file.write(m_output.str()))
+    {
+        Log_output::write_out("Problems writing mafft input.\nExiting.\n",0);
+        exit(1);
+    }
     sequences->clear();
 
 
     stringstream command;
-    command << mafftpath<<"mafft "<<m_name.str()<<" 2>/dev/null";
+    command << mafftpath<<"mafft "<<m_file.get_path();
 
     Log_output::write_out("Mafft: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with mafft pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    string output;
+    int status = Subprocess::run(command.str(),0,&output);
+
+    if(status != 0)
+        Log_output::write_out("Mafft: mafft returned exit status "+Log_output::itos(status)+".\n",1);
 
     // read mafft output
+    vector<string> lines;
+    Subprocess::split_lines(output,&lines);
+
     string name, sequence = "";  // Initialization
-    char temp[256];
 
-    while ( fgets( temp, sizeof temp, fpipe))
+    for(int i=0;i<(int)lines.size();i++)
     {
-    	string line(temp);
+        string line = lines.at(i);
 
         if (line[0] == '>')
         {
@@ -154,20 +142,7 @@ void Mafft_alignment::align_sequences(vector<Fasta_entry> *sequences)
             // If a name and a sequence were found
             if ((name != "") && (sequence != ""))
             {
-                Fasta_entry s;
-                s.name = name;
-                sequence = this->remove_whitespaces(sequence);
-                transform( sequence.begin(), sequence.end(), sequence.begin(), (int(*)(int))toupper );
-                s.sequence = sequence;
-
-                if(has_dna_seqs)
-                {
-                    map<string,string>::iterator it = dna_seqs.find(name);
-                    if(it!=dna_seqs.end())
-                        s.dna_sequence = it->second;
-                }
-
-                sequences->push_back(s);
+                this->add_sequence(sequences,name,sequence,&dna_seqs,has_dna_seqs);
                 name = "";
                 sequence = "";
             }
@@ -176,192 +151,35 @@ void Mafft_alignment::align_sequences(vector<Fasta_entry> *sequences)
         }
         else
         {
-            sequence += temp;  // Sequence isolation
+            sequence += line;  // Sequence isolation
         }
     }
 
     // Addition of the last sequence in file
     if ((name != "") && (sequence != ""))
-    {
-        Fasta_entry s;
-        s.name = name;
-        sequence = this->remove_whitespaces(sequence);
-        transform( sequence.begin(), sequence.end(), sequence.begin(), (int(*)(int))toupper );
-        s.sequence = sequence;
-
-        if(has_dna_seqs)
-        {
-            map<string,string>::iterator it = dna_seqs.find(name);
-            if(it!=dna_seqs.end())
-                s.dna_sequence = it->second;
-        }
-
-        sequences->push_back(s);
-    }
-
-    pclose(fpipe);
-
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
+        this->add_sequence(sequences,name,sequence,&dna_seqs,has_dna_seqs);
 
     if( input_sequences != (int) sequences->size() )
     {
         Log_output::write_out("Problems with mafft.\nExiting.\n",0);
         exit(1);
     }
-
-
 }
 
-void Mafft_alignment::align_sequences_fifo(vector<Fasta_entry> *sequences)
+void Mafft_alignment::add_sequence(vector<Fasta_entry> *sequences,const string &name,string sequence,map<string,string> *dna_seqs,bool has_dna_seqs)
 {
-//    ofstream m_output;
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream m_name;
-
-    int r = rand();
-    while(true)
-    {
-//        stringstream m_name;
-        m_name <<tmp_dir<<"m"<<r<<".fas";
-        ifstream m_file(m_name.str().c_str());
-
-        if(!m_file)
-        {
-//            m_output.open( m_name.str().c_str(), (ios::out) );
-            break;
-        }
-        r = rand();
-    }
-
-
-    map<string,string> dna_seqs;
-    bool has_dna_seqs = (sequences->at(0).sequence.length() > 0);
-
-//    vector<Fasta_entry>::iterator si = sequences->begin();
-//    for(;si!=sequences->end();si++)
-//    {
-//        m_output<<">"<<si->name<<endl<<si->sequence<<endl;
-//        if(has_dna_seqs)
-//            dna_seqs.insert(pair<string,string>(si->name,si->dna_sequence));
-//    }
-//    m_output.close();
-//    sequences->clear();
-
-
-    stringstream command;
-    command << mafftpath<<"mafft "+tmp_dir+"m"<<r<<".fas  2>/dev/null";
-
-    Log_output::write_out("Mafft: command: "+command.str()+"\n",2);
-
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with mafft pipe.\nExiting.\n",0);
-        exit(1);
-    }
-
-    int rv = mkfifo (m_name.str().c_str(), S_IRUSR| S_IWUSR);
-    if (rv < 0) {
-        Log_output::write_out("Problems with mafft fifo.\nExiting.\n",0);
-        exit(1);
-    }
+    Fasta_entry s;
+    s.name = name;
+    sequence = this->remove_whitespaces(sequence);
+    transform( sequence.begin(), sequence.end(), sequence.begin(), (int(*)(int))toupper );
+    s.sequence = sequence;
 
-    FILE *ffifo;
-
-    if((ffifo = fopen(m_name.str().c_str(), "w")) == NULL)
+    if(has_dna_seqs)
     {
-        Log_output::write_out("Problems with mafft fifo.\nExiting.\n",0);
-        exit(1);
+        map<string,string>::iterator it = dna_seqs->find(name);
+        if(it!=dna_seqs->end())
+            s.dna_sequence = it->second;
     }
 
-    vector<Fasta_entry>::iterator si = sequences->begin();
-    for(;si!=sequences->end();si++)
-    {
-        fprintf(ffifo,">%s\n%s\n",si->name.c_str(),si->sequence.c_str());
-
-        if(has_dna_seqs)
-            dna_seqs.insert(pair<string,string>(si->name,si->dna_sequence));
-    }
-    fclose(ffifo);
-    sequences->clear();
-    //
-
-    // read mafft output
-    string name, sequence = "";  // Initialization
-    char temp[256];
-
-    while ( fgets( temp, sizeof temp, fpipe))
-    {
-        string line(temp);
-
-        if (line[0] == '>')
-        {
-            line = this->remove_last_whitespaces(line);
-
-            // If a name and a sequence were found
-            if ((name != "") && (sequence != ""))
-            {
-                Fasta_entry s;
-                s.name = name;
-                sequence = this->remove_whitespaces(sequence);
-                transform( sequence.begin(), sequence.end(), sequence.begin(), (int(*)(int))toupper );
-                s.sequence = sequence;
-
-                if(has_dna_seqs)
-                {
-                    map<string,string>::iterator it = dna_seqs.find(name);
-                    if(it!=dna_seqs.end())
-                        s.dna_sequence = it->second;
-                }
-
-                sequences->push_back(s);
-                name = "";
-                sequence = "";
-            }
-            name = line;
-            name.erase(name.begin());  // Character > deletion
-        }
-        else
-        {
-            sequence += temp;  // Sequence isolation
-        }
-    }
-
-    // Addition of the last sequence in file
-    if ((name != "") && (sequence != ""))
-    {
-        Fasta_entry s;
-        s.name = name;
-        sequence = this->remove_whitespaces(sequence);
-        transform( sequence.begin(), sequence.end(), sequence.begin(), (int(*)(int))toupper );
-        s.sequence = sequence;
-
-        if(has_dna_seqs)
-        {
-            map<string,string>::iterator it = dna_seqs.find(name);
-            if(it!=dna_seqs.end())
-                s.dna_sequence = it->second;
-        }
-
-        sequences->push_back(s);
-    }
-
-    pclose(fpipe);
-
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
-}
-
-void Mafft_alignment::delete_files(int r)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    stringstream m_name;
-    m_name <<tmp_dir<<"m"<<r<<".fas";
-
-    if ( remove( m_name.str().c_str() ) != 0 )
-        Log_output::write_out( "Error deleting file", 1);
+    sequences->push_back(s);
 }
@@ -24,9 +24,10 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <sys/stat.h>
+#include <map>
 #include "utils/settings_handle.h"
 #include "utils/fasta_entry.h"
+#include "utils/subprocess.h"
 
 namespace ppa{
 
@@ -36,20 +37,6 @@ class Mafft_alignment
 {
     string mafftpath;
 
-    std::string get_temp_dir()
-    {
-        std::string tmp_dir = "/tmp/";
-
-        if(Settings_handle::st.is("temp-folder"))
-            tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
-
-        struct stat st;
-        if(stat(tmp_dir.c_str(),&st) != 0)
-            tmp_dir = "";
-
-        return tmp_dir;
-    }
-
     std::string remove_last_whitespaces(const std::string & s)
     {
         // Copy sequence
@@ -87,13 +74,12 @@ class Mafft_alignment
                || (c == '\f');
     }
 
-    void delete_files(int r);
+    void add_sequence(vector<Fasta_entry> *sequences,const string &name,string sequence,map<string,string> *dna_seqs,bool has_dna_seqs);
 
 public:
     Mafft_alignment();
     bool test_executable();
     void align_sequences(vector<Fasta_entry> *sequences);
-    void align_sequences_fifo(vector<Fasta_entry> *sequences);
 };
 }
 
@@ -1827,6 +1827,41 @@ void Model_factory::build_model(int s,Db_matrix *pi,Db_matrix *q,Db_matrix *wU,D
 
 /*******************************************/
 
+void Model_factory::substitution_probabilities(double distance,std::vector<double> *p)
+{
+    // The plain P matrix for the regular alphabet, without the score scaling
+    // of alignment_model().
+    //
+    Eigen* e = new Eigen();
+
+    double* tmr = new double[char_as*char_as];
+    double* twr = new double[char_as];
+    double* twu = new double[char_as*char_as];
+    double* twv = new double[char_as*char_as];
+
+    for(int i=0;i<char_as;i++)
+    {
+        twr[i] = charRoot->g(i);
+
+        for(int j=0;j<char_as;j++)
+        {
+            twu[i*char_as+j] = charU->g(i,j);
+            twv[i*char_as+j] = charV->g(i,j);
+        }
+    }
+
+    e->computePMatrix(char_as,tmr,twu,twv,twr,distance);
+
+    p->assign(tmr,tmr+char_as*char_as);
+
+    delete[] tmr;
+    delete[] twr;
+    delete[] twu;
+    delete[] twv;
+
+    delete e;
+}
+
 Evol_model Model_factory::alignment_model(double distance)
 {
 
@@ -127,6 +127,7 @@ public:
     void codon_model(float ins_rate,float del_rate, float ext_prob, float end_ext_prob);
 
     Evol_model alignment_model(double distance);
+    void substitution_probabilities(double distance,std::vector<double> *p);
 
     void print_int_matrix(Int_matrix *m);
     void print_char_p_matrices(Evol_model &model);
@@ -244,6 +245,10 @@ public:
 
     std::string get_character_in_full_alphabet_at(int i) { return full_character_alphabet->at(i); }
 
+    int get_char_alphabet_size() { return char_as; }
+    double get_char_pi(int i) { return charPi->g(i); }
+    std::vector<Char_symbol> *get_char_symbols() { return &char_symbols; }
+
     int parsimony_state(int parent_state,int child_state) { return parsimony_table->g(parent_state,child_state); }
     int get_child_parsimony_state(int parent_state,int child_state) { return child_parsimony_table->g(parent_state,child_state);}
 };
@@ -100,282 +100,207 @@ string Newick_reader::read_tree(const string & filename) throw (IOException)
 
 /*******************************************/
 
-Node * Newick_reader::parenthesis_to_node(const string & description) throw (Exception)
+Node * Newick_reader::parenthesis_to_tree(const string & description) throw (Exception)
 {
-//    cout<<description<<endl;
-    Newick_reader::Element elt = Newick_reader::get_element(description);
+    string::size_type lastP  = description.rfind(')');
+    if(lastP == string::npos)
+        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no closing parenthesis found.");
+    string::size_type firstP = description.find('(');
+    if(firstP == string::npos)
+        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no opening parenthesis found.");
+    string::size_type semi = description.rfind(';');
+    if(semi == string::npos)
+        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no semi-colon found.");
+    if(lastP <= firstP)
+        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: closing parenthesis before opening parenthesis.");
 
-    //New node:
-    Node * node = new Node();
-    if(!Text_utils::is_empty(elt.length))
-        node->set_distance_to_parent(Text_utils::to_double(elt.length));
-    else
-        node->set_distance_to_parent(0);
+    // The description is read once from left to right. The nodes of each
+    // open parenthesis are kept on a stack until it is closed; internal
+    // nodes are thus completed (and numbered) in post-order.
+    //
+    vector< vector<Node*> > open;
+    Node *root = 0;
+    string::size_type pos = firstP;
 
-    stringstream nhx_tag("");
-    if(!Text_utils::is_empty(elt.nhx))
+    try
     {
-        String_tokenizer * st = new String_tokenizer(elt.nhx, ":", true, false);
-
-        node->set_nhx_tid("");
-        while (st->has_more_token())
+        while(root == 0)
         {
-            string block = st->next_token();
-            block = Text_utils::remove_surrounding_whitespaces(block);
-            if(block.substr(0,4)=="TID=")
+            if(pos >= description.length() || description.at(pos) == ';')
+                throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: unbalanced parentheses.");
+
+            char c = description.at(pos);
+            if(c == '(')
             {
-                block = block.substr(4);
-                node->set_nhx_tid(block);
+                open.push_back(vector<Node*>());
+                pos++;
             }
-            else
+            else if(c == ',')
             {
-                if(nhx_tag.str().length()==0)
-                    nhx_tag<<block;
-                else
-                    nhx_tag<<":"<<block;
+                pos++;
             }
-        }
-        delete st;
-//        node->set_distance_to_parent(Text_utils::to_double(elt.length));
-    }
-    node->set_nhx_tag(nhx_tag.str());
-
-    Node_tokenizer nt(elt.content);
-    vector<string> elements;
-    while(nt.has_next())
-    {
-        elements.push_back(nt.next());
-    }
-
-    if(elements.size() == 1)
-    {
-        //This is a leaf:
-        string name = Text_utils::remove_surrounding_whitespaces(elements[0]);
-        node->set_name(name);
+            else if(c == ')')
+            {
+                pos++;
 
-        node->is_leaf(true);
-    }
-    else if(elements.size()!=2)
-    {
-        // Alignment requires a binary guide tree!
-//        throw Exception("Newick_reader::parenthesis_to_node. Not a binary tree: " + elt.content + ":" + elt.length);
-        throw Exception("The guide tree should be a rooted binary tree. Exiting.\n");
-    }
+                // Alignment requires a binary guide tree!
+                if(open.empty())
+                    throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: unbalanced parentheses.");
+                if(open.back().size() != 2)
+                    throw Exception("The guide tree should be a rooted binary tree. Exiting.\n");
 
-    else
-    {
+                Label label;
+                this->read_label(description,&pos,&label);
 
-        //This is a node: 
-        try
-        {
-            Node * child_0 = parenthesis_to_node(elements[0]);
-            node->add_left_child(child_0);
+                Node * node = new Node();
+                node->add_left_child(open.back().at(0));
+                node->add_right_child(open.back().at(1));
+                open.pop_back();
 
-            Node * child_1 = parenthesis_to_node(elements[1]);
-            node->add_right_child(child_1);
+                this->set_node_label(node,label,open.empty());
 
-//            node->set_name(description);
-            if(elt.nodeid!="")
-            {
-                node->set_name(elt.nodeid);
+                if(open.empty())
+                    root = node;
+                else
+                    open.back().push_back(node);
             }
             else
             {
-                stringstream ss("");
-                ss<<"node"<<node_index;
-                node->set_name(ss.str());
+                Label label;
+                this->read_label(description,&pos,&label);
+
+                //This is a leaf:
+                Node * node = new Node();
+                this->set_node_label(node,label,false);
+                node->set_name(Text_utils::remove_surrounding_whitespaces(label.name));
+                node->is_leaf(true);
+
+                open.back().push_back(node);
             }
-            node_index++;
-            node->is_leaf(false);
-        }
-        catch(exception e)
-        {
-            throw e;
         }
     }
-    return node;
+    catch(Exception &e)
+    {
+        for(unsigned int i=0;i<open.size();i++)
+            for(unsigned int j=0;j<open.at(i).size();j++)
+                delete open.at(i).at(j);
+        throw;
+    }
+
+    return root;
 }
 
 /*******************************************/
 
-Node * Newick_reader::parenthesis_to_tree(const string & description) throw (Exception)
+void Newick_reader::read_label(const string & description, string::size_type *pos, Label *label) const throw (Exception)
 {
-    string::size_type lastP  = description.rfind(')');
-    if(lastP == string::npos)
-        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no closing parenthesis found.");
-    string::size_type firstP = description.find('(');
-    if(firstP == string::npos)
-        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no opening parenthesis found.");
-    string::size_type semi = description.rfind(';');
-    if(semi == string::npos)
-        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no semi-colon found.");
-    if(lastP <= firstP)
-        throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: closing parenthesis before opening parenthesis.");
+    // A label runs up to the next structural character; a bracketed
+    // comment after it is kept if it is an NHX tag and skipped otherwise.
+    //
+    string::size_type end = description.find_first_of(",();[",*pos);
+    if(end == string::npos)
+        end = description.length();
 
-    string content = description.substr(firstP + 1, lastP - firstP - 1);
-    string element = semi == string::npos ? description.substr(lastP + 1) : description.substr(lastP + 1, semi - lastP - 1);
+    string text = description.substr(*pos,end-*pos);
+    *pos = end;
 
-    //New root node:
-    Node * node = new Node();
-
-
-    Newick_reader::Element elt = Newick_reader::get_element(description);
-
-    if(!Text_utils::is_empty(elt.length))
-        node->set_distance_to_parent(Text_utils::to_double(elt.length));
-    else
-        node->set_distance_to_parent(0);
-
-
-    if(!Text_utils::is_empty(elt.nhx))
+    if(end < description.length() && description.at(end) == '[')
     {
-        String_tokenizer * st = new String_tokenizer(elt.nhx, ":", true, false);
+        string::size_type close = description.find(']',end);
+        if(close == string::npos)
+            throw Exception("Newick_reader::parenthesis_to_tree(). Bad format: no closing bracket found.");
 
-        node->set_nhx_tid("");
-        while (st->has_more_token())
-        {
-            string block = st->next_token();
-            block = Text_utils::remove_surrounding_whitespaces(block);
-            if(block.substr(0,4)=="TID=")
-            {
-                block = block.substr(4);
-                node->set_nhx_tid(block);
-            }
-        }
-
-        delete st;
-//        node->set_distance_to_parent(Text_utils::to_double(elt.length));
-    }
+        if(description.compare(end,6,"[&&NHX") == 0)
+            label->nhx = description.substr(end+1,close-end-1);
 
-    Node_tokenizer nt(content);
-    vector<string> elements;
-    while(nt.has_next())
-    {
-        elements.push_back(nt.next());
+        *pos = description.find_first_of(",();",close);
+        if(*pos == string::npos)
+            *pos = description.length();
     }
 
-    if(elements.size()!=2)
+    string::size_type colon = text.rfind(':');
+    if(colon != string::npos)
     {
-        // Alignment requires a binary guide tree!
-//        throw Exception("Newick_reader::parenthesis_to_tree(). Not a binary tree: " + content);
-        throw Exception("The guide tree should be a rooted binary tree. Exiting.\n");
+        label->name = text.substr(0,colon);
+        label->length = text.substr(colon+1);
     }
-
     else
     {
-        //This is a node:
-        try
-        {
-            Node * child_0 = parenthesis_to_node(elements[0]);
-            node->add_left_child(child_0);
-
-            Node * child_1 = parenthesis_to_node(elements[1]);
-            node->add_right_child(child_1);
-
-            if(elt.nodeid!="")
-            {
-                node->set_name(elt.nodeid);
-            }
-            else
-            {
-                node->set_name("root");
-            }
-        }
-        catch(exception e)
-        {
-            throw e;
-        }
-
+        label->name = text;
     }
-    return node;
 }
 
 /*******************************************/
 
-Newick_reader::Element Newick_reader::get_element(const string & elt) throw (Exception)
+void Newick_reader::set_node_label(Node *node, const Label & label, bool is_root)
 {
-    Element element;
-    element.length    = ""; //default
-    element.nhx = "";
-//cout<<"elt: "<<elt<<endl;
-//    string::size_type colon = elt.rfind(':');
-//    string::size_type colon = elt.find(':');
-    try
+    if(!Text_utils::is_empty(label.length))
+        node->set_distance_to_parent(Text_utils::to_double(label.length));
+    else
+        node->set_distance_to_parent(0);
+
+    // Only the TID of the root is kept; other nodes keep the rest of the
+    // NHX tags as well.
+    //
+    stringstream nhx_tag("");
+    if(!Text_utils::is_empty(label.nhx))
     {
-        string::size_type openNHX = elt.rfind("[&&NHX");
-        string::size_type closeNHX = elt.rfind(']');
-        string::size_type lastBracket = elt.rfind(')');
+        String_tokenizer st(label.nhx, ":", true, false);
 
-        string eltt = elt;
-        if( (openNHX != string::npos && lastBracket != string::npos && lastBracket < openNHX)
-            || (openNHX != string::npos && lastBracket == string::npos) )
+        node->set_nhx_tid("");
+        while (st.has_more_token())
         {
-            if(closeNHX != string::npos)
+            string block = st.next_token();
+            block = Text_utils::remove_surrounding_whitespaces(block);
+            if(block.substr(0,4)=="TID=")
             {
-                element.nhx = elt.substr(openNHX+1,closeNHX-openNHX-1);
-                eltt = elt.substr(0,openNHX);
-            }
-        }
-
-        string::size_type colon = eltt.rfind(':');
-        string::size_type endP = eltt.rfind(')');
-
-        string elt2;
-        if(colon != string::npos)
-        {
-            if(endP == string::npos || colon>endP){
-                //this is an element with length:
-                elt2 = eltt.substr(0, colon);
-                element.length = eltt.substr(colon + 1);
+                block = block.substr(4);
+                node->set_nhx_tid(block);
             }
             else
             {
-                //this is an element without length;
-                elt2 = eltt;
+                if(nhx_tag.str().length()==0)
+                    nhx_tag<<block;
+                else
+                    nhx_tag<<":"<<block;
             }
         }
-        else
-        {
-            //this is an element without length;
-            elt2 = eltt;
-        }
-
-//        cout<<"elt2: "<<elt2<<endl;
-
-        string::size_type lastP = elt2.rfind(')');
-        string::size_type firstP = elt2.find('(');
-        if(firstP == string::npos)
-        {
-            //This is a leaf:
-            element.content = elt2;
-        }
-        else
-        {
-            //This is a node:
-            if(lastP < firstP)
-                throw Exception("Newick_reader::get_element. Invalid format: bad closing parenthesis in " + elt2);
+    }
+    if(!is_root)
+        node->set_nhx_tag(nhx_tag.str());
 
-            element.content = elt2.substr(firstP + 1, lastP - firstP - 1);
+    if(node->is_leaf())
+        return;
 
-            string::size_type firstH = elt2.find('#',lastP);
-            string::size_type lastH = elt2.find('#',firstH+1);
+    // Internal nodes keep only names of the form '#n#'
+    //
+    string nodeid = "";
+    string::size_type firstH = label.name.find('#');
+    if(firstH != string::npos)
+    {
+        string::size_type lastH = label.name.find('#',firstH+1);
+        int num = Text_utils::to_int(label.name.substr(firstH+1,lastH-firstH));
+        if(num>0)
+            nodeid = lastH == string::npos ? label.name.substr(firstH) : label.name.substr(firstH,lastH-firstH+1);
+    }
 
-            if(firstH != string::npos)
-            {
-                int num = Text_utils::to_int(elt2.substr(firstH+1,lastH-firstH));
-                if(num>0)
-                {
-                    element.nodeid = elt2.substr(firstH,lastH-firstH+1);
-                }
-            }
-        }
+    if(nodeid!="")
+    {
+        node->set_name(nodeid);
+    }
+    else if(is_root)
+    {
+        node->set_name("root");
     }
-    catch(exception e)
+    else
     {
-        throw Exception("Newick_reader::get_element. Bad tree description: " + elt);
+        stringstream ss("");
+        ss<<"node"<<node_index;
+        node->set_name(ss.str());
     }
-    return element;
+
+    if(!is_root)
+        node_index++;
 }
 
 /*******************************************/
-
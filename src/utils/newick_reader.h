@@ -79,23 +79,23 @@ namespace ppa
 class Newick_reader
 {
     int node_index;
-public:
-    Newick_reader();
-    ~Newick_reader() {}
 
-    string read_tree(const string & filename) throw (IOException);
-    Node * parenthesis_to_node(const string & description) throw (Exception);
-    Node * parenthesis_to_tree(const string & description) throw (Exception);
-
-    struct Element
+    struct Label
     {
-      string content;
+      string name;
       string length;
       string nhx;
-      string nodeid;
     };
 
-    static Element get_element(const string & elt) throw (Exception);
+    void read_label(const string & description, string::size_type *pos, Label *label) const throw (Exception);
+    void set_node_label(Node *node, const Label & label, bool is_root);
+
+public:
+    Newick_reader();
+    ~Newick_reader() {}
+
+    string read_tree(const string & filename) throw (IOException);
+    Node * parenthesis_to_tree(const string & description) throw (Exception);
 };
 
 } //end of namespace ppa.
@@ -0,0 +1,457 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/nj_tree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <omp.h>
+
+using namespace std;
+using namespace ppa;
+
+Nj_tree::Nj_tree()
+{
+}
+
+/************************************************************************************/
+
+string Nj_tree::infer_phylogeny(vector<Fasta_entry> *sequences, bool is_protein, int n_threads)
+{
+    vector<float> distances;
+    this->alignment_distances(sequences,is_protein,n_threads,&distances);
+
+    vector<string> taxa;
+    for(int i=0;i<(int)sequences->size();i++)
+        taxa.push_back(sequences->at(i).name);
+
+    return this->infer_phylogeny(&taxa,&distances,n_threads);
+}
+
+/************************************************************************************/
+
+void Nj_tree::alignment_distances(vector<Fasta_entry> *sequences, bool is_protein, int n_threads, vector<float> *distances)
+{
+    float max_distance = 3.0;
+
+    int char_code[256];
+    for(int i=0;i<256;i++)
+        char_code[i] = -1;
+
+    string alphabet = "ACGT";
+    if(is_protein)
+        alphabet = "ACDEFGHIKLMNPQRSTVWY";
+
+    for(int i=0;i<(int)alphabet.length();i++)
+    {
+        char_code[(unsigned char)alphabet.at(i)] = i;
+        char_code[(unsigned char)tolower(alphabet.at(i))] = i;
+    }
+    if(!is_protein)
+    {
+        char_code[(unsigned char)'U'] = 3;
+        char_code[(unsigned char)'u'] = 3;
+    }
+
+    if(n_threads<1)
+        n_threads = 1;
+
+    int n = sequences->size();
+    vector< vector<unsigned char> > encoded(n);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,16)
+    for(int i=0;i<n;i++)
+    {
+        const string &s = sequences->at(i).sequence;
+        encoded[i].resize(s.length());
+        for(int j=0;j<(int)s.length();j++)
+        {
+            int c = char_code[(unsigned char)s.at(j)];
+            encoded[i][j] = c<0 ? 255 : c;
+        }
+    }
+
+    distances->assign((size_t)n*(n-1)/2,max_distance);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,1)
+    for(int i=1;i<n;i++)
+    {
+        size_t row = (size_t)i*(i-1)/2;
+        const unsigned char *si = encoded[i].empty() ? 0 : &encoded[i][0];
+
+        for(int j=0;j<i;j++)
+        {
+            const unsigned char *sj = encoded[j].empty() ? 0 : &encoded[j][0];
+            int length = min(encoded[i].size(),encoded[j].size());
+
+            int compared = 0, diffs = 0;
+            for(int k=0;k<length;k++)
+            {
+                int valid = (si[k]!=255) & (sj[k]!=255);
+                compared += valid;
+                diffs += valid & (si[k]!=sj[k]);
+            }
+
+            if(compared==0)
+                continue;
+
+            double p = double(diffs)/compared;
+            double x = is_protein ? 1.0-p-0.2*p*p : 1.0-4.0/3.0*p;
+
+            if(x>0)
+            {
+                double d = is_protein ? -log(x) : -0.75*log(x);
+                (*distances)[row+j] = d<max_distance ? d : max_distance;
+            }
+        }
+    }
+}
+
+/************************************************************************************/
+
+string Nj_tree::infer_phylogeny(const vector<string> *taxa, vector<float> *distances, int n_threads)
+{
+    int n = taxa->size();
+
+    if(n<3)
+    {
+        stringstream tree;
+        if(n==1)
+            tree<<"("<<taxa->at(0)<<":0);";
+        else if(n==2)
+            tree<<"("<<taxa->at(0)<<":"<<distances->at(0)/2<<","<<taxa->at(1)<<":"<<distances->at(0)/2<<");";
+        return tree.str();
+    }
+
+    if(n_threads<1)
+        n_threads = 1;
+
+    names = *taxa;
+    left_child.assign(2*n-3,-1);
+    right_child.assign(2*n-3,-1);
+    branch_length.assign(2*n-3,0);
+
+    vector<float> &dist = *distances;
+    vector<float> var(dist);
+
+    // Tree nodes are numbered in the order of creation: a smaller
+    // number is an older cluster. Each cluster occupies one slot of
+    // the distance matrix until it is joined.
+    vector<int> slot_node(n);
+    vector<int> node_slot(2*n-3,-1);
+    vector<double> row_sum(n,0);
+    vector<int> active;
+
+    for(int i=0;i<n;i++)
+    {
+        slot_node[i] = i;
+        node_slot[i] = i;
+        active.push_back(i);
+    }
+
+    for(int i=1;i<n;i++)
+    {
+        size_t row = (size_t)i*(i-1)/2;
+        for(int j=0;j<i;j++)
+        {
+            row_sum[i] += dist[row+j];
+            row_sum[j] += dist[row+j];
+        }
+    }
+
+    // Sorted prefixes of each cluster's distances to the older clusters;
+    // row_floor is a lower bound for the distances left out of the prefix.
+    vector< vector<Row_entry> > rows(n);
+    vector<float> row_floor(n,0);
+    vector<char> row_complete(n,1);
+
+    #pragma omp parallel for num_threads(n_threads) schedule(dynamic,16)
+    for(int i=1;i<n;i++)
+    {
+        vector<Row_entry> &row = rows[i];
+        row.resize(i);
+        size_t offset = (size_t)i*(i-1)/2;
+        for(int j=0;j<i;j++)
+        {
+            row[j].dist = dist[offset+j];
+            row[j].node = j;
+        }
+        if(i>row_prefix_length)
+        {
+            nth_element(row.begin(),row.begin()+row_prefix_length,row.end());
+            row_floor[i] = row[row_prefix_length].dist;
+            row.resize(row_prefix_length);
+            row_complete[i] = 0;
+        }
+        sort(row.begin(),row.end());
+        vector<Row_entry>(row).swap(row);
+    }
+
+    int next_node = n;
+
+    while(active.size()>3)
+    {
+        int m = active.size();
+
+        double r_max = row_sum[active[0]];
+        for(int a=1;a<m;a++)
+            if(row_sum[active[a]]>r_max)
+                r_max = row_sum[active[a]];
+
+        int best_i = -1, best_j = -1;
+        double best_q = 0;
+
+        #pragma omp parallel num_threads(n_threads)
+        {
+            int t_i = -1, t_j = -1;
+            double t_q = 0;
+
+            #pragma omp for schedule(dynamic,8)
+            for(int a=0;a<m;a++)
+            {
+                int si = active[a];
+                int ni = slot_node[si];
+                double ri = row_sum[si];
+                vector<Row_entry> &row = rows[si];
+
+                bool cut = false;
+                size_t w = 0, e = 0;
+                for(;e<row.size();e++)
+                {
+                    int sj = node_slot[row[e].node];
+                    if(sj<0)
+                        continue;
+
+                    row[w++] = row[e];
+
+                    if(t_i>=0 && (m-2)*double(row[e].dist) - ri - r_max > t_q)
+                    {
+                        cut = true;
+                        e++;
+                        break;
+                    }
+
+                    double q = (m-2)*double(row[e].dist) - ri - row_sum[sj];
+                    if(t_i<0 || q<t_q)
+                    {
+                        t_q = q; t_i = si; t_j = sj;
+                    }
+                }
+                if(w<e)
+                    row.erase(row.begin()+w,row.begin()+e);
+
+                if(cut || row_complete[si])
+                    continue;
+
+                if(t_i>=0 && (m-2)*double(row_floor[si]) - ri - r_max > t_q)
+                    continue;
+
+                // The prefix is exhausted: scan the full row and refill it
+                vector<Row_entry> full;
+                for(int b=0;b<m;b++)
+                {
+                    int sj = active[b];
+                    if(slot_node[sj]>=ni)
+                        continue;
+
+                    Row_entry re;
+                    re.dist = dist[index(si,sj)];
+                    re.node = slot_node[sj];
+                    full.push_back(re);
+
+                    double q = (m-2)*double(re.dist) - ri - row_sum[sj];
+                    if(t_i<0 || q<t_q)
+                    {
+                        t_q = q; t_i = si; t_j = sj;
+                    }
+                }
+
+                row_complete[si] = 1;
+                if((int)full.size()>row_prefix_length)
+                {
+                    nth_element(full.begin(),full.begin()+row_prefix_length,full.end());
+                    row_floor[si] = full[row_prefix_length].dist;
+                    full.resize(row_prefix_length);
+                    row_complete[si] = 0;
+                }
+                sort(full.begin(),full.end());
+                row.swap(full);
+            }
+
+            #pragma omp critical
+            {
+                if(t_i>=0)
+                {
+                    int a1 = min(slot_node[t_i],slot_node[t_j]), a2 = max(slot_node[t_i],slot_node[t_j]);
+                    int b1 = best_i<0 ? 0 : min(slot_node[best_i],slot_node[best_j]);
+                    int b2 = best_i<0 ? 0 : max(slot_node[best_i],slot_node[best_j]);
+
+                    if(best_i<0 || t_q<best_q || (t_q==best_q && (a1<b1 || (a1==b1 && a2<b2))))
+                    {
+                        best_q = t_q; best_i = t_i; best_j = t_j;
+                    }
+                }
+            }
+        }
+
+        int si = best_i, sj = best_j;
+
+        double dij = dist[index(si,sj)];
+        double vij = var[index(si,sj)];
+        double bi = dij/2 + (row_sum[si]-row_sum[sj])/(2.0*(m-2));
+        double bj = dij - bi;
+
+        // BIONJ weight minimising the variance of the new distances
+        double lambda = 0.5;
+        if(vij>0)
+        {
+            double sum = 0;
+            for(int a=0;a<m;a++)
+            {
+                int k = active[a];
+                if(k!=si && k!=sj)
+                    sum += var[index(sj,k)] - var[index(si,k)];
+            }
+            lambda = 0.5 + sum/(2.0*(m-2)*vij);
+            if(lambda<0)
+                lambda = 0;
+            if(lambda>1)
+                lambda = 1;
+        }
+
+        int node = next_node++;
+        left_child[node] = slot_node[si];
+        right_child[node] = slot_node[sj];
+        branch_length[slot_node[si]] = bi<0 ? 0 : bi;
+        branch_length[slot_node[sj]] = bj<0 ? 0 : bj;
+
+        // The new node takes the slot of the first cluster
+        double new_sum = 0;
+
+        #pragma omp parallel for num_threads(n_threads) reduction(+:new_sum) if(m>1000)
+        for(int a=0;a<m;a++)
+        {
+            int k = active[a];
+            if(k==si || k==sj)
+                continue;
+
+            size_t ik = index(si,k);
+            size_t jk = index(sj,k);
+
+            double d = lambda*(dist[ik]-bi) + (1-lambda)*(dist[jk]-bj);
+            if(d<0)
+                d = 0;
+            double v = lambda*var[ik] + (1-lambda)*var[jk] - lambda*(1-lambda)*vij;
+            if(v<0)
+                v = 0;
+
+            row_sum[k] += d - dist[ik] - dist[jk];
+            dist[ik] = d;
+            var[ik] = v;
+            new_sum += d;
+        }
+
+        node_slot[slot_node[si]] = -1;
+        node_slot[slot_node[sj]] = -1;
+        node_slot[node] = si;
+        slot_node[si] = node;
+        row_sum[si] = new_sum;
+
+        for(int a=0;a<m;a++)
+        {
+            if(active[a]==sj)
+            {
+                active[a] = active[m-1];
+                active.pop_back();
+                break;
+            }
+        }
+        vector<Row_entry>().swap(rows[sj]);
+
+        // The new cluster is the youngest: its row holds all the others
+        vector<Row_entry> &row = rows[si];
+        row.clear();
+        for(int a=0;a<(int)active.size();a++)
+        {
+            int k = active[a];
+            if(k==si)
+                continue;
+            Row_entry re;
+            re.dist = dist[index(si,k)];
+            re.node = slot_node[k];
+            row.push_back(re);
+        }
+        row_complete[si] = 1;
+        if((int)row.size()>row_prefix_length)
+        {
+            nth_element(row.begin(),row.begin()+row_prefix_length,row.end());
+            row_floor[si] = row[row_prefix_length].dist;
+            row.resize(row_prefix_length);
+            row_complete[si] = 0;
+        }
+        sort(row.begin(),row.end());
+    }
+
+    int a = active[0], b = active[1], c = active[2];
+    double dab = dist[index(a,b)];
+    double dac = dist[index(a,c)];
+    double dbc = dist[index(b,c)];
+
+    double la = (dab+dac-dbc)/2;
+    double lb = (dab+dbc-dac)/2;
+    double lc = (dac+dbc-dab)/2;
+
+    branch_length[slot_node[a]] = la<0 ? 0 : la;
+    branch_length[slot_node[b]] = lb<0 ? 0 : lb;
+    branch_length[slot_node[c]] = lc<0 ? 0 : lc;
+
+    stringstream tree;
+    tree<<"(";
+    this->print_subtree(slot_node[a],&tree);
+    tree<<",";
+    this->print_subtree(slot_node[b],&tree);
+    tree<<",";
+    this->print_subtree(slot_node[c],&tree);
+    tree<<");";
+
+    return tree.str();
+}
+
+/************************************************************************************/
+
+void Nj_tree::print_subtree(int node, stringstream *tree)
+{
+    if(left_child[node]<0)
+    {
+        *tree<<names.at(node);
+    }
+    else
+    {
+        *tree<<"(";
+        this->print_subtree(left_child[node],tree);
+        *tree<<",";
+        this->print_subtree(right_child[node],tree);
+        *tree<<")";
+    }
+
+    char num[32];
+    sprintf(num,":%.6f",branch_length[node]);
+    *tree<<num;
+}
@@ -0,0 +1,82 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef NJ_TREE_H
+#define NJ_TREE_H
+
+/*
+ * BIONJ tree from a packed lower-triangle distance matrix.
+ * The Q-criterion search follows RapidNJ: each cluster keeps a sorted
+ * prefix of its distances to older clusters and a row scan stops as soon
+ * as the lower bound exceeds the best Q found so far. Rows are scanned in
+ * parallel. Returns an unrooted Newick tree with a trifurcating base, as
+ * bppdist does.
+ * Memory is O(n^2): the float distance and variance triangles take
+ * 4*n*(n-1) bytes together (about 4 GB for 32,000 sequences); the row
+ * prefixes add a bounded O(n).
+ */
+
+#include "utils/fasta_entry.h"
+#include <string>
+#include <vector>
+#include <sstream>
+
+using namespace std;
+
+namespace ppa {
+
+class Nj_tree
+{
+    struct Row_entry
+    {
+        float dist;
+        int node;
+        bool operator<(const Row_entry& e) const { return dist < e.dist || (dist == e.dist && node < e.node); }
+    };
+
+    static const int row_prefix_length = 256;
+
+    vector<int> left_child;
+    vector<int> right_child;
+    vector<float> branch_length;
+    vector<string> names;
+
+    static size_t index(int i,int j)
+    {
+        if(i>j)
+            return (size_t)i*(i-1)/2+j;
+        return (size_t)j*(j-1)/2+i;
+    }
+
+    void print_subtree(int node, stringstream *tree);
+
+public:
+    Nj_tree();
+
+    // Packed lower triangle: d(i,j), i>j, is at i*(i-1)/2+j. The matrix is overwritten.
+    string infer_phylogeny(const vector<string> *taxa, vector<float> *distances, int n_threads);
+
+    // Corrected p-distances from aligned sequences
+    void alignment_distances(vector<Fasta_entry> *sequences, bool is_protein, int n_threads, vector<float> *distances);
+    string infer_phylogeny(vector<Fasta_entry> *sequences, bool is_protein, int n_threads);
+};
+}
+
+#endif // NJ_TREE_H
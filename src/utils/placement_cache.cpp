@@ -0,0 +1,212 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <boost/cstdint.hpp>
+#include "utils/placement_cache.h"
+#include "utils/settings_handle.h"
+#include "utils/log_output.h"
+
+using namespace std;
+using namespace ppa;
+
+namespace
+{
+    const char *cache_header = "# PAGAN placement cache 1";
+
+    // fields are length-prefixed so that the concatenation is unambiguous
+    void add_field(string *data, const string &field)
+    {
+        stringstream length;
+        length<<field.length()<<":";
+        data->append(length.str());
+        data->append(field);
+    }
+
+    void add_field(string *data, double value)
+    {
+        stringstream field;
+        field.precision(9);
+        field<<value;
+        add_field(data, field.str());
+    }
+}
+
+/*******************************************************************************/
+
+// 64-bit FNV-1a
+string Placement_cache::hash(const string &data)
+{
+    boost::uint64_t h = 14695981039346656037ULL;
+    for(string::const_iterator it = data.begin(); it != data.end(); ++it)
+    {
+        h ^= (unsigned char)*it;
+        h *= 1099511628211ULL;
+    }
+
+    stringstream hex_value;
+    hex_value<<hex<<setw(16)<<setfill('0')<<h;
+    return hex_value.str();
+}
+
+void Placement_cache::open(const string &file, Node *root, int data_type)
+{
+    this->file = file;
+    placements.clear();
+    modified = false;
+
+    // the reference tree with its tags and the aligned sequences of
+    // the leaves; the ancestral sequences are derived from these
+    string reference;
+    add_field(&reference, data_type);
+    add_field(&reference, root->print_nhx_tree_with_intIDs());
+
+    vector<Node*> leaves;
+    root->get_leaf_nodes(&leaves);
+    for(vector<Node*>::iterator it = leaves.begin(); it != leaves.end(); it++)
+    {
+        Sequence *sequence = (*it)->get_sequence();
+        add_field(&reference, (*it)->get_name());
+        add_field(&reference, sequence->get_sequence_string(true));
+        add_field(&reference, *sequence->get_gapped_sequence());
+    }
+
+    set<string> skip;
+    const char *not_relevant[] = {"queryfile","outfile","ref-seqfile","ref-treefile","ref-snapshot","save-ref-snapshot",
+                                  "placement-cache","config-file","config-log-file","noise","silent","threads"};
+    for(unsigned int i=0;i<sizeof(not_relevant)/sizeof(not_relevant[0]);i++)
+        skip.insert(not_relevant[i]);
+
+    context = hash(reference+"\n"+Settings_handle::st.option_values(skip));
+    cache_open = true;
+
+    ifstream input(file.c_str());
+    if(!input)
+    {
+        Log_output::write_out("Placement cache: creating '"+file+"'.\n",1);
+        return;
+    }
+
+    string line;
+    if(!getline(input,line) || line != cache_header || !getline(input,line) || line != "context "+context)
+    {
+        Log_output::write_out("Placement cache: '"+file+"' is for another reference or settings and will be replaced.\n",1);
+        return;
+    }
+
+    while(getline(input,line))
+    {
+        size_t t1 = line.find('\t');
+        size_t t2 = t1 == string::npos ? t1 : line.find('\t',t1+1);
+        size_t t3 = t2 == string::npos ? t2 : line.find('\t',t2+1);
+        if(t3 == string::npos)
+            continue;
+
+        Placement p;
+        stringstream fields(line.substr(t1+1,t3-t1-1));
+        if(!(fields >> p.query_strand >> p.node_score))
+            continue;
+        p.node_to_align = line.substr(t3+1);
+
+        placements[line.substr(0,t1)] = p;
+    }
+
+    stringstream msg;
+    msg<<"Placement cache: "<<placements.size()<<" placements read from '"<<file<<"'.\n";
+    Log_output::write_out(msg.str(),1);
+}
+
+string Placement_cache::query_key(const Fasta_entry &query, const string &chain) const
+{
+    string data;
+    add_field(&data, context);
+    add_field(&data, chain);
+    add_field(&data, query.sequence);
+    add_field(&data, query.dna_sequence);
+    add_field(&data, query.quality);
+    add_field(&data, query.tid);
+    add_field(&data, query.node_to_align);
+    add_field(&data, query.data_type);
+    add_field(&data, query.first_read_length);
+    add_field(&data, query.num_duplicates);
+
+    for(vector<Seq_edge>::const_iterator it = query.edges.begin(); it != query.edges.end(); ++it)
+    {
+        add_field(&data, it->start_site);
+        add_field(&data, it->end_site);
+        add_field(&data, it->weight);
+    }
+
+    return hash(data);
+}
+
+bool Placement_cache::find(const string &key, Fasta_entry *query) const
+{
+    map<string,Placement>::const_iterator it = placements.find(key);
+    if(it == placements.end())
+        return false;
+
+    query->node_to_align = it->second.node_to_align;
+    query->node_score = it->second.node_score;
+    query->query_strand = it->second.query_strand;
+    return true;
+}
+
+void Placement_cache::store(const string &key, const Fasta_entry &query)
+{
+    Placement p;
+    p.node_to_align = query.node_to_align;
+    p.node_score = query.node_score;
+    p.query_strand = query.query_strand;
+
+    placements[key] = p;
+    modified = true;
+}
+
+/*
+ * The file is written next to the old one and renamed over it, so that an
+ * interrupted run leaves the previous cache intact.
+ */
+void Placement_cache::save() throw (IOException)
+{
+    if(!cache_open || !modified)
+        return;
+
+    string tmp_file = file+".tmp";
+    ofstream output(tmp_file.c_str());
+    if(!output)
+        throw IOException("Placement_cache::save. Failed to open file.");
+
+    output.precision(9);
+    output<<cache_header<<"\n"<<"context "<<context<<"\n";
+
+    for(map<string,Placement>::const_iterator it = placements.begin(); it != placements.end(); ++it)
+        output<<it->first<<"\t"<<it->second.query_strand<<"\t"<<it->second.node_score<<"\t"<<it->second.node_to_align<<"\n";
+
+    output.close();
+    if(!output || rename(tmp_file.c_str(), file.c_str()) != 0)
+        throw IOException("Placement_cache::save. Failed to write file.");
+
+    modified = false;
+}
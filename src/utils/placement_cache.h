@@ -0,0 +1,81 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PLACEMENT_CACHE_H
+#define PLACEMENT_CACHE_H
+
+/*
+ * Query placements stored in a file and reused by later runs. An entry is
+ * keyed by a hash of the query (sequence, quality, TID tag and preset
+ * target nodes) and of the context it was placed in, and keeps the nodes
+ * chosen, the strand and the score. The context hashes the reference tree
+ * with its tags, the aligned reference sequences and the option values
+ * that are not file names or output controls; a file made for another
+ * context is ignored and replaced. Placing a query changes the tree seen
+ * by the next ones, so the caller can chain the keys of the preceding
+ * queries into the key of a query. The alignment of the query to the
+ * nodes found is not cached.
+ */
+
+#include <string>
+#include <map>
+#include "main/node.h"
+#include "utils/fasta_entry.h"
+#include "utils/exceptions.h"
+
+using namespace std;
+
+namespace ppa {
+
+class Placement_cache
+{
+    struct Placement
+    {
+        string node_to_align;
+        float node_score;
+        int query_strand;
+    };
+
+    string file;
+    string context;
+    map<string,Placement> placements;
+    bool cache_open;
+    bool modified;
+
+public:
+    Placement_cache() : cache_open(false), modified(false) {}
+
+    static string hash(const string &data);
+
+    void open(const string &file, Node *root, int data_type);
+    bool is_open() const { return cache_open; }
+    int size() const { return placements.size(); }
+
+    string query_key(const Fasta_entry &query, const string &chain) const;
+
+    bool contains(const string &key) const { return placements.find(key) != placements.end(); }
+    bool find(const string &key, Fasta_entry *query) const;
+    void store(const string &key, const Fasta_entry &query);
+
+    void save() throw (IOException);
+};
+}
+
+#endif // PLACEMENT_CACHE_H
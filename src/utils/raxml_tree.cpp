@@ -83,28 +83,14 @@ bool RAxML_tree::test_executable()
 
 string RAxML_tree::infer_phylogeny(std::vector<Fasta_entry> *sequences,bool is_protein,int n_threads)
 {
+    // raxml names its output files itself: a private working directory
+    // keeps concurrent runs apart
+    string w_dir = Subprocess::make_temp_dir("raxml");
+    string m_name = w_dir+"RAxML_input.phy";
 
     ofstream m_output;
-    string tmp_dir = this->get_temp_dir();
+    m_output.open( m_name.c_str(), (ios::out) );
 
-    int r = rand();
-    while(true)
-    {
-        stringstream m_name;
-        m_name <<tmp_dir<<"RAxML_input.r"<<r;
-        ifstream m_file(m_name.str().c_str());
-
-        stringstream r_name;
-        r_name <<tmp_dir<<"RAxML_info.r"<<r;
-        ifstream r_file(r_name.str().c_str());
-
-        if(!m_file && !r_file)
-        {
-            m_output.open( m_name.str().c_str(), (ios::out) );
-            break;
-        }
-        r = rand();
-    }
     vector<Fasta_entry>::iterator si = sequences->begin();
     m_output <<sequences->size()<<" "<<sequences->at(0).sequence.length()<<endl;
     for(;si!=sequences->end();si++)
@@ -118,32 +104,26 @@ string RAxML_tree::infer_phylogeny(std::vector<Fasta_entry> *sequences,bool is_p
 
     stringstream command;
     if(is_protein)
-        command << raxmlpath<<"raxml -s "+tmp_dir+"RAxML_input.r"<<r<<" -c 4 -f d -m PROTCATJTT -w "+tmp_dir+" -n r"<<r<<" -p "<<r<<" -T "<<n_threads<<" 2>/dev/null";
+        command << raxmlpath<<"raxml -s "<<m_name<<" -c 4 -f d -m PROTCATJTT -w "<<w_dir<<" -n r -p "<<rand()<<" -T "<<n_threads;
     else
-        command << raxmlpath<<"raxml -s "+tmp_dir+"RAxML_input.r"<<r<<" -c 4 -f d -m GTRCAT -w "+tmp_dir+" -n r"<<r<<" -p "<<r<<" -T "<<n_threads<<" 2>/dev/null";
+        command << raxmlpath<<"raxml -s "<<m_name<<" -c 4 -f d -m GTRCAT -w "<<w_dir<<" -n r -p "<<rand()<<" -T "<<n_threads;
 
     Log_output::write_out("Raxml: command: "+command.str()+"\n",2);
 
-    FILE *fpipe;
-    if ( !(fpipe = (FILE*)popen(command.str().c_str(),"r")) )
-    {
-        Log_output::write_out("Problems with raxml pipe.\nExiting.\n",0);
-        exit(1);
-    }
+    string output;
+    int status = Subprocess::run(command.str(),0,&output);
 
+    vector<string> lines;
+    Subprocess::split_lines(output,&lines);
+    for(int i=0;i<(int)lines.size();i++)
+        Log_output::write_out("RAxML: "+lines.at(i),2);
 
-    char line[256];
+    if(status != 0)
+        Log_output::write_out("Raxml: raxml returned exit status "+Log_output::itos(status)+".\n",1);
 
-    while ( fgets( line, sizeof line, fpipe))
-    {
-        Log_output::write_out("RAxML: "+string(line),2);
-    }
-    pclose(fpipe);
-
-    stringstream t_name;
-    t_name <<tmp_dir<<"RAxML_bestTree.r"<<r;
+    string t_name = w_dir+"RAxML_bestTree.r";
 
-    ifstream input(t_name.str().c_str(), ios::in);
+    ifstream input(t_name.c_str(), ios::in);
     string temp,tree = "";
 
     while(!input.eof())
@@ -153,33 +133,7 @@ string RAxML_tree::infer_phylogeny(std::vector<Fasta_entry> *sequences,bool is_p
     }
     input.close();
 
-
-    if(!Settings_handle::st.is("keep-temp-files"))
-        this->delete_files(r);
+    Subprocess::remove_temp_dir(w_dir);
 
     return tree;
 }
-
-
-void RAxML_tree::delete_files(int r)
-{
-
-    string tmp_dir = this->get_temp_dir();
-
-    vector<string> f_names;
-    f_names.push_back("RAxML_input.r");
-    f_names.push_back("RAxML_bestTree.r");
-    f_names.push_back("RAxML_info.r");
-    f_names.push_back("RAxML_log.r");
-    f_names.push_back("RAxML_parsimonyTree.r");
-    f_names.push_back("RAxML_result.r");
-
-    for(int i=0;i<(int)f_names.size();i++)
-    {
-        stringstream m_name;
-        m_name <<tmp_dir<<f_names.at(i)<<r;
-
-        if ( remove( m_name.str().c_str() ) != 0 )
-            Log_output::write_out( "Error deleting file", 1);
-    }
-}
@@ -23,10 +23,10 @@
 
 #include "utils/settings_handle.h"
 #include "utils/fasta_entry.h"
+#include "utils/subprocess.h"
 #include <fstream>
 #include <string>
 #include <vector>
-#include <sys/stat.h>
 #include <stdlib.h>
 
 using namespace std;
@@ -37,27 +37,6 @@ class RAxML_tree
 {
     string raxmlpath;
 
-    std::string get_temp_dir()
-    {
-        std::string tmp_dir = "/tmp/";
-
-        if(Settings_handle::st.is("temp-folder"))
-        {
-            tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
-
-            char resolved_path[200];
-            char* rp = realpath(tmp_dir.c_str(), resolved_path);
-            tmp_dir = string(resolved_path)+"/";
-        }
-        struct stat st;
-        if(stat(tmp_dir.c_str(),&st) != 0)
-            tmp_dir = "";
-
-        return tmp_dir;
-    }
-
-    void delete_files(int r);
-
 public:
     RAxML_tree();
     bool test_executable();
@@ -70,7 +70,11 @@ int Settings::read_command_line_arguments(int argc, char *argv[])
     generic2.add_options()
         ("xml-nhx","output XML alignment with NHX tree")
         ("raxml-tree","use RAxML for guide tree computation [default BppDist]")
-        ("no-bppancestors","no BppAncestors (slow for large alignments)")
+        ("bionj-tree","use built-in BIONJ instead of BppDist for guide tree computation")
+        ("kmer-guidetree","use alignment-free k-mer distances for guide tree computation")
+        ("kmer-length",po::value<int>(),"k-mer length for guide tree distances [default 10 DNA, 4 protein]")
+        ("kmer-sketch-size",po::value<int>()->default_value(500),"k-mers per sequence sketch (0 for all)")
+        ("no-bppancestors","no ML ancestors (use parsimony ancestors)")
         ("noise", po::value<int>(), "output noise level")
         ("log-output-file",po::value<string>(),"output to file instead of stdout")
         ("temp-folder",po::value<string>(),"non-standard place for temp files")
@@ -101,6 +105,7 @@ int Settings::read_command_line_arguments(int argc, char *argv[])
         ("homopolymer", "correct homopolymer error (more agressively)")
         ("pacbio","correct for missing data in PacBio reads (DNA)")
         ("pair-end","connect paired reads (FASTQ)")
+        ("mate-queryfile", po::value<string>(), "mates of the paired queries (FASTQ; implies '--pair-end')")
         ("query-distance", po::value<float>()->default_value(0.1,"0.1"), "evolutionary distance from pseudo-root")
         ("min-query-overlap", po::value<float>()->default_value(0.5,"0.5"), "overlap threshold for query and reference")
         ("overlap-with-any","accept query overlap with any sequence")
@@ -109,7 +114,17 @@ int Settings::read_command_line_arguments(int argc, char *argv[])
 //        ("upwards-search","stepwise search from root")
         ("score-only-ungapped","score query placement only on ungapped sites")
         ("score-ungapped-limit",po::value<float>()->default_value(0.1,"0.1"),"max. ungapped proportion")
+        ("prescore-keep-best",po::value<int>(),"pre-score candidate nodes ungapped and align only the best #")
+        ("prescore-keep-above",po::value<float>(),"also align candidates above #% of the best pre-score (with '--prescore-keep-best')")
+        ("top-down-search","search placement from the root down, skipping subtrees that score poorly (approximate)")
+        ("top-down-margin",po::value<float>()->default_value(0.02,"0.02"),"descend into nodes scoring within # of the best; placements can differ from the exhaustive search")
         ("output-discarded-queries","output discarded queries to a file")
+        ("collapse-duplicate-queries","place identical queries once and copy the result (only for plain alignment output)")
+        ("query-batch-size",po::value<int>(),"read and place queries in batches of N (with '--no-preselection')")
+        ("ref-snapshot", po::value<string>(), "reference snapshot file (replaces '-a' and '-r')")
+        ("save-ref-snapshot", po::value<string>(), "save the reference alignment and tree as a snapshot")
+        ("placement-server", "keep the reference in memory and place query batches read from stdin")
+        ("placement-cache", po::value<string>(), "reuse query placements stored in file (created if missing)")
     ;
 
     boost::program_options::options_description reads_alignment3("Alignment extension output options",100);
@@ -121,7 +136,6 @@ int Settings::read_command_line_arguments(int argc, char *argv[])
         ("trim-extended-alignment","remove terminal reference sequences")
         ("trim-keep-sites",po::value<int>()->default_value(15),"trim distance around queries")
         ("use-consensus", "use consensus for query ancestors")
-        ("pair-end","connect paired reads (FASTQ)")
         ("show-contig-ancestor", "fill contig gaps with ancestral sequence")
         ("consensus-minimum", po::value<int>()->default_value(5), "threshold for inclusion in contig")
         ("consensus-minimum-proportion", po::value<float>()->default_value(0.5,"0.5"), "threshold for inclusion in contig")
@@ -367,11 +381,46 @@ int Settings::read_command_line_arguments(int argc, char *argv[])
                               "If the latter is true, this warning can be ignored.\n",0);
     }
 
+    // reads from a mate file are always paired
+    //
+    if(is("mate-queryfile") && not is("pair-end"))
+        vm.insert(make_pair(string("pair-end"),po::variable_value(boost::any(),false)));
+
+    // the copies are added to the alignment rows only; trees, XML, the
+    // back-translated and the pileup outputs would list the placed query alone
+    //
+    if( is("collapse-duplicate-queries") &&
+        ( is("xml") || is("xml-nhx") || is("guidetree") || is("output-nhx-tree") || is("ancestors") || is("output-ancestors") ) )
+    {
+        Log_output::write_out("Option '--collapse-duplicate-queries' cannot be combined with tree, XML or ancestor output. Exiting.\n",0);
+        exit(1);
+    }
+
+    if( is("collapse-duplicate-queries") &&
+        ( is("translate") || is("mt-translate") || is("find-best-orf") || is("find-orfs") ) )
+    {
+        Log_output::write_out("Option '--collapse-duplicate-queries' cannot be combined with translated or ORF output. Exiting.\n",0);
+        exit(1);
+    }
+
+    if( is("collapse-duplicate-queries") &&
+        ( is("pileup-alignment") || is("align-reads-at-root") || is("build-contigs") ) )
+    {
+        Log_output::write_out("Option '--collapse-duplicate-queries' cannot be combined with pileup alignment or contigs. Exiting.\n",0);
+        exit(1);
+    }
+
+    if( is("prescore-keep-above") && not is("prescore-keep-best") )
+    {
+        Log_output::write_out("Option '--prescore-keep-above' requires option '--prescore-keep-best'. Exiting.\n",0);
+        exit(1);
+    }
+
     // this heuristic only works for placement
     //
     tunneling_coverage = get("anchoring-threshold").as<float>();
 
-    if(not is("queryfile"))
+    if(not is("queryfile") && not is("placement-server"))
     {
         tunneling_coverage = 1;
     }
@@ -497,6 +546,39 @@ void Settings::print_msg()
     Log_output::write_out(ss.str(),0);
 }
 
+/*
+ * One line 'name=value' per option set, in name order, for detecting runs
+ * with identical settings. Flags have an empty value.
+ */
+string Settings::option_values(const set<string> &skip) const throw (Exception)
+{
+    stringstream values;
+    values.precision(9);
+
+    for(po::variables_map::const_iterator it = vm.begin(); it != vm.end(); ++it)
+    {
+        if(skip.find(it->first) != skip.end())
+            continue;
+
+        values<<it->first<<"=";
+
+        const boost::any &value = it->second.value();
+        if(const int *v = boost::any_cast<int>(&value))
+            values<<*v;
+        else if(const float *v = boost::any_cast<float>(&value))
+            values<<*v;
+        else if(const string *v = boost::any_cast<string>(&value))
+            values<<*v;
+        else if(!value.empty())
+            // a value left out would make runs with different settings share placements
+            throw Exception("Settings::option_values. Option '--"+it->first+"' has a value type that is not supported.");
+
+        values<<"\n";
+    }
+
+    return values.str();
+}
+
 string Settings::print_log_msg()
 {
     stringstream tmp;
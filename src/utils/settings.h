@@ -23,6 +23,8 @@
 
 #include <boost/program_options.hpp>
 #include <string>
+#include <set>
+#include "utils/exceptions.h"
 
 namespace ppa{
 
@@ -52,6 +54,7 @@ public:
     void check_version();
     void print_msg();
     std::string print_log_msg();
+    std::string option_values(const std::set<std::string> &skip) const throw (Exception);
 
     enum Placement_target_nodes {tid_nodes,terminal_nodes,internal_nodes,all_nodes};
 
@@ -0,0 +1,370 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/subprocess.h"
+#include "utils/settings_handle.h"
+#include "utils/log_output.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <climits>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if defined (__linux__)
+#include <sys/syscall.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
+
+using namespace std;
+using namespace ppa;
+
+namespace {
+
+bool write_all(int fd,const char *data,size_t length)
+{
+    while(length>0)
+    {
+        ssize_t n = ::write(fd,data,length);
+        if(n<0)
+        {
+            if(errno==EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool make_pipe(int p[2])
+{
+    if(pipe(p)!=0)
+        return false;
+
+    fcntl(p[0],F_SETFD,FD_CLOEXEC);
+    fcntl(p[1],F_SETFD,FD_CLOEXEC);
+    return true;
+}
+
+void close_fd(int *fd)
+{
+    if(*fd>=0)
+        close(*fd);
+    *fd = -1;
+}
+
+}
+
+/*******************************************/
+
+Subprocess_file::Subprocess_file(const string &prefix,const string &suffix)
+{
+    fd = -1;
+    is_named = false;
+
+    bool keep = Settings_handle::st.is("keep-temp-files");
+
+    #if defined (__linux__) && defined (SYS_memfd_create)
+    if(!keep)
+    {
+        // close-on-exec, so that no other child inherits it; the tool
+        // opens it through this process
+        fd = syscall(SYS_memfd_create,prefix.c_str(),MFD_CLOEXEC);
+        if(fd>=0)
+        {
+            stringstream ss;
+            ss<<"/proc/"<<getpid()<<"/fd/"<<fd;
+            path = ss.str();
+            return;
+        }
+    }
+    #endif
+
+    string name = Subprocess::get_temp_dir()+prefix+"XXXXXX"+suffix;
+    vector<char> buffer(name.begin(),name.end());
+    buffer.push_back('\0');
+
+    fd = mkstemps(&buffer[0],suffix.length());
+    if(fd<0)
+    {
+        Log_output::write_out("Subprocess_file: failed to create a temporary file '"+name+"'.\nExiting.\n",0);
+        exit(1);
+    }
+    fcntl(fd,F_SETFD,FD_CLOEXEC);
+
+    path = string(&buffer[0]);
+    is_named = true;
+}
+
+Subprocess_file::~Subprocess_file()
+{
+    if(fd>=0)
+        close(fd);
+
+    if(is_named && !Settings_handle::st.is("keep-temp-files"))
+    {
+        if( unlink( path.c_str() ) != 0 )
+            Log_output::write_out( "Error deleting file "+path+"\n", 1);
+    }
+}
+
+bool Subprocess_file::write(const string &data)
+{
+    if(ftruncate(fd,0)!=0 || lseek(fd,0,SEEK_SET)<0)
+        return false;
+
+    return write_all(fd,data.data(),data.length());
+}
+
+bool Subprocess_file::read(string *data) const
+{
+    // re-open by name: the tool may have truncated or replaced the file
+    int rfd = open(path.c_str(),O_RDONLY);
+    if(rfd<0)
+        return false;
+
+    data->clear();
+    char buffer[65536];
+    while(true)
+    {
+        ssize_t n = ::read(rfd,buffer,sizeof buffer);
+        if(n<0 && errno==EINTR)
+            continue;
+        if(n<=0)
+        {
+            close(rfd);
+            return n==0;
+        }
+        data->append(buffer,n);
+    }
+}
+
+/*******************************************/
+
+string Subprocess::get_temp_dir()
+{
+    string tmp_dir = "/tmp/";
+
+    if(Settings_handle::st.is("temp-folder"))
+        tmp_dir = Settings_handle::st.get("temp-folder").as<string>()+"/";
+
+    struct stat st;
+    if(stat(tmp_dir.c_str(),&st) != 0)
+        tmp_dir = "";
+
+    return tmp_dir;
+}
+
+string Subprocess::make_temp_dir(const string &prefix)
+{
+    string name = Subprocess::get_temp_dir()+prefix+"XXXXXX";
+    vector<char> buffer(name.begin(),name.end());
+    buffer.push_back('\0');
+
+    if(mkdtemp(&buffer[0])==0)
+    {
+        Log_output::write_out("Subprocess: failed to create a temporary directory '"+name+"'.\nExiting.\n",0);
+        exit(1);
+    }
+
+    char resolved_path[PATH_MAX];
+    if(realpath(&buffer[0],resolved_path)==0)
+        return string(&buffer[0])+"/";
+
+    return string(resolved_path)+"/";
+}
+
+void Subprocess::remove_temp_dir(const string &dir)
+{
+    if(Settings_handle::st.is("keep-temp-files"))
+        return;
+
+    DIR *dp = opendir(dir.c_str());
+    if(dp!=0)
+    {
+        struct dirent *ep;
+        while( (ep = readdir(dp)) != 0 )
+        {
+            string name(ep->d_name);
+            if(name != "." && name != "..")
+                unlink( (dir+name).c_str() );
+        }
+        closedir(dp);
+    }
+
+    if( rmdir( dir.c_str() ) != 0 )
+        Log_output::write_out( "Error deleting directory "+dir+"\n", 1);
+}
+
+int Subprocess::run(const string &command,const string *input,string *output,string *errors)
+{
+    // a tool exiting before reading all its input must not kill us
+    static bool sigpipe_ignored = false;
+    if(!sigpipe_ignored)
+    {
+        signal(SIGPIPE,SIG_IGN);
+        sigpipe_ignored = true;
+    }
+
+    int in_pipe[2] = {-1,-1};
+    int out_pipe[2] = {-1,-1};
+    int err_pipe[2] = {-1,-1};
+    pid_t pid = -1;
+
+    // Pipes are close-on-exec and created together with the fork so that
+    // a tool started from another thread never inherits our pipe ends.
+    #pragma omp critical (subprocess_fork)
+    {
+        if( (input==0 || make_pipe(in_pipe)) && make_pipe(out_pipe) && make_pipe(err_pipe) )
+        {
+            pid = fork();
+            if(pid==0)
+            {
+                int null_fd = -1;
+                if(input!=0)
+                    dup2(in_pipe[0],0);
+                else if( (null_fd = open("/dev/null",O_RDONLY)) >= 0)
+                    dup2(null_fd,0);
+                dup2(out_pipe[1],1);
+                dup2(err_pipe[1],2);
+
+                execl("/bin/sh","sh","-c",command.c_str(),(char*)0);
+                _exit(127);
+            }
+        }
+        close_fd(&in_pipe[0]);
+        close_fd(&out_pipe[1]);
+        close_fd(&err_pipe[1]);
+    }
+
+    if(pid<0)
+    {
+        close_fd(&in_pipe[1]);
+        close_fd(&out_pipe[0]);
+        close_fd(&err_pipe[0]);
+        Log_output::write_out("Subprocess: failed to start '"+command+"'.\n",1);
+        return -1;
+    }
+
+    if(output!=0)
+        output->clear();
+    if(errors!=0)
+        errors->clear();
+
+    size_t written = 0;
+    if(in_pipe[1]>=0)
+    {
+        fcntl(in_pipe[1],F_SETFL,fcntl(in_pipe[1],F_GETFL)|O_NONBLOCK);
+        if(input->empty())
+            close_fd(&in_pipe[1]);
+    }
+
+    // feed stdin and drain stdout/stderr until the child closes them all
+    char buffer[65536];
+    while(in_pipe[1]>=0 || out_pipe[0]>=0 || err_pipe[0]>=0)
+    {
+        struct pollfd fds[3];
+        int nfds = 0;
+        int in_i=-1, out_i=-1, err_i=-1;
+
+        if(in_pipe[1]>=0)  { fds[nfds].fd = in_pipe[1]; fds[nfds].events = POLLOUT; in_i = nfds++; }
+        if(out_pipe[0]>=0) { fds[nfds].fd = out_pipe[0]; fds[nfds].events = POLLIN; out_i = nfds++; }
+        if(err_pipe[0]>=0) { fds[nfds].fd = err_pipe[0]; fds[nfds].events = POLLIN; err_i = nfds++; }
+
+        if(poll(fds,nfds,-1)<0)
+        {
+            if(errno==EINTR)
+                continue;
+            break;
+        }
+
+        if(in_i>=0 && fds[in_i].revents!=0)
+        {
+            ssize_t n = ::write(in_pipe[1],input->data()+written,input->length()-written);
+            if(n>0)
+                written += n;
+            if( (n<0 && errno!=EAGAIN && errno!=EINTR) || written==input->length() )
+                close_fd(&in_pipe[1]);
+        }
+
+        int idx[2] = {out_i,err_i};
+        int *pfd[2] = {&out_pipe[0],&err_pipe[0]};
+        string *dest[2] = {output,errors};
+
+        for(int k=0;k<2;k++)
+        {
+            if(idx[k]<0 || fds[idx[k]].revents==0)
+                continue;
+
+            ssize_t n = ::read(*pfd[k],buffer,sizeof buffer);
+            if(n>0)
+            {
+                if(dest[k]!=0)
+                    dest[k]->append(buffer,n);
+            }
+            else if(n==0 || (errno!=EAGAIN && errno!=EINTR))
+                close_fd(pfd[k]);
+        }
+    }
+
+    close_fd(&in_pipe[1]);
+    close_fd(&out_pipe[0]);
+    close_fd(&err_pipe[0]);
+
+    int status = 0;
+    while(waitpid(pid,&status,0)<0)
+    {
+        if(errno!=EINTR)
+            return -1;
+    }
+
+    if(WIFEXITED(status))
+        return WEXITSTATUS(status);
+
+    return -1;
+}
+
+void Subprocess::split_lines(const string &text,vector<string> *lines)
+{
+    // lines keep their trailing newline, as read with fgets()
+    size_t start = 0;
+    while(start<text.length())
+    {
+        size_t end = text.find('\n',start);
+        if(end==string::npos)
+            end = text.length();
+        else
+            end++;
+
+        lines->push_back(text.substr(start,end-start));
+        start = end;
+    }
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SUBPROCESS_H
+#define SUBPROCESS_H
+
+/*
+ * Running the external tools (mafft, exonerate, raxml, bpp*, hmmsearch)
+ * without temp files. Subprocess::run() feeds the command's stdin from a
+ * pipe and drains its stdout and stderr concurrently, so neither side can
+ * block on a full pipe, and returns the exit status. Tools that insist on
+ * file names get a Subprocess_file: an anonymous memory file (memfd) that
+ * the child opens as /proc/<pid>/fd/N of this process. With 'keep-temp-files',
+ * or where memfd is not available, a uniquely named file (mkstemp) in the
+ * temp folder is used instead. Tools that write files of their own choosing
+ * (raxml) run in a private directory from make_temp_dir().
+ */
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace ppa {
+
+class Subprocess_file
+{
+    int fd;
+    string path;
+    bool is_named;
+
+    Subprocess_file(const Subprocess_file&);
+    Subprocess_file& operator=(const Subprocess_file&);
+
+public:
+    Subprocess_file(const string &prefix,const string &suffix="");
+    ~Subprocess_file();
+
+    string get_path() const { return path; }
+    bool write(const string &data);
+    bool read(string *data) const;
+};
+
+class Subprocess
+{
+public:
+    static string get_temp_dir();
+    static string make_temp_dir(const string &prefix);
+    static void remove_temp_dir(const string &dir);
+    static int run(const string &command,const string *input,string *output,string *errors=0);
+    static void split_lines(const string &text,vector<string> *lines);
+};
+}
+
+#endif // SUBPROCESS_H
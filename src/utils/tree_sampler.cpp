@@ -0,0 +1,197 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/tree_sampler.h"
+#include "utils/settings_handle.h"
+#include "utils/log_output.h"
+#include <map>
+
+using namespace std;
+using namespace ppa;
+
+Tree_sampler::Tree_sampler()
+{
+}
+
+/************************************************************************************/
+
+int Tree_sampler::index_nodes(Node *node,int parent_index)
+{
+    int index = names.size();
+
+    parent.push_back(parent_index);
+    distance.push_back(node->get_distance_to_parent());
+    children.push_back(vector<int>());
+    names.push_back(node->is_leaf() ? node->get_name() : "");
+
+    if(!node->is_leaf())
+    {
+        int left = this->index_nodes(node->get_left_child(),index);
+        int right = this->index_nodes(node->get_right_child(),index);
+        children.at(index).push_back(left);
+        children.at(index).push_back(right);
+    }
+
+    return index;
+}
+
+/************************************************************************************/
+
+void Tree_sampler::distances_from(int source,vector<double> *dist)
+{
+    dist->assign(names.size(),-1);
+    dist->at(source) = 0;
+
+    vector<int> stack;
+    stack.push_back(source);
+
+    while(!stack.empty())
+    {
+        int n = stack.back();
+        stack.pop_back();
+
+        int p = parent.at(n);
+        if(p>=0 && dist->at(p)<0)
+        {
+            dist->at(p) = dist->at(n)+distance.at(n);
+            stack.push_back(p);
+        }
+
+        for(int i=0;i<(int)children.at(n).size();i++)
+        {
+            int c = children.at(n).at(i);
+            if(dist->at(c)<0)
+            {
+                dist->at(c) = dist->at(n)+distance.at(c);
+                stack.push_back(c);
+            }
+        }
+    }
+}
+
+/************************************************************************************/
+
+void Tree_sampler::reduce_sequences(Node *root,vector<Fasta_entry> *aligned_sequences,set<string> *keep,set<string> *toremove)
+{
+    parent.clear();
+    distance.clear();
+    children.clear();
+    names.clear();
+
+    this->index_nodes(root,-1);
+
+    map<string,int> lengths;
+    for(int i=0;i<(int)aligned_sequences->size();i++)
+    {
+        string *s = &aligned_sequences->at(i).sequence;
+        int length = 0;
+        for(int j=0;j<(int)s->length();j++)
+            if(s->at(j)!='-' && s->at(j)!='.')
+                length++;
+        lengths.insert(make_pair(aligned_sequences->at(i).name,length));
+    }
+
+    // Candidates are the reference leaves; the queries are always kept
+    vector<int> candidates;
+    vector<int> cand_length;
+    for(int i=0;i<(int)names.size();i++)
+    {
+        if(children.at(i).empty() && keep->find(names.at(i))==keep->end())
+        {
+            candidates.push_back(i);
+            map<string,int>::iterator li = lengths.find(names.at(i));
+            cand_length.push_back(li!=lengths.end() ? li->second : 0);
+        }
+    }
+
+    int n = candidates.size();
+
+    bool use_threshold = Settings_handle::st.is("prune-keep-threshold");
+    float threshold = 0;
+    int number = n;
+    if(use_threshold)
+        threshold = Settings_handle::st.get("prune-keep-threshold").as<float>();
+    else
+        number = Settings_handle::st.get("prune-keep-number").as<int>();
+
+    if(n==0 || (!use_threshold && number>=n))
+        return;
+
+    // The first sequence is the one farthest from the longest sequence
+    int longest = 0;
+    for(int i=1;i<n;i++)
+        if(cand_length.at(i)>cand_length.at(longest))
+            longest = i;
+
+    vector<double> dist;
+    this->distances_from(candidates.at(longest),&dist);
+
+    int first = 0;
+    for(int i=1;i<n;i++)
+    {
+        double d0 = dist.at(candidates.at(first)), d1 = dist.at(candidates.at(i));
+        if(d1>d0 || (d1==d0 && cand_length.at(i)>cand_length.at(first)))
+            first = i;
+    }
+
+    vector<char> selected(n,0);
+    vector<double> min_dist(n,0);
+
+    int n_selected = 0;
+    int next = first;
+
+    while(next>=0)
+    {
+        selected.at(next) = 1;
+        n_selected++;
+
+        if(!use_threshold && n_selected>=number)
+            break;
+
+        this->distances_from(candidates.at(next),&dist);
+
+        next = -1;
+        for(int i=0;i<n;i++)
+        {
+            if(selected.at(i))
+                continue;
+
+            double d = dist.at(candidates.at(i));
+            if(n_selected==1 || d<min_dist.at(i))
+                min_dist.at(i) = d;
+
+            if(next<0 || min_dist.at(i)>min_dist.at(next) ||
+                    (min_dist.at(i)==min_dist.at(next) && cand_length.at(i)>cand_length.at(next)))
+                next = i;
+        }
+
+        if(use_threshold && next>=0 && min_dist.at(next)<threshold)
+            break;
+    }
+
+    for(int i=0;i<n;i++)
+    {
+        if(!selected.at(i))
+        {
+            toremove->insert(names.at(candidates.at(i)));
+            Log_output::write_out("Tree_sampler: remove sequence: "+names.at(candidates.at(i))+"\n",2);
+        }
+    }
+}
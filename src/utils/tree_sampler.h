@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TREE_SAMPLER_H
+#define TREE_SAMPLER_H
+
+/*
+ * Redundancy pruning of the reference sequences, as done by bppphysamp,
+ * using patristic distances on the alignment tree. The sample is grown by
+ * farthest-point selection: the next sequence kept is the one most distant
+ * from those already kept, the longer sequence winning ties. Sampling stops
+ * at 'prune-keep-number' sequences or, with 'prune-keep-threshold', when
+ * no sequence is farther than the threshold from the sample.
+ */
+
+#include "utils/fasta_entry.h"
+#include "main/node.h"
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace ppa {
+
+class Tree_sampler
+{
+    vector<int> parent;
+    vector<double> distance;
+    vector< vector<int> > children;
+    vector<string> names;
+
+    int index_nodes(Node *node,int parent_index);
+    void distances_from(int source,vector<double> *dist);
+
+public:
+    Tree_sampler();
+    void reduce_sequences(Node *root,vector<Fasta_entry> *aligned_sequences,set<string> *keep,set<string> *toremove);
+};
+}
+
+#endif // TREE_SAMPLER_H
@@ -0,0 +1,425 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils/tree_snapshot.h"
+#include "utils/settings_handle.h"
+#include "utils/log_output.h"
+
+using namespace std;
+using namespace ppa;
+
+namespace
+{
+    const char snapshot_magic[8] = {'P','A','G','A','N','S','N','P'};
+    const unsigned int byte_order_mark = 0x01020304;
+
+    template<class T>
+    void put(string *buffer, T value)
+    {
+        buffer->append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put_string(string *buffer, const string &s)
+    {
+        put<unsigned int>(buffer, s.length());
+        buffer->append(s);
+    }
+
+    template<class T>
+    T get(const char **pos, const char *end) throw (IOException)
+    {
+        if(end - *pos < (long)sizeof(T))
+            throw IOException("Tree_snapshot::read. Unexpected end of file.");
+
+        T value;
+        memcpy(&value, *pos, sizeof(T));
+        *pos += sizeof(T);
+        return value;
+    }
+
+    string get_string(const char **pos, const char *end) throw (IOException)
+    {
+        unsigned int length = get<unsigned int>(pos, end);
+        if((unsigned long)(end - *pos) < length)
+            throw IOException("Tree_snapshot::read. Unexpected end of file.");
+
+        string s(*pos, length);
+        *pos += length;
+        return s;
+    }
+}
+
+/*******************************************************************************/
+
+void Tree_snapshot::write(string *buffer, Node *root, int data_type, const float *dna_pi)
+{
+    buffer->append(snapshot_magic, sizeof(snapshot_magic));
+    put<unsigned int>(buffer, byte_order_mark);
+    put<unsigned int>(buffer, format_version);
+    put<int>(buffer, data_type);
+    for(int i=0;i<4;i++)
+        put<float>(buffer, dna_pi[i]);
+    put<char>(buffer, Settings_handle::st.is("codons"));
+
+    this->write_node(root, buffer);
+}
+
+void Tree_snapshot::write(const string &file, Node *root, int data_type, const float *dna_pi) throw (IOException)
+{
+    string buffer;
+    this->write(&buffer, root, data_type, dna_pi);
+
+    ofstream output(file.c_str(), ios::out|ios::binary);
+    if(!output)
+        throw IOException("Tree_snapshot::write. Failed to open file.");
+
+    output.write(buffer.data(), buffer.length());
+    output.close();
+
+    if(!output)
+        throw IOException("Tree_snapshot::write. Failed to write file.");
+}
+
+void Tree_snapshot::write_node(Node *node, string *buffer)
+{
+    put<char>(buffer, node->is_leaf());
+    put<double>(buffer, node->get_distance_to_parent());
+    put_string(buffer, node->name);
+    put_string(buffer, node->name_comment);
+    put_string(buffer, node->name_id);
+    put_string(buffer, node->nhx_tid);
+    put_string(buffer, node->nhx_tag);
+
+    put<unsigned int>(buffer, node->duplicate_queries.size());
+    for(vector< pair<string,string> >::iterator it = node->duplicate_queries.begin(); it != node->duplicate_queries.end(); it++)
+    {
+        put_string(buffer, it->first);
+        put_string(buffer, it->second);
+    }
+
+    put<char>(buffer, node->adjust_left_node_site_index);
+    put<char>(buffer, node->adjust_right_node_site_index);
+    put<char>(buffer, node->node_has_sequence);
+    put<char>(buffer, node->node_has_sequence_object);
+
+    if(node->node_has_sequence_object)
+        this->write_sequence(node->get_sequence(), buffer);
+
+    if(!node->is_leaf())
+    {
+        this->write_node(node->get_left_child(), buffer);
+        this->write_node(node->get_right_child(), buffer);
+    }
+}
+
+void Tree_snapshot::write_sequence(Sequence *sequence, string *buffer)
+{
+    put<int>(buffer, sequence->data_type);
+    put<int>(buffer, sequence->curr_site_index);
+    put<int>(buffer, sequence->prev_site_index);
+    put<int>(buffer, sequence->curr_edge_index);
+    put<int>(buffer, sequence->num_duplicates);
+    put<char>(buffer, sequence->read_sequence);
+    put<char>(buffer, sequence->has_read_descendants);
+    put<char>(buffer, sequence->terminal_sequence);
+    put_string(buffer, sequence->full_char_alphabet);
+    put_string(buffer, sequence->gap_symbol);
+    put_string(buffer, sequence->gapped_seq);
+    put_string(buffer, sequence->unaligned_seq);
+    put_string(buffer, sequence->dna_seq);
+
+    put<unsigned int>(buffer, sequence->unique_index.size());
+    for(vector<Unique_index>::iterator it = sequence->unique_index.begin(); it != sequence->unique_index.end(); it++)
+    {
+        put<int>(buffer, it->left_index);
+        put<int>(buffer, it->right_index);
+        put<int>(buffer, it->match_state);
+        put<int>(buffer, it->site_index);
+    }
+
+    put<unsigned int>(buffer, sequence->edges.size());
+    for(vector<Edge>::iterator it = sequence->edges.begin(); it != sequence->edges.end(); it++)
+    {
+        put<int>(buffer, it->get_index());
+        put<int>(buffer, it->get_start_site_index());
+        put<int>(buffer, it->get_end_site_index());
+        put<float>(buffer, it->get_posterior_weight());
+        put<int>(buffer, it->get_next_fwd_edge_index());
+        put<int>(buffer, it->get_next_bwd_edge_index());
+        put<char>(buffer, it->is_used());
+        put<int>(buffer, it->get_branch_count_since_last_used());
+        put<float>(buffer, it->get_branch_distance_since_last_used());
+        put<int>(buffer, it->get_branch_count_as_skipped_edge());
+    }
+
+    put<unsigned int>(buffer, sequence->sites.size());
+    for(vector<Site>::iterator it = sequence->sites.begin(); it != sequence->sites.end(); it++)
+    {
+        put<int>(buffer, it->index);
+        put<int>(buffer, it->children.left_index);
+        put<int>(buffer, it->children.right_index);
+        put<int>(buffer, it->unique_index.left_index);
+        put<int>(buffer, it->unique_index.right_index);
+        put<int>(buffer, it->unique_index.match_state);
+        put<int>(buffer, it->unique_index.site_index);
+        put<int>(buffer, it->character_state);
+        put_string(buffer, it->character_symbol);
+        put<int>(buffer, it->site_type);
+        put<int>(buffer, it->path_state);
+        put<int>(buffer, it->first_fwd_edge_index);
+        put<int>(buffer, it->current_fwd_edge_index);
+        put<int>(buffer, it->first_bwd_edge_index);
+        put<int>(buffer, it->current_bwd_edge_index);
+        put<float>(buffer, it->posterior_support);
+        put<int>(buffer, it->branch_count_since_last_used);
+        put<float>(buffer, it->branch_distance_since_last_used);
+        put<int>(buffer, it->sumA);
+        put<int>(buffer, it->sumC);
+        put<int>(buffer, it->sumG);
+        put<int>(buffer, it->sumT);
+        put<int>(buffer, it->sumAmino);
+    }
+}
+
+/*******************************************************************************/
+
+Node *Tree_snapshot::read(const string &file, int *data_type, float *dna_pi) throw (IOException)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw IOException("Tree_snapshot::read. Failed to open file.");
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(snapshot_magic))
+    {
+        close(fd);
+        throw IOException("Tree_snapshot::read. Not a snapshot file.");
+    }
+
+    size_t length = st.st_size;
+    void *mapped = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(mapped == MAP_FAILED)
+        throw IOException("Tree_snapshot::read. Failed to map file.");
+
+    Node *root;
+    try
+    {
+        root = this->read(static_cast<const char*>(mapped), length, data_type, dna_pi);
+    }
+    catch(IOException& e)
+    {
+        munmap(mapped, length);
+        throw;
+    }
+
+    munmap(mapped, length);
+
+    return root;
+}
+
+Node *Tree_snapshot::read(const char *data, size_t length, int *data_type, float *dna_pi) throw (IOException)
+{
+    if(length < sizeof(snapshot_magic))
+        throw IOException("Tree_snapshot::read. Not a snapshot file.");
+
+    Cursor c;
+    c.pos = data;
+    c.end = data + length;
+
+    Node *root = 0;
+    try
+    {
+        if(memcmp(c.pos, snapshot_magic, sizeof(snapshot_magic)) != 0)
+            throw IOException("Tree_snapshot::read. Not a snapshot file.");
+        c.pos += sizeof(snapshot_magic);
+
+        if(get<unsigned int>(&c.pos, c.end) != byte_order_mark)
+            throw IOException("Tree_snapshot::read. Snapshot was written on a machine with different byte order.");
+
+        if(get<unsigned int>(&c.pos, c.end) != format_version)
+            throw IOException("Tree_snapshot::read. Unsupported snapshot version.");
+
+        *data_type = get<int>(&c.pos, c.end);
+        for(int i=0;i<4;i++)
+            dna_pi[i] = get<float>(&c.pos, c.end);
+
+        bool codons = get<char>(&c.pos, c.end);
+        if(codons != Settings_handle::st.is("codons"))
+            throw IOException("Tree_snapshot::read. Option '--codons' does not match the snapshot.");
+
+        root = this->read_node(&c);
+
+        if(c.pos != c.end)
+            throw IOException("Tree_snapshot::read. Trailing data after the tree.");
+    }
+    catch(IOException& e)
+    {
+        if(root)
+            delete root;
+        throw;
+    }
+
+    return root;
+}
+
+Node *Tree_snapshot::read_node(Cursor *c) throw (IOException)
+{
+    Node *node = new Node();
+
+    try
+    {
+        bool leaf = get<char>(&c->pos, c->end);
+        node->set_distance_to_parent(get<double>(&c->pos, c->end), false);
+        node->set_name(get_string(&c->pos, c->end));
+        node->add_name_comment(get_string(&c->pos, c->end));
+        node->name_id = get_string(&c->pos, c->end);
+        node->set_nhx_tid(get_string(&c->pos, c->end));
+        node->set_nhx_tag(get_string(&c->pos, c->end));
+
+        unsigned int n = get<unsigned int>(&c->pos, c->end);
+        for(unsigned int i=0;i<n;i++)
+        {
+            string name = get_string(&c->pos, c->end);
+            string comment = get_string(&c->pos, c->end);
+            node->duplicate_queries.push_back(make_pair(name,comment));
+        }
+
+        node->adjust_left_node_site_index = get<char>(&c->pos, c->end);
+        node->adjust_right_node_site_index = get<char>(&c->pos, c->end);
+        node->node_has_sequence = get<char>(&c->pos, c->end);
+
+        if(get<char>(&c->pos, c->end))
+            node->add_ancestral_sequence( this->read_sequence(c) );
+
+        if(!leaf)
+        {
+            node->add_left_child( this->read_node(c) );
+            node->add_right_child( this->read_node(c) );
+        }
+    }
+    catch(IOException& e)
+    {
+        delete node;
+        throw;
+    }
+
+    return node;
+}
+
+Sequence *Tree_snapshot::read_sequence(Cursor *c) throw (IOException)
+{
+    int data_type = get<int>(&c->pos, c->end);
+    Sequence *sequence = new Sequence(0, data_type);
+
+    try
+    {
+        sequence->curr_site_index = get<int>(&c->pos, c->end);
+        sequence->prev_site_index = get<int>(&c->pos, c->end);
+        sequence->curr_edge_index = get<int>(&c->pos, c->end);
+        sequence->num_duplicates = get<int>(&c->pos, c->end);
+        sequence->read_sequence = get<char>(&c->pos, c->end);
+        sequence->has_read_descendants = get<char>(&c->pos, c->end);
+        sequence->terminal_sequence = get<char>(&c->pos, c->end);
+        sequence->full_char_alphabet = get_string(&c->pos, c->end);
+        sequence->gap_symbol = get_string(&c->pos, c->end);
+        sequence->gapped_seq = get_string(&c->pos, c->end);
+        sequence->unaligned_seq = get_string(&c->pos, c->end);
+        sequence->dna_seq = get_string(&c->pos, c->end);
+
+        unsigned int n = get<unsigned int>(&c->pos, c->end);
+        sequence->unique_index.reserve(n);
+        for(unsigned int i=0;i<n;i++)
+        {
+            int l = get<int>(&c->pos, c->end);
+            int r = get<int>(&c->pos, c->end);
+            int s = get<int>(&c->pos, c->end);
+            int si = get<int>(&c->pos, c->end);
+            sequence->unique_index.push_back( Unique_index(l,r,s,si) );
+        }
+
+        n = get<unsigned int>(&c->pos, c->end);
+        sequence->edges.reserve(n);
+        for(unsigned int i=0;i<n;i++)
+        {
+            int index = get<int>(&c->pos, c->end);
+            int start = get<int>(&c->pos, c->end);
+            int end = get<int>(&c->pos, c->end);
+
+            Edge edge(start,end);
+            edge.set_index(index);
+            edge.set_weight(get<float>(&c->pos, c->end));
+            edge.set_next_fwd_edge_index(get<int>(&c->pos, c->end));
+            edge.set_next_bwd_edge_index(get<int>(&c->pos, c->end));
+            edge.is_used(get<char>(&c->pos, c->end));
+            edge.set_branch_count_since_last_used(get<int>(&c->pos, c->end));
+            edge.set_branch_distance_since_last_used(get<float>(&c->pos, c->end));
+            edge.set_branch_count_as_skipped_edge(get<int>(&c->pos, c->end));
+
+            sequence->edges.push_back(edge);
+        }
+
+        n = get<unsigned int>(&c->pos, c->end);
+        sequence->sites.reserve(n);
+        for(unsigned int i=0;i<n;i++)
+        {
+            Site site(&sequence->edges);
+            site.index = get<int>(&c->pos, c->end);
+            site.children.left_index = get<int>(&c->pos, c->end);
+            site.children.right_index = get<int>(&c->pos, c->end);
+            site.unique_index.left_index = get<int>(&c->pos, c->end);
+            site.unique_index.right_index = get<int>(&c->pos, c->end);
+            site.unique_index.match_state = get<int>(&c->pos, c->end);
+            site.unique_index.site_index = get<int>(&c->pos, c->end);
+            site.character_state = get<int>(&c->pos, c->end);
+            site.character_symbol = get_string(&c->pos, c->end);
+            site.site_type = get<int>(&c->pos, c->end);
+            site.path_state = get<int>(&c->pos, c->end);
+            site.first_fwd_edge_index = get<int>(&c->pos, c->end);
+            site.current_fwd_edge_index = get<int>(&c->pos, c->end);
+            site.first_bwd_edge_index = get<int>(&c->pos, c->end);
+            site.current_bwd_edge_index = get<int>(&c->pos, c->end);
+            site.posterior_support = get<float>(&c->pos, c->end);
+            site.branch_count_since_last_used = get<int>(&c->pos, c->end);
+            site.branch_distance_since_last_used = get<float>(&c->pos, c->end);
+            site.sumA = get<int>(&c->pos, c->end);
+            site.sumC = get<int>(&c->pos, c->end);
+            site.sumG = get<int>(&c->pos, c->end);
+            site.sumT = get<int>(&c->pos, c->end);
+            site.sumAmino = get<int>(&c->pos, c->end);
+
+            sequence->sites.push_back(site);
+        }
+    }
+    catch(IOException& e)
+    {
+        delete sequence;
+        throw;
+    }
+
+    return sequence;
+}
@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TREE_SNAPSHOT_H
+#define TREE_SNAPSHOT_H
+
+/*
+ * Binary snapshot of an aligned reference tree. The file stores the
+ * topology, branch lengths, NHX tags, the names of collapsed duplicate
+ * queries and, for every node, the Sequence graph (sites with states,
+ * path states, types and child indices; edges with weights) as read by
+ * read_reference_alignment(). Loading it maps
+ * the file and rebuilds the nodes without re-reading the alignment or
+ * re-computing the ancestral graphs. Values are stored in the native
+ * byte order; the header records it together with a format version and
+ * files from another version or byte order are rejected. The same format
+ * kept in memory serves as a pristine copy of a tree that is modified by
+ * the placement.
+ */
+
+#include <string>
+#include "main/node.h"
+#include "utils/exceptions.h"
+
+using namespace std;
+
+namespace ppa
+{
+
+class Tree_snapshot
+{
+    static const unsigned int format_version = 2;
+
+    struct Cursor
+    {
+        const char *pos;
+        const char *end;
+    };
+
+    void write_node(Node *node, string *buffer);
+    void write_sequence(Sequence *sequence, string *buffer);
+
+    Node *read_node(Cursor *c) throw (IOException);
+    Sequence *read_sequence(Cursor *c) throw (IOException);
+
+public:
+    void write(string *buffer, Node *root, int data_type, const float *dna_pi);
+    void write(const string &file, Node *root, int data_type, const float *dna_pi) throw (IOException);
+
+    Node *read(const char *data, size_t length, int *data_type, float *dna_pi) throw (IOException);
+    Node *read(const string &file, int *data_type, float *dna_pi) throw (IOException);
+};
+
+}
+
+#endif // TREE_SNAPSHOT_H
@@ -0,0 +1,154 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "utils/ungapped_prescore.h"
+#include <algorithm>
+#include <cctype>
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+using namespace ppa;
+
+Ungapped_prescore::Ungapped_prescore(bool is_protein)
+{
+    for(int i=0;i<256;i++)
+        char_code[i] = -1;
+
+    string alphabet = "ACGT";
+    bits_per_char = 2;
+    kmer_length = 8;
+
+    if(is_protein)
+    {
+        alphabet = "ACDEFGHIKLMNPQRSTVWY";
+        bits_per_char = 5;
+        kmer_length = 3;
+    }
+
+    for(int i=0;i<(int)alphabet.length();i++)
+    {
+        char_code[(unsigned char)alphabet.at(i)] = i;
+        char_code[(unsigned char)tolower(alphabet.at(i))] = i;
+    }
+
+    if(!is_protein)
+    {
+        char_code[(unsigned char)'U'] = 3;
+        char_code[(unsigned char)'u'] = 3;
+    }
+}
+
+/************************************************************************************/
+
+void Ungapped_prescore::index_kmers(const string &sequence, vector< pair<unsigned long long,int> > *kmers)
+{
+    // k-mers with characters outside the alphabet are skipped
+    unsigned long long mask = (1ULL << (bits_per_char*kmer_length)) - 1;
+    unsigned long long key = 0;
+    int valid = 0;
+
+    kmers->clear();
+    kmers->reserve(sequence.length());
+
+    for(int i=0;i<(int)sequence.length();i++)
+    {
+        int c = char_code[(unsigned char)sequence.at(i)];
+        if(c<0)
+        {
+            valid = 0;
+            key = 0;
+            continue;
+        }
+
+        key = ((key << bits_per_char) | c) & mask;
+        valid++;
+
+        if(valid >= kmer_length)
+            kmers->push_back(make_pair(key,i-kmer_length+1));
+    }
+}
+
+int Ungapped_prescore::diagonal_score(const string &query, const string &target, int diagonal)
+{
+    int first = max(0,-diagonal);
+    int last = min((int)query.length(),(int)target.length()-diagonal);
+
+    int best = 0;
+    int current = 0;
+
+    for(int i=first;i<last;i++)
+    {
+        int c1 = char_code[(unsigned char)query.at(i)];
+        int c2 = char_code[(unsigned char)target.at(i+diagonal)];
+
+        if(c1>=0 && c1==c2)
+            current++;
+        else
+            current--;
+
+        if(current<0)
+            current = 0;
+        if(current>best)
+            best = current;
+    }
+
+    return best;
+}
+
+int Ungapped_prescore::score(const string &query, const string &target)
+{
+    vector< pair<unsigned long long,int> > target_kmers;
+    this->index_kmers(target,&target_kmers);
+    sort(target_kmers.begin(),target_kmers.end());
+
+    vector< pair<unsigned long long,int> > query_kmers;
+    this->index_kmers(query,&query_kmers);
+
+    // repetitive k-mers are not allowed to vote
+    boost::unordered_map<int,int> votes;
+    for(int i=0;i<(int)query_kmers.size();i++)
+    {
+        vector< pair<unsigned long long,int> >::iterator lo =
+                lower_bound(target_kmers.begin(),target_kmers.end(),make_pair(query_kmers.at(i).first,0));
+        vector< pair<unsigned long long,int> >::iterator hi = lo;
+        while(hi!=target_kmers.end() && hi->first==query_kmers.at(i).first)
+            hi++;
+
+        if(hi-lo > max_kmer_hits)
+            continue;
+
+        for(;lo!=hi;lo++)
+            votes[lo->second - query_kmers.at(i).second]++;
+    }
+
+    vector< pair<int,int> > diagonals;
+    diagonals.reserve(votes.size());
+    for(boost::unordered_map<int,int>::iterator it=votes.begin();it!=votes.end();it++)
+        diagonals.push_back(make_pair(-it->second,it->first));
+
+    int n = min((int)diagonals.size(),diagonals_scored);
+    partial_sort(diagonals.begin(),diagonals.begin()+n,diagonals.end());
+
+    int best = 0;
+    for(int i=0;i<n;i++)
+        best = max(best,this->diagonal_score(query,target,diagonals.at(i).second));
+
+    return best;
+}
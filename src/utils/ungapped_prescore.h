@@ -0,0 +1,58 @@
+/***************************************************************************
+ *   Copyright (C) 2010-2014 by Ari Loytynoja                              *
+ *   ari.loytynoja@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef UNGAPPED_PRESCORE_H
+#define UNGAPPED_PRESCORE_H
+
+/*
+ * Cheap ranking of candidate nodes for a query before the full graph
+ * alignment. Shared k-mers vote for the diagonals of the query and the
+ * node sequence, and the best-supported diagonals are scored with an
+ * ungapped local extension (+1 for identity, -1 otherwise). The score is
+ * that of the best ungapped segment found.
+ */
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace ppa {
+
+class Ungapped_prescore
+{
+    int kmer_length;
+    int bits_per_char;
+    int char_code[256];
+
+    static const int max_kmer_hits = 64;
+    static const int diagonals_scored = 3;
+
+    void index_kmers(const string &sequence, vector< pair<unsigned long long,int> > *kmers);
+    int diagonal_score(const string &query, const string &target, int diagonal);
+
+public:
+    Ungapped_prescore(bool is_protein);
+
+    int score(const string &query, const string &target);
+};
+}
+
+#endif // UNGAPPED_PRESCORE_H
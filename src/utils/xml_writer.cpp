@@ -37,17 +37,25 @@ void Xml_writer::write(ostream & output, const Node *root, const vector<Fasta_en
     if (! output) { throw IOException ("Xml_writer::write. Failed to open file"); }
 
 
-    output << "<ms_alignment>\n<newick>" << root->print_xml_tree() << "</newick>\n<nodes>\n";
+    output << "<ms_alignment>\n<newick>";
+    root->write_xml_tree(output);
+    output << "</newick>\n<nodes>\n";
 
     string seq, temp = "";  // Initialization
 
+    map<string,string> ids;
+    root->get_name_ids(&ids);
+
     vector<Fasta_entry>::const_iterator vi = seqs.begin();
 
     char c1,c2; int i1;
     // Main loop : for all sequences in vector container
     for (; vi != seqs.end(); vi++)
     {
-        string id = root->get_id_for_name(vi->name);
+        string id = "";
+        map<string,string>::const_iterator ii = ids.find(vi->name);
+        if(ii != ids.end())
+            id = ii->second;
 
         stringstream ss(vi->name);
         ss >> c1 >> i1 >> c2;